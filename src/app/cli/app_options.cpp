@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -11,8 +11,10 @@
 
 #include "app/cli/app_options.h"
 
+#include "base/convert_to.h"
 #include "base/fs.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace app {
@@ -30,6 +32,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
+  , m_jobs(m_po.add("jobs").mnemonic('j').requiresValue("<n>").description("Load and save the given files using <n>\nthreads (0 = number of CPU cores), other\nactions run in the main thread"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previously opened sprites"))
@@ -121,6 +124,13 @@ bool AppOptions::hasExporterParams() const
     m_po.enabled(m_sheet);
 }
 
+int AppOptions::jobs() const
+{
+  if (!m_po.enabled(m_jobs))
+    return 1;
+  return std::max(0, base::convert_to<int>(m_po.value_of(m_jobs)));
+}
+
 #ifdef _WIN32
 bool AppOptions::disableWintab() const
 {
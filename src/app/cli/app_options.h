@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -40,6 +40,7 @@ public:
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
   VerboseLevel verboseLevel() const { return m_verboseLevel; }
+  int jobs() const;
 
   const ValueList& values() const {
     return m_po.values();
@@ -116,6 +117,7 @@ private:
 #endif
   Option& m_batch;
   Option& m_preview;
+  Option& m_jobs;
   Option& m_saveAs;
   Option& m_palette;
   Option& m_scale;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,9 +14,11 @@
 namespace app {
 
   class AppOptions;
+  class CliJobs;
   class Context;
   class DocExporter;
   class Params;
+  struct CliJobsStats;
   struct CliOpenFile;
 
   class CliDelegate {
@@ -30,8 +32,14 @@ namespace app {
     virtual void beforeOpenFile(const CliOpenFile& cof) { }
     virtual void afterOpenFile(const CliOpenFile& cof) { }
     virtual void saveFile(Context* ctx, const CliOpenFile& cof) { }
+    // Returns false if the file must be saved with saveFile() (the
+    // file cannot be saved in the background threads of --jobs N).
+    virtual bool saveFileInBackground(Context* ctx,
+                                      const CliOpenFile& cof,
+                                      CliJobs& jobs) { return false; }
     virtual void loadPalette(Context* ctx, const std::string& filename) { }
     virtual void exportFiles(Context* ctx, DocExporter& exporter) { }
+    virtual void showJobsStats(const CliJobsStats& stats) { }
 #ifdef ENABLE_SCRIPTING
     virtual int execScript(const std::string& filename,
                            const Params& params) {
@@ -0,0 +1,310 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_jobs.h"
+
+#include "app/cli/cli_open_file.h"
+#include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/doc_snapshot.h"
+#include "app/file/file.h"
+#include "app/util/open_batch.h"
+#include "base/chrono.h"
+#include "base/log.h"
+#include "doc/parallel.h"
+#include "doc/selected_frames.h"
+#include "doc/sprite.h"
+
+#include <algorithm>
+
+namespace app {
+
+CliJobs::CliJobs(const int njobs)
+  : m_nthreads(njobs > 0 ? njobs: doc::hardware_threads())
+{
+  m_config.fillFromPreferences();
+}
+
+CliJobs::~CliJobs()
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+
+  // Saves that were not started are just discarded (waitSaves() is
+  // always called before when the CLI is processed successfully)
+  m_savesQueue.clear();
+  m_pendingSaves.clear();
+
+  // Delete documents that were loaded but never used (e.g. files
+  // that were loaded as part of a sequence of images)
+  for (auto& job : m_jobs) {
+    if (!job.taken)
+      delete job.doc;
+  }
+}
+
+double CliJobs::loadTime() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_loadTime;
+}
+
+double CliJobs::saveTime() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_saveTime;
+}
+
+void CliJobs::add(const std::string& filename, const bool oneFrame)
+{
+  ASSERT(m_threads.empty());
+
+  Job job;
+  job.filename = filename;
+  job.oneFrame = oneFrame;
+  m_jobs.push_back(job);
+}
+
+void CliJobs::start()
+{
+  // Threads are taken from the shared budget, so file formats that
+  // use threads to load/save files don't create more threads than
+  // hardware threads. At least one thread is used to load/save files
+  // in the background while the main thread processes them.
+  m_reservedThreads = std::make_unique<doc::ReservedThreads>(m_nthreads);
+  const int n = std::max(1, m_reservedThreads->count());
+  m_maxAhead = 2*n;
+  for (int i=0; i<n; ++i)
+    m_threads.emplace_back([this]{ workerThread(); });
+
+  LOG("CLI: Loading %d files using %d threads\n", int(m_jobs.size()), n);
+}
+
+bool CliJobs::open(Context* ctx,
+                   const std::string& filename,
+                   const bool oneFrame,
+                   base::paths& usedFiles)
+{
+  std::unique_lock lock(m_mutex);
+
+  auto it = std::find_if(
+    m_jobs.begin()+m_nextTake, m_jobs.end(),
+    [&filename, oneFrame](const Job& job){
+      return (job.filename == filename &&
+              job.oneFrame == oneFrame);
+    });
+  if (it == m_jobs.end())
+    return false;
+
+  // Previous jobs will not be used (the CLI is processed in order),
+  // so we can release their documents right now.
+  for (auto jt=m_jobs.begin()+m_nextTake; jt != it; ++jt) {
+    if (jt->ready && !jt->taken) {
+      delete jt->doc;
+      jt->doc = nullptr;
+      jt->taken = true;
+    }
+  }
+
+  // Move the window of files that can be loaded in advance
+  m_nextTake = int(it - m_jobs.begin()) + 1;
+  m_cv.notify_all();
+
+  Job& job = *it;
+  m_cv.wait(lock, [&job]{ return job.ready; });
+
+  Doc* doc = job.doc;
+  usedFiles = job.usedFiles;
+  job.doc = nullptr;
+  job.taken = true;
+  lock.unlock();
+
+  if (doc)
+    doc->setContext(ctx);
+  return true;
+}
+
+void CliJobs::save(Context* ctx, const CliOpenFile& cof)
+{
+  ASSERT(!m_threads.empty());
+
+  // Saves to the same file must be done in the same order (the last
+  // one wins), and we don't keep more than m_maxAhead snapshots in
+  // memory.
+  for (const auto& save : m_pendingSaves) {
+    if (save->filename == cof.filename ||
+        save->filenameFormat == cof.filenameFormat) {
+      waitSaves();
+      break;
+    }
+  }
+  while (int(m_pendingSaves.size()) >= m_maxAhead)
+    waitOldestSave();
+
+  auto save = std::make_unique<Save>();
+  save->filename = cof.filename;
+  save->filenameFormat = cof.filenameFormat;
+  save->snapshot = std::make_unique<DocSnapshot>();
+  {
+    const DocReader reader(cof.document, 500);
+    save->snapshot->create(cof.document);
+  }
+
+  // Same region of interest calculated by SaveFileCopyAs with the
+  // parameters given by DefaultCliDelegate::saveFile()
+  Doc* doc = save->snapshot->doc();
+  doc::SelectedFrames selFrames;
+  if (cof.hasFrameRange())
+    selFrames.insert(cof.fromFrame, cof.toFrame);
+
+  FileOpROI roi(doc, doc->sprite()->bounds(),
+                cof.slice, cof.tag,
+                selFrames, cof.hasFrameRange());
+
+  // The FileOp is created in the main thread as it can access the
+  // preferences (e.g. default format options).
+  save->fop.reset(
+    FileOp::createSaveDocumentOperation(
+      ctx, roi,
+      cof.filename,
+      cof.filenameFormat,
+      cof.ignoreEmpty));
+  if (!save->fop)
+    return;
+
+  // Keep the format options in the original document (as when the
+  // file is saved directly)
+  if (doc->formatOptions())
+    cof.document->setFormatOptions(doc->formatOptions());
+
+  {
+    std::lock_guard lock(m_mutex);
+    m_savesQueue.push_back(save.get());
+  }
+  m_pendingSaves.push_back(std::move(save));
+  m_cv.notify_all();
+}
+
+void CliJobs::waitSaves()
+{
+  while (!m_pendingSaves.empty())
+    waitOldestSave();
+}
+
+void CliJobs::waitOldestSave()
+{
+  ASSERT(!m_pendingSaves.empty());
+  std::unique_ptr<Save> save = std::move(m_pendingSaves.front());
+  m_pendingSaves.pop_front();
+  {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [&save]{ return save->done; });
+  }
+
+  if (save->fop->hasError()) {
+    Console console;
+    console.printf(save->fop->error().c_str());
+  }
+  ++m_saves;
+}
+
+bool CliJobs::canLoad() const
+{
+  return (m_nextLoad < int(m_jobs.size()) &&
+          m_nextLoad < m_nextTake + m_maxAhead);
+}
+
+void CliJobs::workerThread()
+{
+  while (true) {
+    Save* save = nullptr;
+    int i = -1;
+    {
+      std::unique_lock lock(m_mutex);
+      m_cv.wait(lock, [this]{
+        return (m_stop ||
+                !m_savesQueue.empty() ||
+                canLoad());
+      });
+      if (m_stop)
+        return;
+
+      if (!m_savesQueue.empty()) {
+        save = m_savesQueue.front();
+        m_savesQueue.pop_front();
+      }
+      else
+        i = m_nextLoad++;
+    }
+    if (save)
+      saveJob(*save);
+    else
+      loadJob(m_jobs[i]);
+  }
+}
+
+void CliJobs::loadJob(Job& job)
+{
+  base::Chrono chrono;
+  Doc* doc = nullptr;
+  base::paths usedFiles;
+
+  try {
+    // Isolated context to load this file, the document is added to
+    // the CliProcessor context later (from the main thread).
+    Context ctx;
+    OpenBatchOfFiles batch;
+    batch.open(&ctx, job.filename, job.oneFrame, &m_config);
+
+    doc = ctx.activeDocument();
+    if (doc)
+      doc->setContext(nullptr);
+    usedFiles = batch.usedFiles();
+  }
+  catch (const std::exception& ex) {
+    Console::showException(ex);
+  }
+
+  std::lock_guard lock(m_mutex);
+  job.doc = doc;
+  job.usedFiles = std::move(usedFiles);
+  job.ready = true;
+  m_loadTime += chrono.elapsed();
+  m_cv.notify_all();
+}
+
+void CliJobs::saveJob(Save& save)
+{
+  base::Chrono chrono;
+  FileOp* fop = save.fop.get();
+
+  try {
+    fop->operate(nullptr);
+  }
+  catch (const std::exception& ex) {
+    fop->setError("Error saving file:\n%s", ex.what());
+  }
+  fop->done();
+
+  std::lock_guard lock(m_mutex);
+  save.done = true;
+  m_saveTime += chrono.elapsed();
+  m_cv.notify_all();
+}
+
+} // namespace app
@@ -0,0 +1,137 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_JOBS_H_INCLUDED
+#define APP_CLI_CLI_JOBS_H_INCLUDED
+#pragma once
+
+#include "app/file/file_op_config.h"
+#include "base/paths.h"
+#include "doc/parallel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+  class Context;
+  class Doc;
+  class DocSnapshot;
+  class FileOp;
+  struct CliOpenFile;
+
+  struct CliJobsStats {
+    int jobs = 0;             // Number of threads used to load/save files
+    int files = 0;            // Number of opened files
+    int saves = 0;            // Number of files saved in background
+    double loadTime = 0.0;    // Seconds spent loading files (sum of all threads)
+    double saveTime = 0.0;    // Seconds spent saving files (sum of all threads)
+    double totalTime = 0.0;   // Seconds spent processing the whole CLI
+  };
+
+  // Loads and saves the files given in the CLI in background threads
+  // (--jobs N). Each file is loaded in its own isolated Context, and
+  // then the CliProcessor takes the loaded documents in the same order
+  // they were specified in the command line, so the rest of the
+  // processing (and its output) is the same as loading the files one
+  // by one. Files are saved from a snapshot of the document, so the
+  // CliProcessor can continue modifying it (--trim, --crop, etc.)
+  // while the file is being saved.
+  class CliJobs {
+  public:
+    CliJobs(const int njobs);
+    ~CliJobs();
+
+    int jobs() const { return int(m_threads.size()); }
+    int saves() const { return m_saves; }
+    double loadTime() const;
+    double saveTime() const;
+
+    // Adds a new file to be loaded, all files must be added before
+    // calling start().
+    void add(const std::string& filename, const bool oneFrame);
+    void start();
+
+    // Waits the given file to be loaded and adds its document to the
+    // given context. Returns false if the file is not in the list of
+    // jobs (so it must be loaded by the caller).
+    bool open(Context* ctx,
+              const std::string& filename,
+              const bool oneFrame,
+              base::paths& usedFiles);
+
+    // Saves a copy of cof.document (as it is right now) in a worker
+    // thread with the same options used by the SaveFileCopyAs command
+    // from the CLI. Must be called from the main thread.
+    void save(Context* ctx, const CliOpenFile& cof);
+
+    // Waits all pending saves, showing their errors in the same order
+    // they were started. Must be called before reading files that
+    // could be generated by a previous save.
+    void waitSaves();
+
+  private:
+    struct Job {
+      std::string filename;
+      bool oneFrame = false;
+      bool ready = false;
+      bool taken = false;
+      Doc* doc = nullptr;
+      base::paths usedFiles;
+    };
+
+    struct Save {
+      std::unique_ptr<DocSnapshot> snapshot;
+      std::unique_ptr<FileOp> fop;
+      std::string filename;
+      std::string filenameFormat;
+      bool done = false;
+    };
+
+    bool canLoad() const;
+    void workerThread();
+    void loadJob(Job& job);
+    void saveJob(Save& save);
+    void waitOldestSave();
+
+    std::vector<Job> m_jobs;
+    // Preferences to load files (filled in the main thread because
+    // worker threads cannot access the preferences)
+    FileOpConfig m_config;
+    std::unique_ptr<doc::ReservedThreads> m_reservedThreads;
+    std::vector<std::thread> m_threads;
+    int m_nthreads;
+    int m_maxAhead = 0;
+
+    // Next job to be loaded and next job to be taken by the
+    // CliProcessor. Workers don't go too far ahead of m_nextTake to
+    // avoid having too many loaded documents waiting.
+    int m_nextLoad = 0;
+    int m_nextTake = 0;
+    bool m_stop = false;
+    double m_loadTime = 0.0;
+
+    // Saves in the same order they were started by the CliProcessor
+    // (only the main thread adds/removes items), and saves that are
+    // waiting for a worker thread. Workers give priority to saves so
+    // we don't keep too many snapshots in memory.
+    std::deque<std::unique_ptr<Save>> m_pendingSaves;
+    std::deque<Save*> m_savesQueue;
+    int m_saves = 0;
+    double m_saveTime = 0.0;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+  };
+
+} // namespace app
+
+#endif
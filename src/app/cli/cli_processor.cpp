@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/ui_context.h"
+#include "base/chrono.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/split_string.h"
@@ -192,6 +193,9 @@ int CliProcessor::process(Context* ctx)
   }
   // Process other options and file names
   else if (!m_options.values().empty()) {
+    base::Chrono chrono;
+    startJobs();
+
 #ifdef ENABLE_SCRIPTING
     Params scriptParams;
 #endif
@@ -443,6 +447,9 @@ int CliProcessor::process(Context* ctx)
             ASSERT(cof.document == lastDoc);
 
             std::string filename = value.value();
+            // The palette file could be saved by a previous --save-as
+            if (m_jobs)
+              m_jobs->waitSaves();
             m_delegate->loadPalette(ctx, filename);
           }
           else {
@@ -627,9 +634,26 @@ int CliProcessor::process(Context* ctx)
         sheetType = SpriteSheetType::Rows;
       m_exporter->setSpriteSheetType(sheetType);
 
+      if (m_jobs)
+        m_jobs->waitSaves();
       m_delegate->exportFiles(ctx, *m_exporter.get());
       m_exporter.reset(nullptr);
     }
+
+    if (m_jobs) {
+      m_jobs->waitSaves();
+
+      CliJobsStats stats;
+      stats.jobs = m_jobs->jobs();
+      stats.files = m_openedFiles;
+      stats.saves = m_jobs->saves();
+      stats.loadTime = m_jobs->loadTime();
+      stats.saveTime = m_jobs->saveTime();
+      stats.totalTime = chrono.elapsed();
+      m_jobs.reset();
+
+      m_delegate->showJobsStats(stats);
+    }
   }
 
   // Running mode
@@ -645,19 +669,73 @@ int CliProcessor::process(Context* ctx)
   return 0;
 }
 
+void CliProcessor::startJobs()
+{
+  // Files are loaded/saved in background threads only in batch mode
+  // (in UI mode files can show dialogs while they are loaded)
+  const int njobs = m_options.jobs();
+  if (njobs == 1 || m_options.startUI())
+    return;
+
+  std::set<std::string> files;
+  std::set<std::string> savedFiles;
+  bool oneFrame = false;
+
+  for (const auto& value : m_options.values()) {
+    const AppOptions::Option* opt = value.option();
+    if (opt) {
+      if (opt == &m_options.oneFrame())
+        oneFrame = true;
+      // Don't load files in advance if they can be generated by
+      // the --save-as of a previous file.
+      else if (opt == &m_options.saveAs())
+        savedFiles.insert(base::normalize_path(value.value()));
+#ifdef ENABLE_SCRIPTING
+      // Scripts can do anything (e.g. generate the files to open),
+      // so we keep the sequential processing.
+      else if (opt == &m_options.script())
+        return;
+#endif
+    }
+    else {
+      std::string fn = base::normalize_path(value.value());
+      if (savedFiles.find(fn) == savedFiles.end() &&
+          files.insert(fn).second) {
+        if (!m_jobs)
+          m_jobs = std::make_unique<CliJobs>(njobs);
+        m_jobs->add(fn, oneFrame);
+      }
+    }
+  }
+
+  if (m_jobs)
+    m_jobs->start();
+}
+
 bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 {
   m_delegate->beforeOpenFile(cof);
 
   Doc* oldDoc = ctx->activeDocument();
 
-  m_batch.open(ctx,
-               cof.filename,
-               cof.oneFrame);
+  // Take the document from the background threads (--jobs N) or
+  // load it right now
+  base::paths usedFiles;
+  if (!m_jobs ||
+      !m_jobs->open(ctx, cof.filename, cof.oneFrame, usedFiles)) {
+    // The file could be generated by a previous --save-as
+    if (m_jobs)
+      m_jobs->waitSaves();
+
+    m_batch.open(ctx,
+                 cof.filename,
+                 cof.oneFrame);
+    usedFiles = m_batch.usedFiles();
+  }
 
   // Mark used file names as "already processed" so we don't try to
   // open then again
-  for (const auto& usedFn : m_batch.usedFiles()) {
+  for (const auto& usedFn : usedFiles) {
     auto fn = base::normalize_path(usedFn);
     m_usedFiles.insert(fn);
 
@@ -673,6 +751,8 @@ bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
   cof.document = doc;
 
   if (doc) {
+    ++m_openedFiles;
+
     // Show all layers
     if (cof.allLayers) {
       for (doc::Layer* layer : doc->sprite()->allLayers())
@@ -879,8 +959,11 @@ void CliProcessor::saveFile(Context* ctx, const CliOpenFile& cof)
         itemCof.filename = filename_formatter(filenameFormat, fnInfo);
         itemCof.filenameFormat = filename_formatter(filenameFormat, fnInfo, false);
 
-        // Call delegate
-        m_delegate->saveFile(ctx, itemCof);
+        // Call delegate (the file is saved in a background thread
+        // with --jobs N)
+        if (!m_jobs ||
+            !m_delegate->saveFileInBackground(ctx, itemCof, *m_jobs))
+          m_delegate->saveFile(ctx, itemCof);
 
         if (cof.trim) {
           ctx->executeCommand(undoCommand);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/cli/cli_delegate.h"
+#include "app/cli/cli_jobs.h"
 #include "app/cli/cli_open_file.h"
 #include "app/doc_exporter.h"
 #include "app/util/open_batch.h"
@@ -44,6 +45,7 @@ namespace app {
                              doc::SelectedLayers& filteredLayers);
 
   private:
+    void startJobs();
     bool openFile(Context* ctx, CliOpenFile& cof);
     void saveFile(Context* ctx, const CliOpenFile& cof);
 
@@ -65,6 +67,10 @@ namespace app {
     // load a sequence of files) so we don't ask for them again.
     std::set<std::string> m_usedFiles;
     OpenBatchOfFiles m_batch;
+
+    // Files loaded in background threads (--jobs N)
+    std::unique_ptr<CliJobs> m_jobs;
+    int m_openedFiles = 0;
   };
 
 } // namespace app
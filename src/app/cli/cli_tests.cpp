@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -93,3 +93,10 @@ TEST(Cli, Version)
   p.process(nullptr);
   EXPECT_TRUE(d.versionWasShown());
 }
+
+TEST(Cli, Jobs)
+{
+  EXPECT_EQ(1, args({ })->jobs());
+  EXPECT_EQ(4, args({ "--jobs", "4" })->jobs());
+  EXPECT_EQ(0, args({ "-j", "0" })->jobs());
+}
@@ -12,6 +12,7 @@
 #include "app/cli/default_cli_delegate.h"
 
 #include "app/cli/app_options.h"
+#include "app/cli/cli_jobs.h"
 #include "app/cli/cli_open_file.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
@@ -26,6 +27,7 @@
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
+#include "fmt/format.h"
 #include "ver/info.h"
 
 #ifdef ENABLE_SCRIPTING
@@ -33,6 +35,7 @@
   #include "app/script/engine.h"
 #endif
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
@@ -102,6 +105,14 @@ void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
   ctx->executeCommand(saveAsCommand, params);
 }
 
+bool DefaultCliDelegate::saveFileInBackground(Context* ctx,
+                                              const CliOpenFile& cof,
+                                              CliJobs& jobs)
+{
+  jobs.save(ctx, cof);
+  return true;
+}
+
 void DefaultCliDelegate::loadPalette(Context* ctx,
                                      const std::string& filename)
 {
@@ -123,6 +134,10 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
 {
   LOG("APP: Exporting sheet...\n");
 
+  // The sprite sheet isn't used after saving it, so the texture can
+  // be rendered and saved by rows (without keeping it in memory).
+  exporter.setStreamTexture(true);
+
   base::task_token token;
   std::unique_ptr<Doc> spriteSheet(
     exporter.exportSheet(ctx, token));
@@ -132,6 +147,19 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
   LOG("APP: Export sprite sheet: Done\n");
 }
 
+void DefaultCliDelegate::showJobsStats(const CliJobsStats& stats)
+{
+  // Use stderr to keep stdout clean for --list-* and --data output
+  const double t = std::max(stats.totalTime, 0.001);
+  std::cerr
+    << fmt::format("Processed {0} files in {1:.2f}s ({2:.1f} files/s)\n"
+                   "Loading time {4:.2f}s in {3} threads ({5:.1f}x the total time)\n"
+                   "Saved {6} files in background ({7:.2f}s, {8:.1f}x the total time)\n",
+                   stats.files, stats.totalTime, stats.files / t,
+                   stats.jobs, stats.loadTime, stats.loadTime / t,
+                   stats.saves, stats.saveTime, stats.saveTime / t);
+}
+
 #ifdef ENABLE_SCRIPTING
 int DefaultCliDelegate::execScript(const std::string& filename,
                                    const Params& params)
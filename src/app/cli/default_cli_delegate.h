@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,8 +19,12 @@ namespace app {
     void showVersion() override;
     void afterOpenFile(const CliOpenFile& cof) override;
     void saveFile(Context* ctx, const CliOpenFile& cof) override;
+    bool saveFileInBackground(Context* ctx,
+                              const CliOpenFile& cof,
+                              CliJobs& jobs) override;
     void loadPalette(Context* ctx, const std::string& filename) override;
     void exportFiles(Context* ctx, DocExporter& exporter) override;
+    void showJobsStats(const CliJobsStats& stats) override;
 #ifdef ENABLE_SCRIPTING
     int execScript(const std::string& filename,
                    const Params& params) override;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,7 +19,9 @@
 #include "doc/cel_io.h"
 #include "doc/image_io.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/subobjects_io.h"
+#include "doc/tileset.h"
 
 namespace app {
 namespace cmd {
@@ -94,6 +96,13 @@ void AddCel::addCel(Layer* layer, Cel* cel)
   static_cast<LayerImage*>(layer)->addCel(cel);
   layer->incrementVersion();
 
+  // Count the tiles of the new tilemap (linked cels share the same
+  // tilemap, so they are counted just once)
+  if (layer->isTilemap() && cel->links() == 0) {
+    if (Tileset* tileset = static_cast<LayerTilemap*>(layer)->tileset())
+      tileset->updateTilesHistogram(cel->image(), 1);
+  }
+
   Doc* doc = static_cast<Doc*>(cel->document());
   DocEvent ev(doc);
   ev.sprite(layer->sprite());
@@ -111,6 +120,11 @@ void AddCel::removeCel(Layer* layer, Cel* cel)
   ev.cel(cel);
   doc->notify_observers<DocEvent&>(&DocObserver::onBeforeRemoveCel, ev);
 
+  if (layer->isTilemap() && cel->links() == 0) {
+    if (Tileset* tileset = static_cast<LayerTilemap*>(layer)->tileset())
+      tileset->updateTilesHistogram(cel->image(), -1);
+  }
+
   static_cast<LayerImage*>(layer)->removeCel(cel);
   layer->incrementVersion();
 
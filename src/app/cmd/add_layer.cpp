@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +15,7 @@
 #include "app/doc_event.h"
 #include "doc/layer.h"
 #include "doc/layer_io.h"
+#include "doc/sprite.h"
 #include "doc/subobjects_io.h"
 
 namespace app {
@@ -69,6 +71,10 @@ void AddLayer::addLayer(Layer* group, Layer* newLayer, Layer* afterThis)
   group->incrementVersion();
   group->sprite()->incrementVersion();
 
+  // Tilemaps of the new layer must be counted in the tiles histogram
+  if (newLayer->isTilemap() || newLayer->isGroup())
+    group->sprite()->invalidateTilesHistograms();
+
   Doc* doc = static_cast<Doc*>(group->sprite()->document());
   DocEvent ev(doc);
   ev.sprite(group->sprite());
@@ -88,6 +94,9 @@ void AddLayer::removeLayer(Layer* group, Layer* layer)
   group->incrementVersion();
   group->sprite()->incrementVersion();
 
+  if (layer->isTilemap() || layer->isGroup())
+    group->sprite()->invalidateTilesHistograms();
+
   doc->notify_observers<DocEvent&>(&DocObserver::onAfterRemoveLayer, ev);
 
   delete layer;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -100,12 +100,14 @@ void ClearMask::clear()
   Mask* mask = doc->mask();
 
   Grid grid = cel->grid();
+  updateTilesHistogram(-1);
   doc::algorithm::fill_selection(
     cel->image(),
     cel->bounds(),
     mask,
     m_bgcolor,
     (cel->image()->isTilemap() ? &grid: nullptr));
+  updateTilesHistogram(1);
 }
 
 void ClearMask::restore()
@@ -114,10 +116,28 @@ void ClearMask::restore()
     return;
 
   Cel* cel = this->cel();
+  updateTilesHistogram(-1);
   copy_image(cel->image(),
              m_copy.get(),
              m_cropPos.x,
              m_cropPos.y);
+  updateTilesHistogram(1);
+}
+
+// Updates the tiles histogram of the tileset with the cleared area
+// of the tilemap.
+void ClearMask::updateTilesHistogram(const int delta)
+{
+  Cel* cel = this->cel();
+  if (!cel->layer()->isTilemap())
+    return;
+
+  if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset()) {
+    tileset->updateTilesHistogram(
+      cel->image(),
+      gfx::Rect(m_cropPos, m_copy->size()),
+      delta);
+  }
 }
 
 } // namespace cmd
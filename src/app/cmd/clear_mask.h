@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -39,6 +39,7 @@ namespace cmd {
   private:
     void clear();
     void restore();
+    void updateTilesHistogram(const int delta);
 
     CmdSequence m_seq;
     ImageRef m_copy;
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +15,7 @@
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/primitives.h"
 
 namespace app {
@@ -42,6 +44,11 @@ ClearRect::ClearRect(Cel* cel, const gfx::Rect& bounds)
 
   m_dstImage.reset(new WithImage(image));
 
+  if (cel->layer()->isTilemap()) {
+    if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset())
+      m_tileset.reset(new WithTileset(tileset));
+  }
+
   Doc* doc = static_cast<Doc*>(cel->document());
   m_bgcolor = doc->bgColor(cel->layer());
 
@@ -72,16 +79,30 @@ void ClearRect::onRedo()
 
 void ClearRect::clear()
 {
+  updateTilesHistogram(-1);
   fill_rect(m_dstImage->image(),
             m_offsetX, m_offsetY,
             m_offsetX + m_copy->width() - 1,
             m_offsetY + m_copy->height() - 1,
             m_bgcolor);
+  updateTilesHistogram(1);
 }
 
 void ClearRect::restore()
 {
+  updateTilesHistogram(-1);
   copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  updateTilesHistogram(1);
+}
+
+void ClearRect::updateTilesHistogram(const int delta)
+{
+  if (m_tileset) {
+    m_tileset->tileset()->updateTilesHistogram(
+      m_dstImage->image(),
+      gfx::Rect(m_offsetX, m_offsetY, m_copy->width(), m_copy->height()),
+      delta);
+  }
 }
 
 } // namespace cmd
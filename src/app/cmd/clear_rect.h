@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
+#include "app/cmd/with_tileset.h"
 #include "app/cmd_sequence.h"
 #include "doc/image_ref.h"
 #include "gfx/fwd.h"
@@ -40,9 +42,12 @@ namespace cmd {
   private:
     void clear();
     void restore();
+    void updateTilesHistogram(const int delta);
 
     CmdSequence m_seq;
     std::unique_ptr<WithImage> m_dstImage;
+    // Tileset used by the tilemap image (nullptr if it's not a tilemap)
+    std::unique_ptr<WithTileset> m_tileset;
     ImageRef m_copy;
     int m_offsetX, m_offsetY;
     color_t m_bgcolor;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -57,6 +57,16 @@ CopyTileRegion::CopyTileRegion(Image* dst, const Image* src,
 {
 }
 
+CopyTilemapRegion::CopyTilemapRegion(Image* dst, const Image* src,
+                                     const gfx::Region& region,
+                                     const gfx::Point& dstPos,
+                                     const doc::Tileset* tileset)
+  : CopyRegion(dst, src, region, dstPos)
+  , m_tilesetId(tileset ? tileset->id(): NullId)
+{
+  ASSERT(dst->pixelFormat() == IMAGE_TILEMAP);
+}
+
 void CopyRegion::onExecute()
 {
   if (!m_alreadyCopied)
@@ -78,8 +88,10 @@ void CopyRegion::swap()
   Image* image = this->image();
   ASSERT(image);
 
+  updateTilesHistogram(image, m_region, -1);
   swap_image_region_with_buffer(m_region, image, m_buffer);
   image->incrementVersion();
+  updateTilesHistogram(image, m_region, 1);
 
   rehash();
 }
@@ -102,5 +114,15 @@ void CopyTileRegion::rehash()
   }
 }
 
+void CopyTilemapRegion::updateTilesHistogram(const Image* image,
+                                             const gfx::Region& region,
+                                             const int delta)
+{
+  if (auto tileset = get<Tileset>(m_tilesetId)) {
+    for (const gfx::Rect& rc : region)
+      tileset->updateTilesHistogram(image, rc, delta);
+  }
+}
+
 } // namespace cmd
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -47,6 +47,9 @@ namespace cmd {
   private:
     void swap();
     virtual void rehash() { }
+    virtual void updateTilesHistogram(const Image* image,
+                                      const gfx::Region& region,
+                                      const int delta) { }
 
     bool m_alreadyCopied;
     gfx::Region m_region;
@@ -69,6 +72,24 @@ namespace cmd {
     doc::ObjectId m_tilesetId;
   };
 
+  // Copies a region of a tilemap (used by a tilemap layer with the
+  // given tileset) keeping the tiles histogram of the tileset
+  // updated.
+  class CopyTilemapRegion : public CopyRegion {
+  public:
+    CopyTilemapRegion(Image* dst, const Image* src,
+                      const gfx::Region& region,
+                      const gfx::Point& dstPos,
+                      const doc::Tileset* tileset);
+
+  private:
+    void updateTilesHistogram(const Image* image,
+                              const gfx::Region& region,
+                              const int delta) override;
+
+    doc::ObjectId m_tilesetId;
+  };
+
 } // namespace cmd
 } // namespace app
 
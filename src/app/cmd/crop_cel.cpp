@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C)      2016  David Capello
 //
 // This program is distributed under the terms of
@@ -51,8 +51,9 @@ void CropCel::cropImage(const gfx::Point& origin,
   Cel* cel = this->cel();
 
   gfx::Rect localBounds(bounds);
+  doc::Tileset* tileset = nullptr;
   if (cel->layer()->isTilemap()) {
-    doc::Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
+    tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
     if (tileset) {
       doc::Grid grid = tileset->grid();
       localBounds = grid.canvasToTile(bounds);
@@ -70,8 +71,15 @@ void CropCel::cropImage(const gfx::Point& origin,
     image->setId(id);
     image->setVersion(ver);
     image->incrementVersion();
+
+    if (tileset)
+      tileset->updateTilesHistogram(cel->image(), -1);
+
     cel->data()->setImage(image, cel->layer());
     cel->data()->incrementVersion();
+
+    if (tileset)
+      tileset->updateTilesHistogram(image.get(), 1);
   }
 
   if (cel->data()->position() != origin) {
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,12 +12,14 @@
 #include "app/cmd/flip_masked_cel.h"
 
 #include "app/cmd/copy_rect.h"
+#include "app/cmd/copy_region.h"
 #include "app/doc.h"
 #include "app/util/autocrop.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 
 namespace app {
@@ -42,8 +45,16 @@ FlipMaskedCel::FlipMaskedCel(Cel* cel, doc::algorithm::FlipType flipType)
 
   int x1, y1, x2, y2;
   if (get_shrink_rect2(&x1, &y1, &x2, &y2, image, copy.get())) {
-    add(new cmd::CopyRect(image, copy.get(),
-                          gfx::Clip(x1, y1, x1, y1, x2-x1+1, y2-y1+1)));
+    const gfx::Rect rc(x1, y1, x2-x1+1, y2-y1+1);
+    // Tilemaps are copied updating the tiles histogram
+    if (cel->layer()->isTilemap()) {
+      add(new cmd::CopyTilemapRegion(
+            image, copy.get(), gfx::Region(rc), gfx::Point(0, 0),
+            static_cast<LayerTilemap*>(cel->layer())->tileset()));
+    }
+    else {
+      add(new cmd::CopyRect(image, copy.get(), gfx::Clip(rc)));
+    }
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2016  David Capello
 //
 // This program is distributed under the terms of
@@ -41,9 +41,10 @@ void PatchCel::onExecute()
   gfx::Rect newBounds;
   gfx::Region regionInTiles;
   doc::Grid grid;
+  doc::Tileset* tileset = nullptr;
   if (cel->image()->pixelFormat() == IMAGE_TILEMAP) {
     newBounds = cel->bounds() | m_region.bounds();
-    auto tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
+    tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
     grid = tileset->grid();
     grid.origin(m_pos);
     regionInTiles = grid.canvasToTile(m_region);
@@ -57,10 +58,11 @@ void PatchCel::onExecute()
 
   if (cel->image()->pixelFormat() == IMAGE_TILEMAP) {
     executeAndAdd(
-      new CopyRegion(cel->image(),
-                     m_patch,
-                     regionInTiles,
-                     -grid.canvasToTile(cel->position())));
+      new CopyTilemapRegion(cel->image(),
+                            m_patch,
+                            regionInTiles,
+                            -grid.canvasToTile(cel->position()),
+                            tileset));
   }
   else {
     executeAndAdd(
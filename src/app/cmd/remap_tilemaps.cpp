@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -50,6 +50,7 @@ void RemapTilemaps::remapTileset(Tileset* tileset, const Remap& remap)
 {
   Sprite* spr = tileset->sprite();
   spr->remapTilemaps(tileset, remap);
+  tileset->remapTilesHistogram(remap);
 
   Doc* doc = static_cast<Doc*>(spr->document());
   DocEvent ev(doc);
@@ -20,6 +20,8 @@
 #include "doc/subobjects_io.h"
 #include "doc/tilesets.h"
 
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -72,9 +74,19 @@ void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
 {
   Sprite* spr = sprite();
 
+  // Tilesets of the tilemaps that are replaced (to update their tiles
+  // histogram)
+  std::vector<Tileset*> tilesets;
+
   for (Cel* cel : spr->uniqueCels()) {
-    if (cel->image()->id() == oldId)
+    if (cel->image()->id() == oldId) {
       cel->data()->incrementVersion();
+
+      if (cel->layer()->isTilemap()) {
+        if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset())
+          tilesets.push_back(tileset);
+      }
+    }
   }
 
   if (spr->hasTilesets()) {
@@ -90,7 +102,16 @@ void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
     }
   }
 
+  if (!tilesets.empty()) {
+    const ImageRef oldImage = spr->getImageRef(oldId);
+    for (Tileset* tileset : tilesets)
+      tileset->updateTilesHistogram(oldImage.get(), -1);
+  }
+
   spr->replaceImage(oldId, newImage);
+
+  for (Tileset* tileset : tilesets)
+    tileset->updateTilesHistogram(newImage.get(), 1);
 }
 
 } // namespace cmd
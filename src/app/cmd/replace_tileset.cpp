@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2023  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -68,6 +68,7 @@ void ReplaceTileset::replaceTileset(Tileset* newTileset)
   spr->replaceTileset(m_tsi, newTileset);
   spr->tilesets()->incrementVersion();
   spr->incrementVersion();
+  newTileset->invalidateTilesHistogram();
 }
 
 } // namespace cmd
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -41,6 +42,8 @@ void SetCelData::onExecute()
   cel->setDataRef(m_newData);
   cel->incrementVersion();
   m_newData.reset();
+
+  invalidateTilesHistograms();
 }
 
 void SetCelData::onUndo()
@@ -62,6 +65,7 @@ void SetCelData::onUndo()
   }
 
   cel->incrementVersion();
+  invalidateTilesHistograms();
 }
 
 void SetCelData::onRedo()
@@ -74,6 +78,7 @@ void SetCelData::onRedo()
   ASSERT(newData);
   cel->setDataRef(newData);
   cel->incrementVersion();
+  invalidateTilesHistograms();
 }
 
 void SetCelData::createCopy()
@@ -87,5 +92,14 @@ void SetCelData::createCopy()
     cel->layer());
 }
 
+// The tilemap of the cel was replaced with a tilemap that could be
+// shared with other cels, so we count all tiles again.
+void SetCelData::invalidateTilesHistograms()
+{
+  Cel* cel = this->cel();
+  if (cel->layer()->isTilemap())
+    cel->sprite()->invalidateTilesHistograms();
+}
+
 } // namespace cmd
 } // namespace app
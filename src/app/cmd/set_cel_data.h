@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -34,6 +35,7 @@ namespace cmd {
 
   private:
     void createCopy();
+    void invalidateTilesHistograms();
 
     ObjectId m_oldDataId;
     ObjectId m_oldImageId;
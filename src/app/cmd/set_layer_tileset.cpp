@@ -31,6 +31,7 @@ void SetLayerTileset::onExecute()
   auto layer = static_cast<LayerTilemap*>(this->layer());
   layer->setTilesetIndex(m_newTsi);
   layer->incrementVersion();
+  layer->sprite()->invalidateTilesHistograms();
 }
 
 void SetLayerTileset::onUndo()
@@ -38,6 +39,7 @@ void SetLayerTileset::onUndo()
   auto layer = static_cast<LayerTilemap*>(this->layer());
   layer->setTilesetIndex(m_oldTsi);
   layer->incrementVersion();
+  layer->sprite()->invalidateTilesHistograms();
 }
 
 void SetLayerTileset::onFireNotifications()
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,6 +30,7 @@ void SetTotalFrames::onExecute()
   Sprite* spr = sprite();
   spr->setTotalFrames(m_newFrames);
   spr->incrementVersion();
+  spr->invalidateTilesHistograms();
 }
 
 void SetTotalFrames::onUndo()
@@ -36,6 +38,7 @@ void SetTotalFrames::onUndo()
   Sprite* spr = sprite();
   spr->setTotalFrames(m_oldFrames);
   spr->incrementVersion();
+  spr->invalidateTilesHistograms();
 }
 
 void SetTotalFrames::onFireNotifications()
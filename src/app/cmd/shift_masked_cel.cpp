@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,7 @@
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 
 namespace app {
@@ -60,6 +61,13 @@ void ShiftMaskedCel::shift(int dx, int dy)
     newImage->setVersion(ver);
     newImage->incrementVersion();
     cel->data()->setImage(newImage, cel->layer());
+
+    if (cel->layer()->isTilemap()) {
+      if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset()) {
+        tileset->updateTilesHistogram(oldImage.get(), -1);
+        tileset->updateTilesHistogram(newImage.get(), 1);
+      }
+    }
   }
   cel->data()->setBounds(newBounds);
   cel->data()->incrementVersion();
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +14,7 @@
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/sprite.h"
 
 namespace app {
@@ -51,6 +53,12 @@ void UnlinkCel::onExecute()
 
   cel->setDataRef(celDataCopy);
   cel->incrementVersion();
+
+  // The tilemap copy is a new tilemap to count in the histogram
+  if (cel->layer()->isTilemap()) {
+    if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset())
+      tileset->updateTilesHistogram(imgCopy.get(), 1);
+  }
 }
 
 void UnlinkCel::onUndo()
@@ -59,6 +67,11 @@ void UnlinkCel::onUndo()
   CelDataRef oldCelData = cel->sprite()->getCelDataRef(m_oldCelDataId);
   ASSERT(oldCelData);
 
+  if (cel->layer()->isTilemap()) {
+    if (Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset())
+      tileset->updateTilesHistogram(cel->image(), -1);
+  }
+
   cel->setDataRef(oldCelData);
   cel->incrementVersion();
 }
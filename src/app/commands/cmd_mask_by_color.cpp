@@ -27,8 +27,11 @@
 #include "base/chrono.h"
 #include "base/convert_to.h"
 #include "base/scoped_value.h"
+#include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/selected_frames.h"
 #include "doc/sprite.h"
 #include "ui/box.h"
 #include "ui/button.h"
@@ -38,6 +41,9 @@
 #include "ui/widget.h"
 #include "ui/window.h"
 
+#include <set>
+#include <vector>
+
 // Uncomment to see the performance of doc::MaskBoundaries ctor
 //#define SHOW_BOUNDARIES_GEN_PERFORMANCE
 
@@ -75,9 +81,14 @@ private:
   Window* m_window = nullptr;
   ColorButton* m_buttonColor = nullptr;
   CheckBox* m_checkPreview = nullptr;
+  CheckBox* m_checkAllFrames = nullptr;
   Slider* m_sliderTolerance = nullptr;
   SelModeField* m_selMode = nullptr;
   bool m_isOrigMaskVisible;
+
+  // Cels of the active layer in all frames (or in the selected
+  // frames) to select the color in all of them.
+  std::vector<const Cel*> m_cels;
 };
 
 MaskByColorCommand::MaskByColorCommand()
@@ -128,22 +139,50 @@ void MaskByColorCommand::onExecute(Context* context)
   m_selMode->setupTooltips(tooltipManager);
 
   m_checkPreview = new CheckBox(Strings::mask_by_color_preview());
+  m_checkAllFrames = new CheckBox(Strings::mask_by_color_all_frames());
   auto button_ok = new Button(Strings::mask_by_color_ok());
   auto button_cancel = new Button(Strings::mask_by_color_cancel());
 
   m_checkPreview->processMnemonicFromText();
+  m_checkAllFrames->processMnemonicFromText();
   button_ok->processMnemonicFromText();
   button_cancel->processMnemonicFromText();
 
   if (get_config_bool(ConfigSection, "Preview", true))
     m_checkPreview->setSelected(true);
 
+  // Cels of the active layer in the selected frames of the timeline
+  // (or in all frames) for the "All Frames" option.
+  m_cels.clear();
+  const Layer* layer = reader.layer();
+  if (layer && layer->isImage() && !layer->isTilemap()) {
+    const Site* site = reader.site();
+    SelectedFrames frames;
+    if (site->inFrames() || site->inCels())
+      frames = site->selectedFrames();
+    else
+      frames.insert(0, sprite->lastFrame());
+
+    // Linked cels are included just once
+    std::set<const CelData*> celData;
+    for (frame_t frame : frames) {
+      const Cel* cel = layer->cel(frame);
+      if (cel && celData.insert(cel->data()).second)
+        m_cels.push_back(cel);
+    }
+  }
+  if (m_cels.size() > 1)
+    m_checkAllFrames->setSelected(get_config_bool(ConfigSection, "AllFrames", false));
+  else
+    m_checkAllFrames->setEnabled(false);
+
   button_ok->Click.connect([this, button_ok]{ m_window->closeWindow(button_ok); });
   button_cancel->Click.connect([this, button_cancel]{ m_window->closeWindow(button_cancel); });
 
   m_buttonColor->Change.connect([&]{ maskPreview(reader); });
   m_sliderTolerance->Change.connect([&]{ maskPreview(reader); });
   m_checkPreview->Click.connect([&]{ maskPreview(reader); });
+  m_checkAllFrames->Click.connect([&]{ maskPreview(reader); });
   m_selMode->ModeChange.connect([&]{ maskPreview(reader); });
 
   button_ok->setFocusMagnet(true);
@@ -155,6 +194,7 @@ void MaskByColorCommand::onExecute(Context* context)
   box1->addChild(m_selMode);
   box1->addChild(box2);
   box1->addChild(box3);
+  box1->addChild(m_checkAllFrames);
   box1->addChild(m_checkPreview);
   box1->addChild(box4);
   box2->addChild(label_color);
@@ -196,6 +236,8 @@ void MaskByColorCommand::onExecute(Context* context)
 
     set_config_int(ConfigSection, "Tolerance", m_sliderTolerance->getValue());
     set_config_bool(ConfigSection, "Preview", m_checkPreview->isSelected());
+    if (m_checkAllFrames->isEnabled())
+      set_config_bool(ConfigSection, "AllFrames", m_checkAllFrames->isSelected());
   }
   else {
     document->generateMaskBoundaries();
@@ -219,8 +261,14 @@ Mask* MaskByColorCommand::generateMask(const Mask& origMask,
   int tolerance = m_sliderTolerance->getValue();
 
   std::unique_ptr<Mask> mask(new Mask());
-  mask->byColor(image, color, tolerance);
-  mask->offsetOrigin(xpos, ypos);
+  if (m_checkAllFrames->isEnabled() &&
+      m_checkAllFrames->isSelected()) {
+    mask->byColor(m_cels, color, tolerance);
+  }
+  else {
+    mask->byColor(image, color, tolerance);
+    mask->offsetOrigin(xpos, ypos);
+  }
 
   if (!origMask.isEmpty() && m_isOrigMaskVisible) {
     switch (mode) {
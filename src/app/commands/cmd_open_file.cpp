@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -79,6 +79,7 @@ OpenFileCommand::OpenFileCommand()
   , m_repeatCheckbox(false)
   , m_oneFrame(false)
   , m_seqDecision(gen::SequenceDecision::ASK)
+  , m_config(nullptr)
 {
 }
 
@@ -182,7 +183,7 @@ void OpenFileCommand::onExecute(Context* context)
 
     std::unique_ptr<FileOp> fop(
       FileOp::createLoadDocumentOperation(
-        context, filename, flags));
+        context, filename, flags, m_config));
     bool unrecent = false;
 
     // Do nothing (the user cancelled or something like that)
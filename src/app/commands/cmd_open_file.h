@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,8 @@
 
 namespace app {
 
+  struct FileOpConfig;
+
   class OpenFileCommand : public Command {
   public:
     OpenFileCommand();
@@ -29,6 +31,12 @@ namespace app {
       return m_seqDecision;
     }
 
+    // Configuration to load files when the command is executed from
+    // a non-UI thread (where the FileOp cannot read the preferences).
+    void setFileOpConfig(const FileOpConfig* config) {
+      m_config = config;
+    }
+
   protected:
     void onLoadParams(const Params& params) override;
     void onExecute(Context* context) override;
@@ -40,6 +48,7 @@ namespace app {
     bool m_oneFrame;
     base::paths m_usedFiles;
     gen::SequenceDecision m_seqDecision;
+    const FileOpConfig* m_config;
   };
 
 } // namespace app
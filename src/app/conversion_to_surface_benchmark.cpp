@@ -0,0 +1,70 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/conversion_to_surface.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "os/surface.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace app;
+using namespace doc;
+
+void BM_ConvertImageToSurface(benchmark::State& state) {
+  const PixelFormat pixelFormat = PixelFormat(state.range(0));
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(i, 255-i, (i*7) & 255, 255));
+
+  ImageRef image(Image::create(pixelFormat, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image.get(), x, y,
+                (pixelFormat == IMAGE_RGB ? rgba(x, y, x+y, 255):
+                 pixelFormat == IMAGE_GRAYSCALE ? graya(x+y, 255):
+                 pixelFormat == IMAGE_BITMAP ? (x+y) & 1:
+                                               (x+y) & 255));
+
+  os::SurfaceRef surface = os::instance()->makeRgbaSurface(w, h);
+
+  while (state.KeepRunning()) {
+    convert_image_to_surface(image.get(), &pal, surface.get(),
+                             0, 0, 0, 0, w, h);
+  }
+}
+
+BENCHMARK(BM_ConvertImageToSurface)
+  ->Args({ IMAGE_RGB, 256, 256 })
+  ->Args({ IMAGE_RGB, 1024, 1024 })
+  ->Args({ IMAGE_RGB, 4096, 4096 })
+  ->Args({ IMAGE_GRAYSCALE, 256, 256 })
+  ->Args({ IMAGE_GRAYSCALE, 1024, 1024 })
+  ->Args({ IMAGE_GRAYSCALE, 4096, 4096 })
+  ->Args({ IMAGE_INDEXED, 256, 256 })
+  ->Args({ IMAGE_INDEXED, 1024, 1024 })
+  ->Args({ IMAGE_INDEXED, 4096, 4096 })
+  ->Args({ IMAGE_BITMAP, 256, 256 })
+  ->Args({ IMAGE_BITMAP, 1024, 1024 })
+  ->Unit(benchmark::kMicrosecond);
+
+int app_main(int argc, char* argv[])
+{
+  os::SystemRef system(os::make_system());
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -19,6 +19,7 @@
 #include "app/crash/write_document.h"
 #include "app/doc.h"
 #include "app/doc_access.h"
+#include "app/doc_snapshot.h"
 #include "app/file/file.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
@@ -230,9 +231,24 @@ public:
 
 bool Session::saveDocumentChanges(Doc* doc)
 {
-  CustomWeakDocReader reader(doc);
-  if (!reader.isLocked())
-    return false;
+  // The document is locked only to create a snapshot of it (copying
+  // just the objects that are not saved yet in the backup), then the
+  // lock is released so the user can continue editing the sprite
+  // while we write the backup files.
+  DocSnapshot snapshot;
+  {
+    CustomWeakDocReader reader(doc);
+    if (!reader.isLocked())
+      return false;
+
+    const doc::ObjectId docId = doc->id();
+    if (!snapshot.create(doc,
+                         [docId](const doc::Object* obj){
+                           return is_object_saved(docId, obj);
+                         },
+                         &reader))
+      return false;
+  }
 
   app::Context ctx;
   std::string dir = base::join_path(m_path,
@@ -254,7 +270,7 @@ bool Session::saveDocumentChanges(Doc* doc)
   }
 
   // Save document information
-  return write_document(dir, doc, &reader);
+  return write_document(dir, snapshot.doc(), nullptr);
 }
 
 void Session::removeDocument(Doc* doc)
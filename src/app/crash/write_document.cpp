@@ -395,6 +395,17 @@ bool write_document(const std::string& dir,
   return writer.saveDocument();
 }
 
+bool is_object_saved(doc::ObjectId docId, const doc::Object* obj)
+{
+  auto it = g_docVersions.find(docId);
+  if (it == g_docVersions.end())
+    return false;
+
+  auto jt = it->second.find(obj->id());
+  return (jt != it->second.end() &&
+          jt->second.newer() == obj->version());
+}
+
 void delete_document_internals(Doc* doc)
 {
   ASSERT(doc);
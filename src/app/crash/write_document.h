@@ -10,8 +10,11 @@
 
 #include <string>
 
+#include "doc/object_id.h"
+
 namespace doc {
   class CancelIO;
+  class Object;
 }
 
 namespace app {
@@ -22,6 +25,10 @@ namespace app {
     bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
     void delete_document_internals(Doc* doc);
 
+    // Returns true if the given object (with its current version) is
+    // already saved in the backup of the given document.
+    bool is_object_saved(doc::ObjectId docId, const doc::Object* obj);
+
   } // namespace crash
 } // namespace app
 
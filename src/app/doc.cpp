@@ -394,23 +394,30 @@ void Doc::destroyMaskBoundaries()
 
 void Doc::generateMaskBoundaries(const Mask* mask)
 {
-  m_maskBoundaries.reset();
-
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
+    if (!isMaskVisible()) {     // The mask is hidden
+      m_maskBoundaries.reset();
       return;                   // Done, without boundaries
+    }
     else
       mask = this->mask();      // Use the document mask
   }
 
   ASSERT(mask);
 
-  if (!mask->isEmpty()) {
-    m_maskBoundaries.regen(mask->bitmap());
-    m_maskBoundaries.offset(mask->bounds().x,
-                            mask->bounds().y);
+  if (mask->isPlainRectangle()) {
+    // Avoid creating the bitmap of rectangular selections
+    m_maskBoundaries.regen(mask->bounds());
   }
+  else if (!mask->isEmpty()) {
+    // Only the modified area of the mask is regenerated (or the
+    // boundaries are just moved if the mask was moved)
+    m_maskBoundaries.regen(mask->bitmap(),
+                           mask->bounds().origin());
+  }
+  else
+    m_maskBoundaries.reset();
 
   notifySelectionBoundariesChanged();
 }
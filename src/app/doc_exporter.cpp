@@ -19,6 +19,7 @@
 #include "app/file/file.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
+#include "app/skyline_packer.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
 #include "base/convert_to.h"
@@ -29,10 +30,9 @@
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/images_map.h"
-#include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/selected_frames.h"
 #include "doc/selected_layers.h"
@@ -48,12 +48,15 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -62,6 +65,12 @@ using namespace doc;
 
 namespace {
 
+// Approximate number of bytes of each band of rows when the texture
+// is rendered and saved by rows (see DocExporter::setStreamTexture()).
+// It's the same size used by the PNG encoder to compress bands of rows
+// in parallel, so each band is rendered once for each compressed band.
+const std::size_t kTextureBandSize = 1024*1024;
+
 std::string escape_for_json(const std::string& path)
 {
   std::string res = path;
@@ -235,32 +244,83 @@ public:
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
 
-  ImageRef createRender(ImageBufferPtr& imageBuf) {
-    ASSERT(m_sprite);
+  // Layers of the sprite that must be visible to render this sample.
+  void showLayers(RestoreVisibleLayers& layersVisibility) const {
+    if (m_selLayers)
+      layersVisibility.showSelectedLayers(m_sprite,
+                                          *m_selLayers);
+  }
 
+  // Returns true if both samples are rendered with the same visible
+  // layers (so they can be rendered at the same time from different
+  // threads without changing the layers visibility).
+  bool hasSameLayers(const Sample& other) const {
+    return (m_sprite == other.m_sprite &&
+            m_selLayers == other.m_selLayers);
+  }
+
+  ImageRef createRender(ImageBufferPtr& imageBuf) const {
     // We use the m_image as it is, it doesn't require a special
     // render.
     if (m_image)
       return m_image;
 
-    ImageRef render(
+    RestoreVisibleLayers layersVisibility;
+    showLayers(layersVisibility);
+
+    render::Render render;
+    return createRender(render, imageBuf);
+  }
+
+  // Creates the render of the sample using the given render and
+  // image buffer. The layers must be visible (see showLayers()).
+  ImageRef createRender(render::Render& render,
+                        ImageBufferPtr& imageBuf) const {
+    ASSERT(m_sprite);
+
+    if (m_image)
+      return m_image;
+
+    ImageRef image(
       Image::create(m_sprite->pixelFormat(),
                     m_trimmedBounds.w,
                     m_trimmedBounds.h,
                     imageBuf));
-    render->setMaskColor(m_sprite->transparentColor());
-    clear_image(render.get(), m_sprite->transparentColor());
-    renderSample(render.get(), 0, 0, false);
-    return render;
+    image->setMaskColor(m_sprite->transparentColor());
+    clear_image(image.get(), m_sprite->transparentColor());
+    renderSample(render, image.get(), 0, 0, false);
+    return image;
   }
 
   void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
     RestoreVisibleLayers layersVisibility;
-    if (m_selLayers)
-      layersVisibility.showSelectedLayers(m_sprite,
-                                          *m_selLayers);
+    showLayers(layersVisibility);
 
     render::Render render;
+    renderSample(render, dst, x, y, extrude);
+  }
+
+  // Renders the sample in "dst" using the given render. The layers
+  // must be visible (see showLayers()).
+  void renderSample(render::Render& render,
+                    doc::Image* dst, int x, int y, bool extrude) const {
+    // Only the area inside "dst" is rendered (e.g. when the texture
+    // is rendered in bands of rows, "dst" is just a band).
+    auto renderClip = [this, dst, &render](gfx::Clip clip) {
+      const gfx::Rect dstBounds = clip.dstBounds() & dst->bounds();
+      if (dstBounds.isEmpty())
+        return;
+      clip.src += dstBounds.origin() - clip.dst;
+      clip.dst = dstBounds.origin();
+      clip.size = dstBounds.size();
+
+      if (m_image) {
+        dst->copy(m_image.get(), clip);
+      }
+      else {
+        render.renderSprite(dst, m_sprite, m_frame, clip);
+      }
+    };
 
     // 1) We cannot use the Preferences because this is called from a non-UI thread
     // 2) We should use the new blend mode always when we're saving files
@@ -287,24 +347,13 @@ public:
       // side.
       for (int j=0; j<3; ++j) {
         for (int i=0; i<3; ++i) {
-          gfx::Clip clip(x+dx[i], y+dy[j], gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j]));
-          if (m_image) {
-            dst->copy(m_image.get(), clip);
-          }
-          else {
-            render.renderSprite(dst, m_sprite, m_frame, clip);
-          }
+          renderClip(gfx::Clip(x+dx[i], y+dy[j],
+                               gfx::RectT<int>(srcx[i], srcy[j], szx[i], szy[j])));
         }
       }
     }
     else {
-      gfx::Clip clip(x, y, m_trimmedBounds);
-      if (m_image) {
-        dst->copy(m_image.get(), clip);
-      }
-      else {
-        render.renderSprite(dst, m_sprite, m_frame, clip);
-      }
+      renderClip(gfx::Clip(x, y, m_trimmedBounds));
     }
   }
 
@@ -353,6 +402,106 @@ private:
   List m_samples;
 };
 
+// Threads to capture/render samples, each one with its own
+// render::Render and image buffer. Consecutive samples that use the
+// same visible layers are processed in parallel, the layers
+// visibility is changed only from the calling thread between these
+// groups of samples.
+class DocExporter::SampleWorkers {
+public:
+  using Func = std::function<void(const int i,
+                                  render::Render& render,
+                                  ImageBufferPtr& imageBuf)>;
+
+  SampleWorkers()
+    : m_workers(doc::hardware_threads()) {
+    for (auto& worker : m_workers)
+      worker.imageBuf = std::make_shared<doc::ImageBuffer>();
+  }
+
+  // Calls func(i, ...) for each i-th sample of "samples". Progress
+  // is reported to the "token" from 0.0 to 1.0.
+  void run(const std::vector<const Sample*>& samples,
+           const Func& func,
+           base::task_token& token) {
+    const int n = int(samples.size());
+    std::atomic<int> done(0);
+
+    for (int begin=0; begin<n; ) {
+      if (token.canceled())
+        return;
+
+      int end = begin+1;
+      while (end < n && samples[end]->hasSameLayers(*samples[begin]))
+        ++end;
+
+      RestoreVisibleLayers layersVisibility;
+      samples[begin]->showLayers(layersVisibility);
+
+      std::atomic<int> next(begin);
+      auto work = [&](Worker& worker, const bool mainThread) {
+        int i;
+        while (!token.canceled() && (i = next++) < end) {
+          func(i, worker.render, worker.imageBuf);
+          ++done;
+          if (mainThread)
+            token.set_progress(float(done) / n);
+        }
+      };
+
+      doc::run_workers(
+        std::min(int(m_workers.size()), end-begin),
+        [this, &work](const int t){ work(m_workers[t], t == 0); });
+
+      begin = end;
+    }
+  }
+
+private:
+  struct Worker {
+    render::Render render;
+    ImageBufferPtr imageBuf;
+  };
+  std::vector<Worker> m_workers;
+};
+
+// Finds samples with the same pixels as previous samples. Only the
+// hash of each sample render is kept in memory, the render of a
+// previous sample is generated again when its hash matches to
+// compare the pixels.
+class DocExporter::DuplicatedSamples {
+public:
+  DuplicatedSamples(const Samples& samples)
+    : m_samples(samples)
+    , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
+    , m_otherBuf(std::make_shared<doc::ImageBuffer>()) {
+  }
+
+  // Returns the index of a previous sample with the same pixels of
+  // the given "sample" (with index "i"), or -1 if there is no
+  // duplicate (in this case the sample is added to the map).
+  int find(const Sample& sample, const uint32_t i) {
+    const ImageRef render(sample.createRender(m_sampleBuf));
+    const size_t hash = calculate_image_hash(render.get(), render->bounds());
+
+    auto range = m_hashes.equal_range(hash);
+    for (auto it=range.first; it!=range.second; ++it) {
+      const ImageRef other(m_samples[it->second].createRender(m_otherBuf));
+      if (is_same_image(render.get(), other.get()))
+        return int(it->second);
+    }
+
+    m_hashes.emplace(hash, i);
+    return -1;
+  }
+
+private:
+  const Samples& m_samples;
+  std::unordered_multimap<size_t, uint32_t> m_hashes;
+  doc::ImageBufferPtr m_sampleBuf;
+  doc::ImageBufferPtr m_otherBuf;
+};
+
 class DocExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -392,7 +541,7 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
+    DuplicatedSamples duplicates(samples);
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -418,20 +567,13 @@ public:
       }
 
       if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
+        const int j = duplicates.find(sample, i);
+        if (j >= 0) {
           sample.setDuplicated();
           sample.setSharedBounds(samples[j].sharedBounds());
           ++i;
           continue;
         }
-        else {
-          duplicates[sampleRender] = i;
-        }
       }
 
       const Sprite* sprite = sample.sprite();
@@ -533,8 +675,8 @@ public:
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
+    DuplicatedSamples duplicates(samples);
+    std::vector<gfx::Size> sizes;
 
     uint32_t i = 0;
     for (auto& sample : samples) {
@@ -548,25 +690,45 @@ public:
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
+      const int j = duplicates.find(sample, i);
+      if (j >= 0) {
         sample.setDuplicated();
         sample.setSharedBounds(samples[j].sharedBounds());
       }
       else {
-        duplicates[sampleRender] = i;
-        pr.add(sample.requiredSize());
+        sizes.push_back(sample.requiredSize());
       }
       ++i;
     }
 
     token.set_progress_range(0.3f, 0.4f);
+    if (sizes.size() < kSkylinePackerMinSamples) {
+      gfx::PackingRects pr(borderPadding, shapePadding);
+      packSamples(pr, sizes, samples, width, height, token);
+    }
+    else {
+      SkylinePacker pr(borderPadding, shapePadding);
+      packSamples(pr, sizes, samples, width, height, token);
+    }
+    token.set_progress_range(0.0f, 1.0f);
+  }
+
+private:
+  // gfx::PackingRects tries all free positions for each rectangle
+  // (and repacks everything for each candidate texture size), so it's
+  // used only for small sheets (where it gives the same result as in
+  // previous versions). The SkylinePacker is used for big sheets.
+  static constexpr std::size_t kSkylinePackerMinSamples = 256;
+
+  template<typename Packer>
+  static void packSamples(Packer& pr,
+                          const std::vector<gfx::Size>& sizes,
+                          Samples& samples,
+                          int& width, int& height,
+                          base::task_token& token) {
+    for (const gfx::Size& sz : sizes)
+      pr.add(sz);
+
     if (width == 0 || height == 0) {
       gfx::Size sz = pr.bestFit(token, width, height);
       width = sz.w;
@@ -575,7 +737,6 @@ public:
     else {
       pr.pack(gfx::Size(width, height), token);
     }
-    token.set_progress_range(0.0f, 1.0f);
 
     auto it = pr.begin();
     for (auto& sample : samples) {
@@ -592,7 +753,6 @@ public:
 
 DocExporter::DocExporter()
   : m_docBuf(std::make_shared<doc::ImageBuffer>())
-  , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
 {
   m_cache.spriteId = doc::NullId;
   reset();
@@ -624,6 +784,7 @@ void DocExporter::reset()
   m_listTags = false;
   m_listLayers = false;
   m_listSlices = false;
+  m_streamTexture = false;
   m_documents.clear();
 }
 
@@ -683,18 +844,30 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
     return nullptr;
   token.set_progress(0.4f);
 
+  // The texture can be rendered and saved by bands of rows if the
+  // file format supports it (the texture is never in memory).
+  const bool streaming =
+    (m_streamTexture &&
+     !m_textureFilename.empty() &&
+     format_supports_scanlines(m_textureFilename));
+
   // 3) Create and render the texture.
   std::unique_ptr<Doc> textureDocument(
-    createEmptyTexture(samples, token));
+    createEmptyTexture(samples, !streaming, token));
   if (token.canceled())
     return nullptr;
   token.set_progress(0.6f);
 
   Sprite* texture = textureDocument->sprite();
-  Image* textureImage = texture->root()->firstLayer()
-    ->cel(frame_t(0))->image();
+  if (streaming) {
+    makeSamplesCompatible(ctx, samples, texture->pixelFormat());
+  }
+  else {
+    Image* textureImage = texture->root()->firstLayer()
+      ->cel(frame_t(0))->image();
 
-  renderTexture(ctx, samples, textureImage, token);
+    renderTexture(ctx, samples, textureImage, token);
+  }
   if (token.canceled())
     return nullptr;
   token.set_progress(0.8f);
@@ -713,13 +886,18 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   if (!m_textureFilename.empty()) {
     DX_TRACE("DX: exportSheet", m_textureFilename);
     textureDocument->setFilename(m_textureFilename.c_str());
-    int ret = save_document(ctx, textureDocument.get());
+    int ret = (streaming ? saveTextureByRows(ctx, samples, textureDocument.get()):
+                           save_document(ctx, textureDocument.get()));
     if (ret == 0)
       textureDocument->markAsSaved();
   }
 
   token.set_progress(1.0f);
 
+  // The streamed texture doesn't contain the rendered pixels
+  if (streaming)
+    return nullptr;
+
   return textureDocument.release();
 }
 
@@ -884,6 +1062,22 @@ void DocExporter::captureSamples(Samples& samples,
 {
   DX_TRACE("DX: Capture samples");
 
+  // Samples are captured in three steps: 1) create all samples (in
+  // order), 2) render and trim the samples that need it using several
+  // threads, and 3) add the final samples (in the same order).
+  struct CapturedSample {
+    Sample sample;
+    gfx::Rect spriteBounds;
+    bool splitGrid = false;
+    bool needsTrim = false;      // Render+trim this sample in step 2
+    int linkedTo = -1;           // Index of a previous CapturedSample with the same cel
+    bool notEmpty = false;       // Result of the trim (false if it's completely trimmed out)
+    gfx::Rect frameBounds;       // Result of the trim
+    int firstSample = -1;        // Index of the first sample added in "samples"
+    CapturedSample(const Sample& sample) : sample(sample) { }
+  };
+  std::vector<CapturedSample> captured;
+
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -962,13 +1156,16 @@ void DocExporter::captureSamples(Samples& samples,
 
       std::string filename = filename_formatter(format, fnInfo);
 
-      Sample sample(
-        (item.image ? item.image->size():
-         item.splitGrid ? sprite->gridBounds().size():
-                          sprite->size()),
-        doc, sprite, item.image, item.selLayers.get(),
-        frame, innerTag, filename,
-        m_innerPadding, m_extrude);
+      CapturedSample c(
+        Sample((item.image ? item.image->size():
+                item.splitGrid ? sprite->gridBounds().size():
+                                 sprite->size()),
+               doc, sprite, item.image, item.selLayers.get(),
+               frame, innerTag, filename,
+               m_innerPadding, m_extrude));
+      c.spriteBounds = spriteBounds;
+      c.splitGrid = item.splitGrid;
+
       Cel* cel = nullptr;
       Cel* link = nullptr;
       bool done = false;
@@ -980,22 +1177,15 @@ void DocExporter::captureSamples(Samples& samples,
       }
 
       // Re-use linked samples
-      bool alreadyTrimmed = false;
       if (link && m_mergeDuplicates &&
           !item.isOneImageOnly()) {
-        for (const Sample& other : samples) {
-          if (token.canceled())
-            return;
-
+        for (int i=0; i<int(captured.size()); ++i) {
+          const Sample& other = captured[i].sample;
           if (other.sprite() == sprite &&
               other.layer() == layer &&
               other.frame() == link->frame()) {
-            ASSERT(!other.isLinked());
-
-            sample.setLinked();
-            sample.setTrimmedBounds(other.trimmedBounds());
-            sample.setSharedBounds(other.sharedBounds());
-            alreadyTrimmed = true;
+            ASSERT(captured[i].linkedTo < 0);
+            c.linkedTo = i;
             done = true;
             break;
           }
@@ -1011,11 +1201,44 @@ void DocExporter::captureSamples(Samples& samples,
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
+        c.needsTrim = true;
+      }
+      // If "Ignore Empty" is checked and the item is a tile...
+      else if (m_ignoreEmptyCels && item.isOneImageOnly()) {
+        // Skip empty tile
+        if (is_empty_image(item.image.get()))
+          continue;
+      }
 
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
+      captured.push_back(c);
+    }
+  }
+
+  // Render and trim samples
+  {
+    std::vector<int> indexes;
+    std::vector<const Sample*> toTrim;
+    for (int i=0; i<int(captured.size()); ++i) {
+      if (captured[i].needsTrim) {
+        indexes.push_back(i);
+        toTrim.push_back(&captured[i].sample);
+      }
+    }
 
+    token.set_progress_range(0.0f, 0.2f);
+    SampleWorkers workers;
+    workers.run(
+      toTrim,
+      [this, &captured, &indexes](const int i,
+                                  render::Render& render,
+                                  ImageBufferPtr& imageBuf) {
+        CapturedSample& c = captured[indexes[i]];
+        const Sample& sample = c.sample;
+        const Sprite* sprite = sample.sprite();
+        const Layer* layer = sample.layer();
+        ImageRef sampleRender(sample.createRender(render, imageBuf));
+
+        doc::color_t refColor = 0;
         if (m_trimCels) {
           if ((layer &&
                layer->isBackground()) ||
@@ -1031,78 +1254,101 @@ void DocExporter::captureSamples(Samples& samples,
         else if (m_ignoreEmptyCels)
           refColor = sprite->transparentColor();
 
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
-
-          // Should we ignore this empty frame? (i.e. don't include
-          // the frame in the sprite sheet)
-          if (m_ignoreEmptyCels)
-            continue;
+        c.notEmpty =
+          algorithm::shrink_bounds(sampleRender.get(),
+                                   refColor,
+                                   nullptr,          // layer
+                                   c.spriteBounds,   // startBounds
+                                   c.frameBounds);   // output bounds
+      },
+      token);
+    token.set_progress_range(0.0f, 1.0f);
+    if (token.canceled())
+      return;
+  }
 
-          // Create an entry with Size(1, 1) for this completely
-          // trimmed frame anyway so we conserve the frame information
-          // (position and duration of the frame in the JSON data, and
-          // the relative position of the frame in frame tags).
-          sample.setTrimmedBounds(frameBounds = gfx::Rect(0, 0, 1, 1));
-        }
+  for (CapturedSample& c : captured) {
+    Sample& sample = c.sample;
+    bool alreadyTrimmed = false;
 
-        if (m_trimCels) {
-          // TODO merge this code with the code in DocApi::trimSprite()
-          if (m_trimByGrid) {
-            const gfx::Rect& gridBounds = doc->sprite()->gridBounds();
-            gfx::Point posTopLeft =
-              snap_to_grid(gridBounds,
-                           frameBounds.origin(),
-                           PreferSnapTo::FloorGrid);
-            gfx::Point posBottomRight =
-              snap_to_grid(gridBounds,
-                           frameBounds.point2(),
-                           PreferSnapTo::CeilGrid);
-            frameBounds = gfx::Rect(posTopLeft, posBottomRight);
-          }
-          sample.setTrimmedBounds(frameBounds);
-          alreadyTrimmed = true;
-        }
-      }
-      // If "Ignore Empty" is checked and the item is a tile...
-      else if (m_ignoreEmptyCels && item.isOneImageOnly()) {
-        // Skip empty tile
-        if (is_empty_image(item.image.get()))
-          continue;
-      }
+    if (c.linkedTo >= 0) {
+      const CapturedSample& other = captured[c.linkedTo];
 
-      if (!alreadyTrimmed && m_trimSprite)
-        sample.setTrimmedBounds(spriteBounds);
+      // The linked cel was ignored (e.g. because it's empty)
+      if (other.firstSample < 0)
+        continue;
 
-      if (item.splitGrid) {
-        const gfx::Rect& gridBounds = sprite->gridBounds();
-        gfx::Point initPos(0, 0), pos;
-        initPos = pos = snap_to_grid(gridBounds, initPos, PreferSnapTo::BoxOrigin);
+      sample.setLinked();
+      sample.setTrimmedBounds(samples[other.firstSample].trimmedBounds());
+      sample.setSharedBounds(samples[other.firstSample].sharedBounds());
+      alreadyTrimmed = true;
+    }
+    else if (c.needsTrim) {
+      gfx::Rect frameBounds = c.frameBounds;
+      if (!c.notEmpty) {
+        // If shrink_bounds() returns false, it's because the whole
+        // image is transparent (equal to the mask color).
+
+        // Should we ignore this empty frame? (i.e. don't include
+        // the frame in the sprite sheet)
+        if (m_ignoreEmptyCels)
+          continue;
 
-        for (; pos.y+gridBounds.h <= spriteBounds.h; pos.y+=gridBounds.h) {
-          for (pos.x=initPos.x; pos.x+gridBounds.w <= spriteBounds.w; pos.x+=gridBounds.w) {
-            const gfx::Rect cellBounds(pos, gridBounds.size());
-            sample.setTrimmedBounds(cellBounds);
-            sample.setSharedBounds(std::make_shared<gfx::Rect>(sample.inTextureBounds()));
-            samples.addSample(sample);
-          }
-        }
+        // Create an entry with Size(1, 1) for this completely
+        // trimmed frame anyway so we conserve the frame information
+        // (position and duration of the frame in the JSON data, and
+        // the relative position of the frame in frame tags).
+        sample.setTrimmedBounds(frameBounds = gfx::Rect(0, 0, 1, 1));
       }
-      else {
-        samples.addSample(sample);
+
+      if (m_trimCels) {
+        // TODO merge this code with the code in DocApi::trimSprite()
+        if (m_trimByGrid) {
+          const gfx::Rect& gridBounds = sample.sprite()->gridBounds();
+          gfx::Point posTopLeft =
+            snap_to_grid(gridBounds,
+                         frameBounds.origin(),
+                         PreferSnapTo::FloorGrid);
+          gfx::Point posBottomRight =
+            snap_to_grid(gridBounds,
+                         frameBounds.point2(),
+                         PreferSnapTo::CeilGrid);
+          frameBounds = gfx::Rect(posTopLeft, posBottomRight);
+        }
+        sample.setTrimmedBounds(frameBounds);
+        alreadyTrimmed = true;
       }
+    }
 
-      DX_TRACE("DX:   - Sample:",
-               sample.document()->filename(),
-               "Layer:", sample.layer() ? sample.layer()->name(): "-",
-               "TrimmedBounds:", sample.trimmedBounds(),
-               "InTextureBounds:", sample.inTextureBounds());
+    if (!alreadyTrimmed && m_trimSprite)
+      sample.setTrimmedBounds(c.spriteBounds);
+
+    const int firstSample = samples.size();
+    if (c.splitGrid) {
+      const gfx::Rect& gridBounds = sample.sprite()->gridBounds();
+      gfx::Point initPos(0, 0), pos;
+      initPos = pos = snap_to_grid(gridBounds, initPos, PreferSnapTo::BoxOrigin);
+
+      for (; pos.y+gridBounds.h <= c.spriteBounds.h; pos.y+=gridBounds.h) {
+        for (pos.x=initPos.x; pos.x+gridBounds.w <= c.spriteBounds.w; pos.x+=gridBounds.w) {
+          const gfx::Rect cellBounds(pos, gridBounds.size());
+          sample.setTrimmedBounds(cellBounds);
+          sample.setSharedBounds(std::make_shared<gfx::Rect>(sample.inTextureBounds()));
+          samples.addSample(sample);
+        }
+      }
     }
+    else {
+      samples.addSample(sample);
+    }
+    if (samples.size() > firstSample)
+      c.firstSample = firstSample;
+
+    DX_TRACE("DX:   - Sample:",
+             sample.document()->filename(),
+             "Layer:", sample.layer() ? sample.layer()->name(): "-",
+             "TrimmedBounds:", sample.trimmedBounds(),
+             "InTextureBounds:", sample.inTextureBounds());
   }
 }
 
@@ -1178,6 +1424,7 @@ gfx::Size DocExporter::calculateSheetSize(const Samples& samples,
 }
 
 Doc* DocExporter::createEmptyTexture(const Samples& samples,
+                                     const bool withImage,
                                      base::task_token& token) const
 {
   ColorMode colorMode = ColorMode::INDEXED;
@@ -1246,15 +1493,23 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   if (token.canceled())
     return nullptr;
 
-  std::unique_ptr<Sprite> sprite(
-    Sprite::MakeStdSprite(
-      ImageSpec(colorMode,
-                std::max(textureSize.w, m_textureWidth),
-                std::max(textureSize.h, m_textureHeight),
-                transparentColor,
-                (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone())),
-      maxColors,
-      m_docBuf));
+  const ImageSpec spec(colorMode,
+                       std::max(textureSize.w, m_textureWidth),
+                       std::max(textureSize.h, m_textureHeight),
+                       transparentColor,
+                       (colorSpace ? colorSpace: gfx::ColorSpace::MakeNone()));
+
+  std::unique_ptr<Sprite> sprite;
+  if (withImage) {
+    sprite.reset(Sprite::MakeStdSprite(spec, maxColors, m_docBuf));
+  }
+  // Empty layer, the texture will be rendered by rows when it's saved
+  else {
+    sprite = std::make_unique<Sprite>(spec, maxColors);
+    auto layer = new LayerImage(sprite.get());
+    layer->setName("Layer 1");
+    sprite->root()->addLayer(layer);
+  }
 
   if (palette.size() > 0)
     sprite->setPalette(&palette, false);
@@ -1265,48 +1520,132 @@ Doc* DocExporter::createEmptyTexture(const Samples& samples,
   return document.release();
 }
 
-void DocExporter::renderTexture(Context* ctx,
-                                const Samples& samples,
-                                Image* textureImage,
-                                base::task_token& token) const
+void DocExporter::makeSamplesCompatible(Context* ctx,
+                                        const Samples& samples,
+                                        const PixelFormat pixelFormat) const
 {
-  textureImage->clear(textureImage->maskColor());
-
-  int i = 0;
   for (const auto& sample : samples) {
-    if (token.canceled())
-      return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
-
     if (sample.isLinked() ||
         sample.isDuplicated() ||
-        sample.isEmpty()) {
-      ++i;
+        sample.isEmpty())
       continue;
-    }
 
     // Make the sprite compatible with the texture so the render()
     // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
+    if (sample.sprite()->pixelFormat() != pixelFormat) {
       cmd::SetPixelFormat(
         sample.sprite(),
-        textureImage->pixelFormat(),
+        pixelFormat,
         render::Dithering(),
         Sprite::DefaultRgbMapAlgorithm(), // TODO add rgbmap algorithm preference
         nullptr, // toGray is not needed because the texture is Indexed or RGB
         nullptr) // TODO add a delegate to show progress
         .execute(ctx);
     }
+  }
+}
+
+void DocExporter::renderTexture(Context* ctx,
+                                const Samples& samples,
+                                Image* textureImage,
+                                base::task_token& token) const
+{
+  textureImage->clear(textureImage->maskColor());
+  makeSamplesCompatible(ctx, samples, textureImage->pixelFormat());
+
+  std::vector<const Sample*> toRender;
+  for (const auto& sample : samples) {
+    if (!sample.isLinked() &&
+        !sample.isDuplicated() &&
+        !sample.isEmpty())
+      toRender.push_back(&sample);
+  }
+
+  // Each sample is rendered in its own area of the texture, so
+  // several samples can be rendered at the same time.
+  token.set_progress_range(0.6f, 0.8f);
+  SampleWorkers workers;
+  workers.run(
+    toRender,
+    [this, &toRender, textureImage](const int i,
+                                    render::Render& render,
+                                    ImageBufferPtr&) {
+      const Sample* sample = toRender[i];
+      sample->renderSample(
+        render,
+        textureImage,
+        sample->inTextureBounds().x+m_innerPadding,
+        sample->inTextureBounds().y+m_innerPadding,
+        m_extrude);
+    },
+    token);
+  token.set_progress_range(0.0f, 1.0f);
+}
+
+void DocExporter::renderTextureRows(const Samples& samples,
+                                    const int y,
+                                    Image* dst) const
+{
+  dst->clear(dst->maskColor());
+
+  const gfx::Rect rows(0, y, dst->width(), dst->height());
+  for (const auto& sample : samples) {
+    if (sample.isLinked() ||
+        sample.isDuplicated() ||
+        sample.isEmpty())
+      continue;
+
+    const gfx::Rect& bounds = sample.inTextureBounds();
+    if (!bounds.intersects(rows))
+      continue;
 
     sample.renderSample(
-      textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
+      dst,
+      bounds.x+m_innerPadding,
+      bounds.y+m_innerPadding-y,
       m_extrude);
-    ++i;
   }
 }
 
+int DocExporter::saveTextureByRows(Context* ctx,
+                                   const Samples& samples,
+                                   Doc* textureDocument) const
+{
+  std::unique_ptr<FileOp> fop(
+    FileOp::createSaveDocumentOperation(
+      ctx,
+      FileOpROI(textureDocument, textureDocument->sprite()->bounds(),
+                "", "", SelectedFrames(), false),
+      textureDocument->filename(), "",
+      false));
+  if (!fop)
+    return -1;
+
+  if (!fop->hasError()) {
+    const Sprite* texture = textureDocument->sprite();
+    const std::size_t rowSize =
+      std::max<std::size_t>(1, std::size_t(texture->width()) *
+                               bytes_per_pixel_for_colormode(texture->colorMode()));
+    fop->setRowsRenderer(
+      [this, &samples](const int y, Image* dst){
+        renderTextureRows(samples, y, dst);
+      },
+      int(std::clamp<std::size_t>(kTextureBandSize / rowSize, 1,
+                                   std::max(1, texture->height()))));
+  }
+
+  // Operate in this same thread
+  fop->operate();
+  fop->done();
+
+  if (fop->hasError()) {
+    Console console(ctx);
+    console.printf(fop->error().c_str());
+  }
+
+  return (!fop->hasError() ? 0: -1);
+}
+
 void DocExporter::trimTexture(const Samples& samples,
                               doc::Sprite* texture) const
 {
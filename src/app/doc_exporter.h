@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "doc/image_buffer.h"
 #include "doc/object_id.h"
 #include "doc/object_version.h"
+#include "doc/pixel_format.h"
 #include "gfx/fwd.h"
 #include "gfx/rect.h"
 
@@ -79,6 +80,12 @@ namespace app {
     void setListLayers(bool value) { m_listLayers = value; }
     void setListSlices(bool value) { m_listSlices = value; }
 
+    // Renders and saves the texture in bands of rows when the texture
+    // file format supports it (e.g. PNG), so the whole texture is
+    // never in memory. In this case exportSheet() returns nullptr
+    // (e.g. useful from the CLI where the texture is not needed).
+    void setStreamTexture(bool stream) { m_streamTexture = stream; }
+
     void addImage(
       Doc* doc,
       const doc::ImageRef& image);
@@ -102,6 +109,8 @@ namespace app {
   private:
     class Sample;
     class Samples;
+    class DuplicatedSamples;
+    class SampleWorkers;
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
@@ -119,11 +128,21 @@ namespace app {
     gfx::Size calculateSheetSize(const Samples& samples,
                                  base::task_token& token) const;
     Doc* createEmptyTexture(const Samples& samples,
+                            const bool withImage,
                             base::task_token& token) const;
+    void makeSamplesCompatible(Context* ctx,
+                               const Samples& samples,
+                               const doc::PixelFormat pixelFormat) const;
     void renderTexture(Context* ctx,
                        const Samples& samples,
                        doc::Image* textureImage,
                        base::task_token& token) const;
+    void renderTextureRows(const Samples& samples,
+                           const int y,
+                           doc::Image* dst) const;
+    int saveTextureByRows(Context* ctx,
+                          const Samples& samples,
+                          Doc* textureDocument) const;
     void trimTexture(const Samples& samples, doc::Sprite* texture) const;
     void createDataFile(const Samples& samples, std::ostream& os, doc::Sprite* texture);
 
@@ -181,11 +200,11 @@ namespace app {
     bool m_listTags;
     bool m_listLayers;
     bool m_listSlices;
+    bool m_streamTexture;
     Items m_documents;
 
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
-    doc::ImageBufferPtr m_sampleBuf;
 
     // Trimmed bounds of a specific sprite (to avoid recalculating
     // this)
@@ -0,0 +1,271 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_snapshot.h"
+
+#include "app/doc.h"
+#include "doc/cancel_io.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+// Objects without version are marked with the version 1 (as the
+// backup process does), so future modifications of the original
+// object can be detected comparing its version with the snapshot.
+void mark_version(Object* obj)
+{
+  if (!obj->version())
+    obj->incrementVersion();
+}
+
+template<typename T>
+T* copy_id_and_version(Object* orig, T* copy)
+{
+  mark_version(orig);
+  copy->setSnapshotId(orig->id());
+  copy->setVersion(orig->version());
+  return copy;
+}
+
+} // anonymous namespace
+
+DocSnapshot::DocSnapshot()
+{
+}
+
+DocSnapshot::~DocSnapshot()
+{
+  // Delete the document before the cached images/cel data
+  m_doc.reset();
+}
+
+bool DocSnapshot::create(Doc* doc,
+                         const SkipObject& skip,
+                         doc::CancelIO* cancel)
+{
+  m_doc.reset();
+  m_images.clear();
+  m_celDatas.clear();
+  m_skip = skip;
+  m_cancel = cancel;
+
+  Sprite* spr = doc->sprite();
+  std::unique_ptr<Sprite> sprCopy(
+    new Sprite(spr->spec(), spr->palette(0)->size()));
+
+  sprCopy->setTotalFrames(spr->totalFrames());
+  for (frame_t fr=0; fr<spr->totalFrames(); ++fr)
+    sprCopy->setFrameDuration(fr, spr->frameDuration(fr));
+  sprCopy->setPixelRatio(spr->pixelRatio());
+  sprCopy->setGridBounds(spr->gridBounds());
+  sprCopy->setUserData(spr->userData());
+  sprCopy->setTileManagementPlugin(spr->tileManagementPlugin());
+
+  // Palettes
+  for (const Palette* pal : spr->getPalettes())
+    sprCopy->setPalette(pal, true);
+  {
+    auto it = spr->getPalettes().begin();
+    for (Palette* palCopy : sprCopy->getPalettes()) {
+      ASSERT(it != spr->getPalettes().end());
+      *palCopy = **it;
+      copy_id_and_version(*it, palCopy);
+      ++it;
+    }
+  }
+
+  // Tilesets must be copied before layers (tilemaps reference them)
+  if (spr->hasTilesets()) {
+    tileset_index tsi = 0;
+    for (Tileset* tileset : *spr->tilesets()) {
+      if (isCanceled())
+        return false;
+
+      // Keep empty spaces in the array (erased tilesets)
+      sprCopy->tilesets()->set(
+        tsi++, (tileset ? copyTileset(tileset, sprCopy.get()): nullptr));
+    }
+  }
+
+  for (Tag* tag : spr->tags())
+    sprCopy->tags().add(copy_id_and_version(tag, new Tag(*tag)));
+
+  for (Slice* slice : spr->slices())
+    sprCopy->slices().add(copy_id_and_version(slice, new Slice(*slice)));
+
+  for (Layer* layer : spr->root()->layers()) {
+    Layer* layerCopy = copyLayer(layer, sprCopy.get());
+    if (!layerCopy)
+      return false;
+    sprCopy->root()->addLayer(layerCopy);
+  }
+
+  copy_id_and_version(spr, sprCopy.get());
+
+  auto docCopy = std::make_unique<Doc>(sprCopy.get());
+  sprCopy.release();
+  docCopy->setFilename(doc->filename());
+  docCopy->setFormatOptions(doc->formatOptions());
+  copy_id_and_version(doc, docCopy.get());
+
+  m_doc = std::move(docCopy);
+  return true;
+}
+
+bool DocSnapshot::isCanceled() const
+{
+  return (m_cancel && m_cancel->isCanceled());
+}
+
+bool DocSnapshot::skip(const Object* obj) const
+{
+  return (m_skip && m_skip(obj));
+}
+
+Tileset* DocSnapshot::copyTileset(Tileset* tileset, Sprite* spriteCopy)
+{
+  std::unique_ptr<Tileset> copy(
+    new Tileset(spriteCopy, tileset->grid(), 0));
+  copy->setName(tileset->name());
+  copy->setUserData(tileset->userData());
+  copy->setBaseIndex(tileset->baseIndex());
+  copy->setMatchFlags(tileset->matchFlags());
+  copy->setExternal(tileset->externalFilename(),
+                    tileset->externalTileset());
+
+  // Tiles are copied only if they are needed
+  mark_version(tileset);
+  if (!skip(tileset)) {
+    for (tile_index ti=0; ti<tileset->size(); ++ti) {
+      ImageRef tile = tileset->get(ti);
+      ASSERT(tile);
+      copy->add(ImageRef(Image::createCopy(tile.get())),
+                tileset->getTileData(ti));
+    }
+  }
+  return copy_id_and_version(tileset, copy.release());
+}
+
+Layer* DocSnapshot::copyLayer(Layer* layer, Sprite* spriteCopy)
+{
+  if (isCanceled())
+    return nullptr;
+
+  std::unique_ptr<Layer> copy;
+  switch (layer->type()) {
+    case ObjectType::LayerImage:
+      copy = std::make_unique<LayerImage>(spriteCopy);
+      break;
+    case ObjectType::LayerTilemap:
+      copy = std::make_unique<LayerTilemap>(
+        spriteCopy, static_cast<LayerTilemap*>(layer)->tilesetIndex());
+      break;
+    case ObjectType::LayerGroup:
+      copy = std::make_unique<LayerGroup>(spriteCopy);
+      break;
+    default:
+      ASSERT(false);
+      return nullptr;
+  }
+
+  copy->setName(layer->name());
+  copy->setFlags(layer->flags());
+  copy->setUserData(layer->userData());
+
+  if (layer->isImage()) {
+    auto imgLayer = static_cast<LayerImage*>(layer);
+    auto imgCopy = static_cast<LayerImage*>(copy.get());
+    imgCopy->setBlendMode(imgLayer->blendMode());
+    imgCopy->setOpacity(imgLayer->opacity());
+    if (!copyCels(imgLayer, imgCopy))
+      return nullptr;
+  }
+  else if (layer->isGroup()) {
+    for (Layer* child : static_cast<LayerGroup*>(layer)->layers()) {
+      Layer* childCopy = copyLayer(child, spriteCopy);
+      if (!childCopy)
+        return nullptr;
+      static_cast<LayerGroup*>(copy.get())->addLayer(childCopy);
+    }
+  }
+
+  return copy_id_and_version(layer, copy.release());
+}
+
+bool DocSnapshot::copyCels(LayerImage* layer, LayerImage* layerCopy)
+{
+  for (auto it=layer->getCelBegin(), end=layer->getCelEnd(); it!=end; ++it) {
+    if (isCanceled())
+      return false;
+
+    Cel* cel = *it;
+    CelData* data = cel->data();
+    CelDataRef dataCopy;
+
+    // Linked cels share the same copy of the cel data
+    auto jt = m_celDatas.find(data->id());
+    if (jt != m_celDatas.end()) {
+      dataCopy = jt->second;
+    }
+    else {
+      dataCopy = std::make_shared<CelData>(copyImage(data->imageRef()));
+      dataCopy->setBounds(data->bounds());
+      if (data->hasBoundsF())
+        dataCopy->setBoundsF(data->boundsF());
+      dataCopy->setOpacity(data->opacity());
+      dataCopy->setUserData(data->userData());
+      copy_id_and_version(data, dataCopy.get());
+      m_celDatas[data->id()] = dataCopy;
+    }
+
+    Cel* celCopy = new Cel(cel->frame(), dataCopy);
+    celCopy->setZIndex(cel->zIndex());
+    layerCopy->addCel(copy_id_and_version(cel, celCopy));
+  }
+  return true;
+}
+
+ImageRef DocSnapshot::copyImage(const ImageRef& image)
+{
+  auto it = m_images.find(image->id());
+  if (it != m_images.end())
+    return it->second;
+
+  mark_version(image.get());
+
+  ImageRef copy;
+  if (skip(image.get())) {
+    // The pixels are not needed, we use a small placeholder with the
+    // same ID/version of the original image
+    copy.reset(Image::create(image->pixelFormat(), 1, 1));
+  }
+  else {
+    copy.reset(Image::createCopy(image.get()));
+  }
+
+  copy_id_and_version(image.get(), copy.get());
+  m_images[image->id()] = copy;
+  return copy;
+}
+
+} // namespace app
@@ -0,0 +1,77 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_SNAPSHOT_H_INCLUDED
+#define APP_DOC_SNAPSHOT_H_INCLUDED
+#pragma once
+
+#include "doc/cel_data.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace doc {
+  class CancelIO;
+  class Layer;
+  class LayerImage;
+  class Object;
+  class Sprite;
+  class Tileset;
+}
+
+namespace app {
+  class Doc;
+
+  // A copy of a document in a specific point of time that can be
+  // used from a background thread (e.g. to write the backup data)
+  // without keeping the original document locked, so the user can
+  // continue editing the sprite meanwhile.
+  //
+  // All objects in the snapshot (sprite, layers, cels, images, etc.)
+  // have the same IDs and versions of the original objects. Images
+  // and tilesets that the "skip" function excludes are not copied,
+  // an empty placeholder (with the same ID/version) is used instead.
+  class DocSnapshot {
+  public:
+    // Returns true if the content of the given object is not needed
+    // in the snapshot (e.g. it's already saved in the backup).
+    using SkipObject = std::function<bool(const doc::Object* obj)>;
+
+    DocSnapshot();
+    ~DocSnapshot();
+
+    // Creates a snapshot of the given document, which must be locked
+    // by the caller. Returns false if the operation was canceled.
+    bool create(Doc* doc,
+                const SkipObject& skip = nullptr,
+                doc::CancelIO* cancel = nullptr);
+
+    Doc* doc() const { return m_doc.get(); }
+
+  private:
+    bool isCanceled() const;
+    bool skip(const doc::Object* obj) const;
+    doc::Tileset* copyTileset(doc::Tileset* tileset, doc::Sprite* spriteCopy);
+    doc::Layer* copyLayer(doc::Layer* layer, doc::Sprite* spriteCopy);
+    bool copyCels(doc::LayerImage* layer, doc::LayerImage* layerCopy);
+    doc::ImageRef copyImage(const doc::ImageRef& image);
+
+    std::unique_ptr<Doc> m_doc;
+    SkipObject m_skip;
+    doc::CancelIO* m_cancel = nullptr;
+
+    // Copied images/cel data by the ID of the original object (to
+    // share the same copy between linked cels)
+    std::map<doc::ObjectId, doc::ImageRef> m_images;
+    std::map<doc::ObjectId, doc::CelDataRef> m_celDatas;
+  };
+
+} // namespace app
+
+#endif
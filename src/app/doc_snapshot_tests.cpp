@@ -0,0 +1,139 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_diff.h"
+#include "app/doc_snapshot.h"
+#include "app/test_context.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "doc/slice.h"
+#include "doc/tag.h"
+
+using namespace app;
+using namespace doc;
+
+typedef std::unique_ptr<Doc> DocPtr;
+
+TEST(DocSnapshot, CopyWithSameIds)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(32, 16));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  Cel* cel = layer->cel(frame_t(0));
+  Image* image = cel->image();
+  put_pixel(image, 3, 4, 1);
+
+  DocSnapshot snapshot;
+  ASSERT_TRUE(snapshot.create(doc.get()));
+  Doc* copy = snapshot.doc();
+  ASSERT_TRUE(copy != nullptr);
+  EXPECT_FALSE(compare_docs(doc.get(), copy).anything);
+
+  Layer* layerCopy = copy->sprite()->root()->firstLayer();
+  Cel* celCopy = layerCopy->cel(frame_t(0));
+  Image* imageCopy = celCopy->image();
+  EXPECT_EQ(doc->id(), copy->id());
+  EXPECT_EQ(sprite->id(), copy->sprite()->id());
+  EXPECT_EQ(layer->id(), layerCopy->id());
+  EXPECT_EQ(cel->id(), celCopy->id());
+  EXPECT_EQ(image->id(), imageCopy->id());
+  EXPECT_EQ(image->version(), imageCopy->version());
+  EXPECT_NE(0u, imageCopy->version());
+  EXPECT_TRUE(imageCopy->isSnapshot());
+
+  // IDs keep pointing to the original objects
+  EXPECT_EQ(image, get<Image>(image->id()));
+  EXPECT_EQ(layer, get<Layer>(layer->id()));
+
+  // Modifying the original doesn't modify the snapshot
+  put_pixel(image, 3, 4, 2);
+  EXPECT_EQ(2u, get_pixel(image, 3, 4));
+  EXPECT_EQ(1u, get_pixel(imageCopy, 3, 4));
+
+  doc->close();
+}
+
+TEST(DocSnapshot, SkipImages)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(32, 16));
+  Sprite* sprite = doc->sprite();
+  Image* image = sprite->root()->firstLayer()->cel(frame_t(0))->image();
+
+  DocSnapshot snapshot;
+  ASSERT_TRUE(snapshot.create(
+                doc.get(),
+                [](const Object* obj){
+                  return (obj->type() == ObjectType::Image);
+                }));
+
+  Image* imageCopy =
+    snapshot.doc()->sprite()->root()->firstLayer()->cel(frame_t(0))->image();
+  EXPECT_EQ(image->id(), imageCopy->id());
+  EXPECT_EQ(image->version(), imageCopy->version());
+  EXPECT_EQ(1, imageCopy->width());
+  EXPECT_EQ(1, imageCopy->height());
+
+  doc->close();
+}
+
+TEST(DocSnapshot, CopyUserData)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc(ctx.documents().add(32, 16));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(4));
+
+  Tag* tag = new Tag(1, 3);
+  tag->setName("walk");
+  tag->setColor(rgba(255, 0, 0, 255));
+  tag->userData().setText("tag text");
+  tag->userData().properties()["speed"] = int32_t(5);
+  sprite->tags().add(tag);
+
+  Slice* slice = new Slice;
+  slice->setName("slice");
+  slice->insert(0, SliceKey(gfx::Rect(1, 2, 3, 4)));
+  slice->userData().setText("slice text");
+  slice->userData().setColor(rgba(0, 0, 255, 255));
+  sprite->slices().add(slice);
+
+  Layer* layer = sprite->root()->firstLayer();
+  UserData layerData;
+  layerData.setText("layer text");
+  layerData.setColor(rgba(0, 255, 0, 255));
+  layer->setUserData(layerData);
+
+  DocSnapshot snapshot;
+  ASSERT_TRUE(snapshot.create(doc.get()));
+  Sprite* spriteCopy = snapshot.doc()->sprite();
+  EXPECT_FALSE(compare_docs(doc.get(), snapshot.doc()).anything);
+
+  ASSERT_EQ(1u, spriteCopy->tags().size());
+  const Tag* tagCopy = *spriteCopy->tags().begin();
+  EXPECT_EQ(tag->id(), tagCopy->id());
+  EXPECT_EQ("walk", tagCopy->name());
+  EXPECT_EQ(1, tagCopy->fromFrame());
+  EXPECT_EQ(3, tagCopy->toFrame());
+  EXPECT_EQ(rgba(255, 0, 0, 255), tagCopy->color());
+  EXPECT_EQ(tag->userData(), tagCopy->userData());
+
+  ASSERT_EQ(1u, spriteCopy->slices().size());
+  const Slice* sliceCopy = *spriteCopy->slices().begin();
+  EXPECT_EQ(slice->id(), sliceCopy->id());
+  EXPECT_EQ(slice->userData(), sliceCopy->userData());
+
+  EXPECT_EQ(layer->userData(),
+            spriteCopy->root()->firstLayer()->userData());
+
+  doc->close();
+}
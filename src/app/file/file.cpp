@@ -36,6 +36,7 @@
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "fmt/format.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -48,13 +49,34 @@
 #include "open_sequence.xml.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cstdarg>
+#include <list>
+#include <utility>
+#include <vector>
 
 namespace app {
 
 using namespace base;
 
+namespace {
+
+// Band of rows rendered with a FileRowsRenderer when an image is
+// saved. Each thread keeps a reference to the last band it used, so
+// consecutive rows of the same band can be read without locking (the
+// encoder can compress several bands of rows in parallel, e.g. PNG).
+struct RenderedRows {
+  int rendererId = 0;
+  int y = 0;
+  doc::ImageRef image;
+};
+
+thread_local RenderedRows t_renderedRows;
+std::atomic<int> g_rowsRendererId(0);
+
+} // anonymous namespace
+
 class FileOp::FileAbstractImageImpl : public FileAbstractImage {
 public:
   FileAbstractImageImpl(FileOp* fop)
@@ -67,6 +89,29 @@ public:
     ASSERT(m_doc && m_sprite);
   }
 
+  ~FileAbstractImageImpl() {
+    if (m_rowsRendererId &&
+        t_renderedRows.rendererId == m_rowsRendererId) {
+      t_renderedRows.rendererId = 0;
+      t_renderedRows.image.reset();
+    }
+  }
+
+  void setRowsRenderer(const FileRowsRenderer& renderer,
+                       const int bandHeight) {
+    ASSERT(bandHeight > 0);
+    m_rowsRenderer = renderer;
+    m_rowsRendererId = ++g_rowsRendererId;
+    m_bandHeight = bandHeight;
+    // Enough bands for all the threads that can be encoding rows
+    m_maxBands = 2*doc::hardware_threads();
+    m_bands.clear();
+  }
+
+  bool hasRowsRenderer() const {
+    return (m_rowsRenderer != nullptr);
+  }
+
   void setSpecSize(const gfx::Size& fullCanvasSize,
                    const gfx::Size& frameSize) {
     if (m_supportAnimation) {
@@ -95,12 +140,14 @@ public:
         m_tmpScaledImage.reset(doc::Image::create(m_spec));
       }
 
+      // Sprite::rgbMap() is not used as sequence frames are saved
+      // from several threads (and nearest neighbor doesn't need it).
       doc::algorithm::resize_image(
         image.get(),
         m_tmpScaledImage.get(),
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         palette(frame),
-        m_sprite->rgbMap(frame),
+        nullptr,
         image->maskColor());
     }
   }
@@ -145,42 +192,51 @@ public:
   }
 
   const uint8_t* getScanline(int y) const override {
+    if (m_rowsRenderer)
+      return getRenderedScanline(y);
     return m_tmpScaledImage->getPixelAddress(0, y);
   }
 
   void renderFrame(const doc::frame_t frame,
                    const gfx::Rect& frameBounds,
                    doc::Image* dst) const override {
+    // This function can be called from several threads at the same
+    // time (e.g. GifEncoder renders frames in parallel), so the
+    // temporary unscaled image is not shared between calls.
     const bool needResize = this->needResize();
-
-    if (needResize &&
-        (!m_tmpUnscaledRender ||
-         m_tmpUnscaledRender->size() != frameBounds.size())) {
+    doc::ImageRef unscaledRender;
+    if (needResize) {
       auto spec = m_sprite->spec();
       spec.setSize(frameBounds.size());
       spec.setColorMode(dst->colorMode());
-      m_tmpUnscaledRender.reset(doc::Image::create(spec));
+      unscaledRender.reset(doc::Image::create(spec));
     }
 
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
     render.renderSprite(
-      (needResize ? m_tmpUnscaledRender.get(): dst),
+      (needResize ? unscaledRender.get(): dst),
       m_sprite, frame,
       gfx::Clip(gfx::Point(0, 0), frameBounds));
 
     if (needResize) {
+      // The nearest neighbor method doesn't need a RgbMap (and
+      // Sprite::rgbMap() cannot be used from other threads).
       doc::algorithm::resize_image(
-        m_tmpUnscaledRender.get(),
+        unscaledRender.get(),
         dst,
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         palette(frame),
-        m_sprite->rgbMap(frame),
-        m_tmpUnscaledRender->maskColor());
+        nullptr,
+        unscaledRender->maskColor());
     }
   }
 
+  const gfx::PointF& scale() const {
+    return m_scale;
+  }
+
   void setScale(const gfx::PointF& scale) {
     m_scale = scale;
     m_spec.setWidth(m_spec.width() * m_scale.x);
@@ -192,14 +248,76 @@ private:
     return (m_scale != gfx::PointF(1.0, 1.0));
   }
 
+  const uint8_t* getRenderedScanline(const int y) const {
+    RenderedRows& band = t_renderedRows;
+    if (band.rendererId != m_rowsRendererId ||
+        y < band.y || y >= band.y + band.image->height()) {
+      band.rendererId = m_rowsRendererId;
+      band.y = y - (y % m_bandHeight);
+      band.image = getRenderedBand(band.y);
+    }
+    return band.image->getPixelAddress(0, y - band.y);
+  }
+
+  // Returns the band of rows that starts in the given "y" row. The
+  // last rendered bands are shared between all threads, so rows that
+  // are needed by two threads (e.g. the PNG encoder uses the last
+  // rows of the previous band as dictionary) are rendered only once.
+  doc::ImageRef getRenderedBand(const int y) const {
+    {
+      std::lock_guard lock(m_bandsMutex);
+      if (auto image = findRenderedBand(y))
+        return image;
+    }
+
+    // The renderer isn't thread-safe (it renders sprites), only
+    // the encoding is done in parallel.
+    std::lock_guard renderLock(m_renderMutex);
+    {
+      // Other thread could render this band while we were waiting
+      std::lock_guard lock(m_bandsMutex);
+      if (auto image = findRenderedBand(y))
+        return image;
+    }
+
+    doc::ImageSpec spec = m_spec;
+    spec.setHeight(std::min(m_bandHeight, m_spec.height() - y));
+    doc::ImageRef image(doc::Image::create(spec));
+    m_rowsRenderer(y, image.get());
+
+    std::lock_guard lock(m_bandsMutex);
+    m_bands.push_front(std::make_pair(y, image));
+    if (int(m_bands.size()) > m_maxBands)
+      m_bands.pop_back();
+    return image;
+  }
+
+  // m_bandsMutex must be locked
+  doc::ImageRef findRenderedBand(const int y) const {
+    for (auto it=m_bands.begin(); it!=m_bands.end(); ++it) {
+      if (it->first == y) {
+        auto image = it->second;
+        m_bands.splice(m_bands.begin(), m_bands, it);
+        return image;
+      }
+    }
+    return nullptr;
+  }
+
   const Doc* m_doc;
   const doc::Sprite* m_sprite;
   doc::ImageSpec m_spec;
   const bool m_supportAnimation;
   const bool m_newBlend;
   doc::ImageRef m_tmpScaledImage = nullptr;
-  mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
+  FileRowsRenderer m_rowsRenderer;
+  int m_rowsRendererId = 0;
+  int m_bandHeight = 0;
+  int m_maxBands = 0;
+  mutable std::mutex m_renderMutex;
+  mutable std::mutex m_bandsMutex;
+  mutable std::list<std::pair<int, doc::ImageRef>> m_bands; // Most recently used first
 };
 
 base::paths get_readable_extensions()
@@ -296,6 +414,18 @@ bool format_supports_palette(const std::string& filename)
   return (format && format->support(FILE_SUPPORT_PALETTES));
 }
 
+bool format_supports_scanlines(const std::string& filename)
+{
+  // Get the format through the extension of the filename
+  FileFormat* format =
+    FileFormatsManager::instance()
+    ->getFileFormat(dio::detect_format_by_file_extension(filename));
+
+  return (format &&
+          format->support(FILE_ENCODE_ABSTRACT_IMAGE) &&
+          format->support(FILE_ENCODE_SCANLINES));
+}
+
 FileOpROI::FileOpROI()
   : m_document(nullptr)
   , m_slice(nullptr)
@@ -1008,78 +1138,27 @@ void FileOp::operate(IFileOpProgress* progress)
     //      is already checked in SaveFileBaseCommand::saveDocumentInBackground
     //      and only in UI mode (so the CLI still works)
 
+    const bool rowsRenderer = (m_abstractImage &&
+                               m_abstractImage->hasRowsRenderer());
+
     // Save a sequence
-    if (isSequence()) {
+    if (isSequence() && !rowsRenderer) {
       ASSERT(m_format->support(FILE_SUPPORT_SEQUENCES));
 
-      Sprite* sprite = m_document->sprite();
-
-      // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      m_roi.fileCanvasSize().w,
-                                      m_roi.fileCanvasSize().h));
-
-      m_seq.progress_offset = 0.0f;
-      m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
-
-      // For each frame in the sprite.
-      render::Render render;
-      render.setNewBlend(m_config.newBlend);
-
-      frame_t outputFrame = 0;
-      for (frame_t frame : m_roi.selectedFrames()) {
-        gfx::Rect bounds = m_roi.frameBounds(frame);
-        if (bounds.isEmpty())
-          continue; // Skip frame because there is no slice key
-
-        if (m_abstractImage) {
-          m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
-                                       bounds.size());
-        }
-
-        // Render the (unscaled) sequenced image.
-        render.renderSprite(
-          m_seq.image.get(), sprite, frame,
-          gfx::Clip(gfx::Point(0, 0), bounds));
-
-        bool save = true;
-
-        // Check if we have to ignore empty frames
-        if (m_ignoreEmpty &&
-            !sprite->isOpaque() &&
-            doc::is_empty_image(m_seq.image.get())) {
-          save = false;
-        }
-
-        if (save) {
-          // Setup the palette.
-          sprite->palette(frame)->copyColorsTo(m_seq.palette);
-
-          // Setup the filename to be used.
-          m_filename = m_seq.filename_list[outputFrame];
-
-          // Make directories
-          makeDirectories();
-
-          // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
-            setError("Error saving frame %d in the file \"%s\"\n",
-                     outputFrame+1, m_filename.c_str());
-            break;
-          }
-        }
-
-        m_seq.progress_offset += m_seq.progress_fraction;
-        ++outputFrame;
-      }
+      saveSequence();
 
       m_filename = *m_seq.filename_list.begin();
-
-      // Destroy the image
-      m_seq.image.reset();
     }
     // Direct save to a file.
     else {
+      // Save the only frame of a sequence format rendering its rows
+      // on demand (without rendering the whole sprite).
+      if (rowsRenderer && isSequence()) {
+        ASSERT(m_seq.filename_list.size() == 1);
+        m_filename = *m_seq.filename_list.begin();
+        m_document->sprite()->palette(frame_t(0))->copyColorsTo(m_seq.palette);
+      }
+
       makeDirectories();
 
       if (m_abstractImage) {
@@ -1118,6 +1197,141 @@ void FileOp::operate(IFileOpProgress* progress)
   setProgress(1.0f);
 }
 
+#ifdef ENABLE_SAVE
+
+// Saves each frame of the sequence in its own file. Frames are
+// rendered and encoded by several threads at the same time (each
+// thread with only one frame in memory).
+void FileOp::saveSequence()
+{
+  const Sprite* sprite = m_document->sprite();
+
+  m_seq.progress_offset = 0.0f;
+  m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
+
+  // Frames to save with their output index (the filename)
+  std::vector<std::pair<frame_t, int>> items;
+  int outputFrame = 0;
+  for (frame_t frame : m_roi.selectedFrames()) {
+    if (m_roi.frameBounds(frame).isEmpty())
+      continue; // Skip frame because there is no slice key
+    items.push_back(std::make_pair(frame, outputFrame++));
+  }
+  if (items.empty())
+    return;
+
+  std::mutex mutex;             // To access the following variables
+  std::size_t nextItem = 0;
+  bool failed = false;
+
+  auto saveFrames = [&]() {
+    render::Render render;
+    render.setNewBlend(m_config.newBlend);
+
+    while (true) {
+      std::pair<frame_t, int> item;
+      {
+        std::lock_guard lock(mutex);
+        if (failed || nextItem == items.size() || isStop())
+          return;
+        item = items[nextItem++];
+      }
+
+      const frame_t frame = item.first;
+      const int outputFrame = item.second;
+      const gfx::Rect bounds = m_roi.frameBounds(frame);
+
+      // Render the (unscaled) sequenced image.
+      ImageRef image(Image::create(sprite->pixelFormat(),
+                                   m_roi.fileCanvasSize().w,
+                                   m_roi.fileCanvasSize().h));
+      render.renderSprite(
+        image.get(), sprite, frame,
+        gfx::Clip(gfx::Point(0, 0), bounds));
+
+      // Check if we have to ignore empty frames
+      const bool save =
+        !(m_ignoreEmpty &&
+          !sprite->isOpaque() &&
+          doc::is_empty_image(image.get()));
+
+      std::unique_ptr<FileOp> fop;
+      bool result = true;
+      if (save) {
+        fop = createSequenceFrameOperation(
+          frame, m_seq.filename_list[outputFrame], image);
+
+        // Directories are created one at a time (the same directory
+        // can be used by several files)
+        {
+          std::lock_guard lock(mutex);
+          fop->makeDirectories();
+        }
+
+        // Call the "save" procedure... did it fail?
+        result = m_format->save(fop.get());
+      }
+
+      std::lock_guard lock(mutex);
+      if (fop) {
+        if (fop->hasError())
+          setError("%s", fop->error().c_str());
+        if (fop->hasIncompatibilityError())
+          setIncompatibilityError(fop->m_incompatibilityError);
+      }
+      if (!result) {
+        setError("Error saving frame %d in the file \"%s\"\n",
+                 outputFrame+1, fop->filename().c_str());
+        failed = true;
+      }
+
+      // Report the progress of the whole sequence
+      m_seq.progress_offset += m_seq.progress_fraction;
+      {
+        std::lock_guard progressLock(m_mutex);
+        m_progress = m_seq.progress_offset;
+        if (m_progressInterface)
+          m_progressInterface->ackFileOpProgress(m_progress);
+      }
+    }
+  };
+
+  doc::run_workers(int(items.size()),
+                   [&saveFrames](const int){ saveFrames(); });
+}
+
+// Creates an operation to save one frame of the sequence (the given
+// rendered image) in the given file. The operation uses the same
+// format, options, and on-the-fly scale of this one.
+std::unique_ptr<FileOp> FileOp::createSequenceFrameOperation(
+  const frame_t frame,
+  const std::string& filename,
+  const ImageRef& image)
+{
+  std::unique_ptr<FileOp> fop(new FileOp(FileOpSave, m_context, &m_config));
+  fop->m_format = m_format;
+  fop->m_document = m_document;
+  fop->m_filename = filename;
+  fop->m_roi = m_roi;
+  fop->m_formatOptions = m_formatOptions;
+  fop->m_parent = this;
+
+  fop->m_seq.palette = new Palette(frame_t(0), 256);
+  m_document->sprite()->palette(frame)->copyColorsTo(fop->m_seq.palette);
+  fop->m_seq.image = image;
+  fop->m_seq.frame = frame;
+
+  if (m_abstractImage) {
+    fop->makeAbstractImage();
+    fop->m_abstractImage->setScale(m_abstractImage->scale());
+    fop->m_abstractImage->setSpecSize(m_roi.fileCanvasSize(),
+                                      m_roi.frameBounds(frame).size());
+  }
+  return fop;
+}
+
+#endif // ENABLE_SAVE
+
 // After mark the 'fop' as 'done' you must to free it calling fop_free().
 void FileOp::done()
 {
@@ -1427,6 +1641,16 @@ FileAbstractImage* FileOp::abstractImageToSave()
   return m_abstractImage.get();
 }
 
+void FileOp::setRowsRenderer(const FileRowsRenderer& renderer,
+                             const int bandHeight)
+{
+  ASSERT(m_format->support(FILE_ENCODE_SCANLINES));
+  ASSERT(m_roi.frames() == 1);
+
+  makeAbstractImage();
+  m_abstractImage->setRowsRenderer(renderer, bandHeight);
+}
+
 void FileOp::setOnTheFlyScale(const gfx::PointF& scale)
 {
   makeAbstractImage();
@@ -1519,6 +1743,9 @@ bool FileOp::isStop() const
     std::scoped_lock lock(m_mutex);
     stop = m_stop;
   }
+  // Frames of a sequence are stopped with the whole sequence
+  if (!stop && m_parent)
+    stop = m_parent->isStop();
   return stop;
 }
 
@@ -1533,6 +1760,7 @@ FileOp::FileOp(FileOpType type,
   , m_progressInterface(nullptr)
   , m_done(false)
   , m_stop(false)
+  , m_parent(nullptr)
   , m_oneframe(false)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
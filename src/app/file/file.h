@@ -22,6 +22,7 @@
 #include "os/color_space.h"
 
 #include <cstdio>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -138,12 +139,19 @@ namespace app {
     virtual const uint8_t* getScanline(int y) const = 0;
 
     // In case that the encoder supports animation and needs to render
-    // a full frame renders.
+    // a full frame renders. It can be called from several threads
+    // at the same time to render different frames.
     virtual void renderFrame(const doc::frame_t frame,
                              const gfx::Rect& frameBounds,
                              doc::Image* dst) const = 0;
   };
 
+  // Renders the rows of the image to be saved starting at "y" in the
+  // given "dst" image (a band of rows with the width of the whole
+  // image). Used to save big images (e.g. sprite sheet textures)
+  // without having the whole image in memory.
+  using FileRowsRenderer = std::function<void(const int y, doc::Image* dst)>;
+
   // Structure to load & save files.
   //
   // TODO This class do to many things. There should be a previous
@@ -265,6 +273,12 @@ namespace app {
     FileAbstractImage* abstractImageToSave();
     void setOnTheFlyScale(const gfx::PointF& scale);
 
+    // Saves a one frame image rendering bands of "bandHeight" rows on
+    // demand (instead of rendering the whole sprite). The file format
+    // needs the FILE_ENCODE_SCANLINES flag to use this.
+    void setRowsRenderer(const FileRowsRenderer& renderer,
+                         const int bandHeight);
+
     const std::string& error() const { return m_error; }
     void setError(const char *error, ...);
     bool hasError() const { return !m_error.empty(); }
@@ -309,6 +323,9 @@ namespace app {
     std::string m_incompatibilityError; // Incompatibility error string.
     bool m_done;                // True if the operation finished.
     bool m_stop;                // Force the break of the operation.
+    const FileOp* m_parent;     // Operation that saves the whole sequence
+                                // (for operations that save one frame of
+                                // the sequence, see isStop()).
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
@@ -350,6 +367,13 @@ namespace app {
     void prepareForSequence();
     void makeAbstractImage();
     void makeDirectories();
+#ifdef ENABLE_SAVE
+    void saveSequence();
+    std::unique_ptr<FileOp> createSequenceFrameOperation(
+      const doc::frame_t frame,
+      const std::string& filename,
+      const doc::ImageRef& image);
+#endif
   };
 
   // Available extensions for each load/save operation.
@@ -368,6 +392,10 @@ namespace app {
   // Returns true if the given file format supports palette/s
   bool format_supports_palette(const std::string& filename);
 
+  // Returns true if the given file format can be saved rendering the
+  // image row by row (see FileOp::setRowsRenderer())
+  bool format_supports_scanlines(const std::string& filename);
+
 } // namespace app
 
 #endif
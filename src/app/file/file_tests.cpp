@@ -12,14 +12,17 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
+#include "app/file/png_options.h"
 #include "base/base64.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "doc/user_data.h"
 #include "fmt/format.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <functional>
+#include <iterator>
 #include <vector>
 #include <fstream>
 
@@ -341,3 +344,148 @@ TEST(File, CustomProperties)
     }
   }
 }
+
+TEST(File, GifWithSeveralThreads)
+{
+  app::Context ctx;
+  const int nframes = 24;
+
+  auto read_file = [](const std::string& fn) {
+    std::ifstream f(fn, std::ifstream::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(f),
+                             std::istreambuf_iterator<char>());
+  };
+
+  std::unique_ptr<Doc> doc(
+    ctx.documents().add(64, 48, doc::ColorMode::RGB, 256));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  ASSERT_TRUE(layer != nullptr);
+  sprite->setTotalFrames(nframes);
+
+  // Moving rectangles over a transparent background (so frames have
+  // different deltas/disposal methods) and a few repeated frames
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    Cel* cel = layer->cel(frame);
+    if (!cel) {
+      cel = new Cel(frame, ImageRef(Image::create(IMAGE_RGB, 64, 48)));
+      layer->addCel(cel);
+    }
+    Image* image = cel->image();
+    clear_image(image, 0);
+    const int f = (frame % 8 == 7 ? frame-1: frame);
+    fill_rect(image, f*2, f, f*2+15, f+9, rgba(255, f*10, 0, 255));
+    fill_rect(image, 40-f, 30-f, 50-f, 40-f, rgba(0, 0, 255-f*5, 255));
+    sprite->setFrameDuration(frame, 20 + (frame % 3)*10);
+  }
+
+  // Save the GIF using just one worker thread (so frames are
+  // processed in order, as in a serial encoder), and then with all
+  // available threads
+  doc->setFilename("_test_serial.gif");
+  {
+    doc::ReservedThreads reserved(doc::hardware_threads());
+    save_document(&ctx, doc.get());
+  }
+  doc->setFilename("_test_parallel.gif");
+  save_document(&ctx, doc.get());
+  doc->close();
+
+  const std::vector<char> serial = read_file("_test_serial.gif");
+  const std::vector<char> parallel = read_file("_test_parallel.gif");
+  EXPECT_FALSE(serial.empty());
+  EXPECT_TRUE(serial == parallel);
+
+  std::unique_ptr<Doc> doc2(load_document(&ctx, "_test_parallel.gif"));
+  ASSERT_TRUE(doc2 != nullptr);
+  EXPECT_EQ(nframes, doc2->sprite()->totalFrames());
+  for (frame_t frame=0; frame<nframes; ++frame)
+    EXPECT_EQ(20 + (frame % 3)*10, doc2->sprite()->frameDuration(frame));
+  doc2->close();
+
+  std::remove("_test_serial.gif");
+  std::remove("_test_parallel.gif");
+}
+
+TEST(File, BigPngRoundTrip)
+{
+  // Images of 1M pixels or more are compressed using several threads
+  const int w = 1100;
+  const int h = 1000;
+  const std::string fn = "_test_big.png";
+  app::Context ctx;
+
+  auto pixel_color = [](const doc::ColorMode colorMode, const int c) -> color_t {
+    switch (colorMode) {
+      case doc::ColorMode::RGB:
+        return rgba(c, 255-c, (c*7) & 0xff, (c & 1 ? 255: 128 + c/2));
+      case doc::ColorMode::GRAYSCALE:
+        return graya(c, (c & 1 ? 255: 128 + c/2));
+      case doc::ColorMode::INDEXED:
+        return c;
+    }
+    return 0;
+  };
+
+  struct Config {
+    int compressionLevel;
+    PngOptions::Filter filter;
+  };
+  for (const Config& config : { Config{ -1, PngOptions::Filter::Default },
+                                Config{ 1, PngOptions::Filter::Up },
+                                Config{ 6, PngOptions::Filter::Paeth },
+                                Config{ 9, PngOptions::Filter::Adaptive } }) {
+    for (const auto colorMode : { doc::ColorMode::RGB,
+                                  doc::ColorMode::GRAYSCALE,
+                                  doc::ColorMode::INDEXED }) {
+      {
+        std::unique_ptr<Doc> doc(ctx.documents().add(w, h, colorMode, 256));
+        doc->setFilename(fn);
+
+        auto opts = std::make_shared<PngOptions>();
+        opts->compressionLevel(config.compressionLevel);
+        opts->filter(config.filter);
+        doc->setFormatOptions(opts);
+
+        Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+        std::srand(w*h + int(colorMode));
+        int c = std::rand()%256;
+        for (int y=0; y<h; y++) {
+          for (int x=0; x<w; x++) {
+            put_pixel(image, x, y, pixel_color(colorMode, c));
+            if ((std::rand()&4) == 0)
+              c = std::rand()%256;
+          }
+        }
+
+        save_document(&ctx, doc.get());
+        doc->close();
+      }
+
+      {
+        std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+        ASSERT_TRUE(doc != nullptr);
+        ASSERT_EQ(w, doc->sprite()->width());
+        ASSERT_EQ(h, doc->sprite()->height());
+        ASSERT_EQ(colorMode, doc->sprite()->colorMode());
+
+        const Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+        std::srand(w*h + int(colorMode));
+        int c = std::rand()%256;
+        for (int y=0; y<h; y++) {
+          for (int x=0; x<w; x++) {
+            ASSERT_EQ(pixel_color(colorMode, c), get_pixel(image, x, y))
+              << "Pixel " << x << "," << y
+              << " level " << config.compressionLevel
+              << " filter " << int(config.filter);
+            if ((std::rand()&4) == 0)
+              c = std::rand()%256;
+          }
+        }
+        doc->close();
+      }
+    }
+  }
+
+  std::remove(fn.c_str());
+}
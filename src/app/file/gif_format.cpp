@@ -25,6 +25,7 @@
 #include "base/fs.h"
 #include "doc/doc.h"
 #include "doc/octree_map.h"
+#include "doc/parallel.h"
 #include "gfx/clip.h"
 #include "render/dithering.h"
 #include "render/ordered_dither.h"
@@ -35,6 +36,14 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <gif_lib.h>
 
@@ -1088,6 +1097,8 @@ public:
   }
 
   ~GifEncoder() {
+    stopThreads();
+
     if (m_globalColormap)
       GifFreeMapObject(m_globalColormap);
   }
@@ -1097,60 +1108,248 @@ public:
     if (m_loop >= 0)
       writeLoopExtension();
 
-    // Previous and next images are used to decide the best disposal
-    // method (e.g. if it's more convenient to restore the background
-    // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    auto frame_beg = m_fop->roi().selectedFrames().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().selectedFrames().end();
-#endif
-    auto frame_it = frame_beg;
-
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
-    gifframe_t nframes = totalFrames();
-    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
-
-      if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
-      else
-        std::swap(m_previousImage, m_currentImage);
-
-      // Render next frame
-      std::swap(m_currentImage, m_nextImage);
-      if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+    for (frame_t frame : m_fop->roi().selectedFrames())
+      m_spriteFrames.push_back(frame);
+    ASSERT(int(m_spriteFrames.size()) == totalFrames());
 
-      gfx::Rect frameBounds = m_spriteBounds;
-      DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+    // Frames are rendered, compared and converted to indexed images
+    // in background threads, only the LZW compression (the writing
+    // of the file) must be done in order in this thread.
+    startThreads();
 
-      // Creation of the deltaImage (difference image result respect
-      // to current VS previous frame image).  At the same time we
-      // must scan the next image, to check if some pixel turns to
-      // transparent (0), if the case, we need to force disposal
-      // method of the current image to RESTORE_BG.  Further, at the
-      // same time, we must check if we can go without color zero (0).
-
-      calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
+    gifframe_t nframes = totalFrames();
+    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
+      std::unique_ptr<FrameData> data = waitFrameData(gifFrame);
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
+      writeImage(gifFrame, *data,
                  // Only the last frame in the animation needs the fix
                  (fix_last_frame_duration && gifFrame == nframes-1));
 
       m_fop->setProgress(double(gifFrame+1) / double(nframes));
     }
+
+    stopThreads();
     return true;
   }
 
 private:
 
+  // All the information to write a GIF frame.
+  struct FrameData {
+    bool ready = false;
+    gfx::Rect frameBounds;
+    DisposalMethod disposal = DisposalMethod::NONE;
+    std::unique_ptr<Image> deltaImage;
+    // Indexed image to be written and the remap of its indexes
+    ImageRef frameImage;
+    Remap remap = Remap(256);
+    // Palette used in this frame if it's not the global colormap
+    std::unique_ptr<Palette> localPalette;
+    int localTransparent = -1;
+  };
+
+  void startThreads() {
+    // The delta thread and one worker are always created (this
+    // thread just waits the frames to write them), more workers
+    // are created only if there are threads available (e.g. there
+    // aren't available threads if several files are saved in
+    // parallel).
+    m_reservedThreads = std::make_unique<doc::ReservedThreads>(
+      std::max(1, int(totalFrames()))+1);
+    const int nworkers = std::max(1, m_reservedThreads->count()-1);
+    m_maxFramesAhead = 2*nworkers + 2;
+
+    m_deltaThread = std::thread([this]{ deltaThread(); });
+    for (int i=0; i<nworkers; ++i)
+      m_workers.emplace_back([this]{ workerThread(); });
+  }
+
+  void stopThreads() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+
+    if (m_deltaThread.joinable())
+      m_deltaThread.join();
+    for (auto& worker : m_workers)
+      worker.join();
+    m_workers.clear();
+    m_reservedThreads.reset();
+  }
+
+  // Waits the given frame to be ready to be written (or rethrows the
+  // exception that was thrown in a background thread).
+  std::unique_ptr<FrameData> waitFrameData(const gifframe_t gifFrame) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, gifFrame]{
+      auto it = m_data.find(gifFrame);
+      return (m_error || (it != m_data.end() && it->second->ready));
+    });
+    if (m_error)
+      std::rethrow_exception(m_error);
+
+    auto it = m_data.find(gifFrame);
+    std::unique_ptr<FrameData> data = std::move(it->second);
+    m_data.erase(it);
+
+    // Allow to render more frames
+    m_nextToWrite = gifFrame+1;
+    m_cv.notify_all();
+    return data;
+  }
+
+  void setError(std::exception_ptr error) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_error)
+      m_error = error;
+    m_stop = true;
+    m_cv.notify_all();
+  }
+
+  // Renders frames (limited to m_maxFramesAhead frames ahead of the
+  // last written frame) and converts the deltas of the rendered
+  // frames to indexed images.
+  void workerThread() {
+    try {
+      while (true) {
+        gifframe_t gifFrame;
+        bool renderJob;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this]{
+            return (m_stop ||
+                    !m_quantizeQueue.empty() ||
+                    canRenderMoreFrames());
+          });
+          if (m_stop)
+            return;
+
+          // Converting frames has priority as they are nearer to be
+          // written.
+          renderJob = m_quantizeQueue.empty();
+          if (renderJob) {
+            gifFrame = m_nextToRender++;
+          }
+          else {
+            gifFrame = m_quantizeQueue.front();
+            m_quantizeQueue.pop_front();
+          }
+        }
+
+        if (renderJob) {
+          ImageRef image(Image::create(
+                           (m_preservePaletteOrder ? IMAGE_INDEXED: IMAGE_RGB),
+                           m_spriteBounds.w,
+                           m_spriteBounds.h));
+          renderFrame(m_spriteFrames[gifFrame], image.get());
+
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_rendered[gifFrame] = image;
+        }
+        else {
+          FrameData* data;
+          {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            data = m_data[gifFrame].get();
+          }
+
+          quantizeImage(*data);
+
+          std::unique_lock<std::mutex> lock(m_mutex);
+          data->ready = true;
+        }
+        m_cv.notify_all();
+      }
+    }
+    catch (...) {
+      setError(std::current_exception());
+    }
+  }
+
+  bool canRenderMoreFrames() const {
+    return (m_nextToRender < totalFrames() &&
+            m_nextToRender < m_nextToWrite + m_maxFramesAhead);
+  }
+
+  // Returns the rendered image of the given frame (or nullptr if the
+  // encoder was stopped).
+  ImageRef waitRenderedImage(const gifframe_t gifFrame) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, gifFrame]{
+      return (m_stop || m_rendered.find(gifFrame) != m_rendered.end());
+    });
+    if (m_stop)
+      return nullptr;
+
+    auto it = m_rendered.find(gifFrame);
+    ImageRef image = it->second;
+    m_rendered.erase(it);
+    return image;
+  }
+
+  // Each delta depends on the result of the previous frame (last
+  // disposal/bounds and the modified current image), so they are
+  // calculated in order in one thread.
+  void deltaThread() {
+    try {
+      // Previous and next images are used to decide the best disposal
+      // method (e.g. if it's more convenient to restore the background
+      // color or to restore the previous frame to reach the next one).
+      gifframe_t nframes = totalFrames();
+      for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
+        if (gifFrame == 0) {
+          m_images[2] = waitRenderedImage(0);
+          if (!m_images[2])
+            return;
+        }
+        else
+          std::swap(m_images[0], m_images[1]);
+
+        // Get next rendered frame
+        std::swap(m_images[1], m_images[2]);
+        if (gifFrame+1 < nframes) {
+          m_images[2] = waitRenderedImage(gifFrame+1);
+          if (!m_images[2])
+            return;
+        }
+
+        m_previousImage = m_images[0].get();
+        m_currentImage = m_images[1].get();
+        m_nextImage = m_images[2].get();
+
+        auto data = std::make_unique<FrameData>();
+        data->frameBounds = m_spriteBounds;
+        data->disposal = DisposalMethod::DO_NOT_DISPOSE;
+
+        // Creation of the deltaImage (difference image result respect
+        // to current VS previous frame image).  At the same time we
+        // must scan the next image, to check if some pixel turns to
+        // transparent (0), if the case, we need to force disposal
+        // method of the current image to RESTORE_BG.  Further, at the
+        // same time, we must check if we can go without color zero (0).
+
+        calculateDeltaImageFrameBoundsDisposal(gifFrame,
+                                               data->frameBounds,
+                                               data->disposal);
+        data->deltaImage = std::move(m_deltaImage);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop)
+          return;
+        m_data[gifFrame] = std::move(data);
+        m_quantizeQueue.push_back(gifFrame);
+        m_cv.notify_all();
+      }
+    }
+    catch (...) {
+      setError(std::current_exception());
+    }
+  }
+
   void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
                                               gfx::Rect& frameBounds,
                                               DisposalMethod& disposal) {
@@ -1366,36 +1565,35 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Converts the delta image of the frame to an indexed image (this
+  // is executed in a worker thread).
+  void quantizeImage(FrameData& data) const {
+    const gfx::Rect& frameBounds = data.frameBounds;
+    int transparentIndex = m_transparentIndex;
+
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(data.deltaImage.get(), transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
-    ImageRef frameImage(Image::create(IMAGE_INDEXED,
-                                      frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+    octree.regenerateMap(&framePalette, transparentIndex);
+    data.frameImage.reset(Image::create(IMAGE_INDEXED,
+                                        frameBounds.w,
+                                        frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = data.remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
-      LockImageBits<IndexedTraits> dstBits(frameImage.get());
+      const LockImageBits<RgbTraits> srcBits(data.deltaImage.get());
+      LockImageBits<IndexedTraits> dstBits(data.frameImage.get());
 
       auto srcIt = srcBits.begin();
       auto dstIt = dstBits.begin();
@@ -1414,13 +1612,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1443,34 +1641,49 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
-        Palette reducedPalette(0, usedNColors);
+      if (!m_globalColormap) {
+        data.localPalette = std::make_unique<Palette>(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
           if (usedColors[i]) {
-            reducedPalette.setEntry(j, framePalette.getEntry(i));
+            data.localPalette->setEntry(j, framePalette.getEntry(i));
             remap.map(i, j);
             ++j;
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      data.frameImage.reset(Image::createCopy(data.deltaImage.get()));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    data.localTransparent = localTransparent;
+    data.deltaImage.reset();
+  }
+
+  void writeImage(const gifframe_t gifFrame,
+                  const FrameData& data,
+                  const bool fixDuration) {
+    const frame_t frame = m_spriteFrames[gifFrame];
+    const gfx::Rect& frameBounds = data.frameBounds;
+    const Image* frameImage = data.frameImage.get();
+    const Remap& remap = data.remap;
+
+    ColorMapObject* colormap = m_globalColormap;
+    if (data.localPalette)
+      colormap = createColorMap(data.localPalette.get());
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, frame, data.localTransparent,
+                   data.disposal, fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1488,8 +1701,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1501,8 +1714,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1516,9 +1729,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1748,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,12 +1758,12 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
 
-  void renderFrame(frame_t frame, Image* dst) {
+  void renderFrame(frame_t frame, Image* dst) const {
     if (m_preservePaletteOrder)
       clear_image(dst, m_bgIndex);
     else
@@ -1600,14 +1814,32 @@ private:
   bool m_interlaced;
   int m_loop;
   bool m_preservePaletteOrder;
+  std::vector<frame_t> m_spriteFrames;
+
+  // Used only in the m_deltaThread
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
   ImageRef m_images[3];
   Image* m_previousImage;
   Image* m_currentImage;
   Image* m_nextImage;
   std::unique_ptr<Image> m_deltaImage;
+
+  std::unique_ptr<doc::ReservedThreads> m_reservedThreads;
+  std::thread m_deltaThread;
+  std::vector<std::thread> m_workers;
+  int m_maxFramesAhead = 0;
+
+  // Everything below is guarded by m_mutex
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stop = false;
+  std::exception_ptr m_error;
+  gifframe_t m_nextToRender = 0;
+  gifframe_t m_nextToWrite = 0;
+  std::map<gifframe_t, ImageRef> m_rendered;
+  std::map<gifframe_t, std::unique_ptr<FrameData>> m_data;
+  std::deque<gifframe_t> m_quantizeQueue;
 };
 
 bool GifFormat::onSave(FileOp* fop)
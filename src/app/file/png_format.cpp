@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,20 +10,31 @@
 #endif
 
 #include "app/app.h"
+#include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
 #include "app/file/png_format.h"
 #include "app/file/png_options.h"
+#include "app/pref/preferences.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "gfx/color_space.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -55,7 +66,9 @@ class PngFormat : public FileFormat {
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_SEQUENCES |
       FILE_SUPPORT_PALETTE_WITH_ALPHA |
-      FILE_ENCODE_ABSTRACT_IMAGE;
+      FILE_SUPPORT_GET_FORMAT_OPTIONS |
+      FILE_ENCODE_ABSTRACT_IMAGE |
+      FILE_ENCODE_SCANLINES;
   }
 
   bool onLoad(FileOp* fop) override;
@@ -64,6 +77,7 @@ class PngFormat : public FileFormat {
   bool onSave(FileOp* fop) override;
   void saveColorSpace(png_structp png, png_infop info, const gfx::ColorSpace* colorSpace);
 #endif
+  FormatOptionsPtr onAskUserForFormatOptions(FileOp* fop) override;
 };
 
 FileFormat* CreatePngFormat()
@@ -523,6 +537,381 @@ gfx::ColorSpaceRef PngFormat::loadColorSpace(png_structp png_ptr, png_infop info
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// Minimum number of pixels of an image to compress it in several
+// threads.
+const std::size_t kMinPixelsToUseThreads = 1024*1024;
+
+// Approximated number of bytes of each band of rows compressed
+// independently. It doesn't depend on the number of threads, so the
+// generated file is always the same.
+const std::size_t kBandSize = 1024*1024;
+
+// Max size of the deflate dictionary (window size)
+const std::size_t kDictSize = 32*1024;
+
+// Converts the "y" row of the image to the PNG pixel format of the
+// given color type.
+void convert_row_to_png(FileOp* fop,
+                        const FileAbstractImage* img,
+                        const int color_type,
+                        const png_uint_32 width,
+                        const png_uint_32 height,
+                        const png_uint_32 y,
+                        uint8_t* dst_address)
+{
+  const ImageSpec& spec = img->spec();
+
+  if (color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+    unsigned int x, c, a;
+    bool opaque = true;
+
+    if (spec.colorMode() == ColorMode::RGB) {
+      auto src_address = (const uint32_t*)img->getScanline(y);
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        a = rgba_geta(c);
+
+        if (opaque) {
+          if (a < 255)
+            opaque = false;
+          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+            a = 254;
+        }
+
+        *(dst_address++) = rgba_getr(c);
+        *(dst_address++) = rgba_getg(c);
+        *(dst_address++) = rgba_getb(c);
+        *(dst_address++) = a;
+      }
+    }
+    // In case that we are converting an indexed image to RGB just
+    // to convert one pixel with alpha=254.
+    else if (spec.colorMode() == ColorMode::INDEXED) {
+      auto src_address = (const uint8_t*)img->getScanline(y);
+      unsigned int x, c;
+      int r, g, b, a;
+      bool opaque = true;
+
+      for (x=0; x<width; ++x) {
+        c = *(src_address++);
+        fop->sequenceGetColor(c, &r, &g, &b);
+        fop->sequenceGetAlpha(c, &a);
+
+        if (opaque) {
+          if (a < 255)
+            opaque = false;
+          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+            a = 254;
+        }
+
+        *(dst_address++) = r;
+        *(dst_address++) = g;
+        *(dst_address++) = b;
+        *(dst_address++) = a;
+      }
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_RGB) {
+    auto src_address = (const uint32_t*)img->getScanline(y);
+    unsigned int x, c;
+
+    for (x=0; x<width; ++x) {
+      c = *(src_address++);
+      *(dst_address++) = rgba_getr(c);
+      *(dst_address++) = rgba_getg(c);
+      *(dst_address++) = rgba_getb(c);
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+    auto src_address = (const uint16_t*)img->getScanline(y);
+    unsigned int x, c, a;
+    bool opaque = true;
+
+    for (x=0; x<width; x++) {
+      c = *(src_address++);
+      a = graya_geta(c);
+
+      if (opaque) {
+        if (a < 255)
+          opaque = false;
+        else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
+          a = 254;
+      }
+
+      *(dst_address++) = graya_getv(c);
+      *(dst_address++) = a;
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_GRAY) {
+    auto src_address = (const uint16_t*)img->getScanline(y);
+    unsigned int x, c;
+
+    for (x=0; x<width; ++x) {
+      c = *(src_address++);
+      *(dst_address++) = graya_getv(c);
+    }
+  }
+  else if (color_type == PNG_COLOR_TYPE_PALETTE) {
+    auto src_address = (const uint8_t*)img->getScanline(y);
+    unsigned int x;
+
+    for (x=0; x<width; ++x)
+      *(dst_address++) = *(src_address++);
+  }
+}
+
+int png_filters_from_options(const PngOptions::Filter filter)
+{
+  switch (filter) {
+    case PngOptions::Filter::None: return PNG_FILTER_NONE;
+    case PngOptions::Filter::Sub: return PNG_FILTER_SUB;
+    case PngOptions::Filter::Up: return PNG_FILTER_UP;
+    case PngOptions::Filter::Average: return PNG_FILTER_AVG;
+    case PngOptions::Filter::Paeth: return PNG_FILTER_PAETH;
+    case PngOptions::Filter::Default:
+    case PngOptions::Filter::Adaptive: return PNG_ALL_FILTERS;
+  }
+  return PNG_ALL_FILTERS;
+}
+
+inline int paeth_predictor(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+  else
+    return c;
+}
+
+// Filters the "row" with the given PNG filter type (0=None, 1=Sub,
+// 2=Up, 3=Average, 4=Paeth) using the previous row "prev" (nullptr
+// for the first row). The output starts with the filter type byte.
+void filter_png_row_with_type(const int type,
+                              const uint8_t* row,
+                              const uint8_t* prev,
+                              const std::size_t rowbytes,
+                              const std::size_t bpp,
+                              uint8_t* out)
+{
+  *(out++) = type;
+  for (std::size_t i=0; i<rowbytes; ++i) {
+    const int a = (i >= bpp ? row[i-bpp]: 0);
+    const int b = (prev ? prev[i]: 0);
+    const int c = (prev && i >= bpp ? prev[i-bpp]: 0);
+    int v = row[i];
+    switch (type) {
+      case 1: v -= a; break;
+      case 2: v -= b; break;
+      case 3: v -= (a + b) / 2; break;
+      case 4: v -= paeth_predictor(a, b, c); break;
+    }
+    out[i] = uint8_t(v);
+  }
+}
+
+// Filters the row with the given filter. In the adaptive case, all
+// filters are tested and the one with the minimum sum of absolute
+// values is used (the same heuristic used by libpng).
+void filter_png_row(const PngOptions::Filter filter,
+                    const uint8_t* row,
+                    const uint8_t* prev,
+                    const std::size_t rowbytes,
+                    const std::size_t bpp,
+                    uint8_t* out,
+                    std::vector<uint8_t>& tmp)
+{
+  if (filter != PngOptions::Filter::Adaptive) {
+    filter_png_row_with_type(int(filter) - int(PngOptions::Filter::None),
+                             row, prev, rowbytes, bpp, out);
+    return;
+  }
+
+  tmp.resize(rowbytes+1);
+  std::size_t bestSum = std::numeric_limits<std::size_t>::max();
+  for (int type=0; type<5; ++type) {
+    filter_png_row_with_type(type, row, prev, rowbytes, bpp, tmp.data());
+
+    std::size_t sum = 0;
+    for (std::size_t i=1; i<=rowbytes && sum < bestSum; ++i)
+      sum += std::abs(int(int8_t(tmp[i])));
+
+    if (sum < bestSum) {
+      bestSum = sum;
+      std::copy(tmp.begin(), tmp.end(), out);
+    }
+  }
+}
+
+// A band of rows compressed independently from the others.
+struct PngBand {
+  png_uint_32 y1, y2;
+  std::vector<uint8_t> output;  // Compressed data
+  uLong adler = 1;              // Adler-32 of the uncompressed data
+  uLong length = 0;             // Size of the uncompressed data
+  bool ok = false;
+};
+
+void compress_png_band(FileOp* fop,
+                       const FileAbstractImage* img,
+                       const int color_type,
+                       const png_uint_32 width,
+                       const png_uint_32 height,
+                       const std::size_t rowbytes,
+                       const std::size_t bpp,
+                       const int level,
+                       const PngOptions::Filter filter,
+                       const bool last,
+                       PngBand& band)
+{
+  const std::size_t stride = rowbytes+1;
+
+  // Last rows of the previous band are filtered too to be used as
+  // the dictionary (as pigz does).
+  const png_uint_32 dictRows =
+    std::min<png_uint_32>(band.y1, png_uint_32((kDictSize + stride - 1) / stride));
+  const png_uint_32 firstRow = band.y1 - dictRows;
+
+  std::vector<uint8_t> filtered(std::size_t(band.y2 - firstRow) * stride);
+  std::vector<uint8_t> row(rowbytes), prev(rowbytes), tmp;
+  bool hasPrev = false;
+  if (firstRow > 0) {
+    convert_row_to_png(fop, img, color_type, width, height, firstRow-1, prev.data());
+    hasPrev = true;
+  }
+  for (png_uint_32 y=firstRow; y<band.y2; ++y) {
+    convert_row_to_png(fop, img, color_type, width, height, y, row.data());
+    filter_png_row(filter, row.data(), (hasPrev ? prev.data(): nullptr),
+                   rowbytes, bpp, &filtered[std::size_t(y - firstRow) * stride], tmp);
+    std::swap(row, prev);
+    hasPrev = true;
+  }
+
+  const std::size_t dictSize = std::min(kDictSize, std::size_t(dictRows) * stride);
+  const uint8_t* data = &filtered[std::size_t(dictRows) * stride];
+  const std::size_t size = std::size_t(band.y2 - band.y1) * stride;
+  band.length = uLong(size);
+  band.adler = adler32(1, data, uInt(size));
+
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // Raw deflate stream (without zlib header/trailer)
+  if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return;
+  if (dictSize > 0)
+    deflateSetDictionary(&zs, data - dictSize, uInt(dictSize));
+
+  band.output.resize(deflateBound(&zs, uLong(size)) + 64);
+  zs.next_in = (Bytef*)data;
+  zs.avail_in = uInt(size);
+  zs.next_out = band.output.data();
+  zs.avail_out = uInt(band.output.size());
+
+  // All bands end in a byte boundary (Z_SYNC_FLUSH) so they can be
+  // concatenated, only the last one finishes the stream.
+  const int flush = (last ? Z_FINISH: Z_SYNC_FLUSH);
+  while (true) {
+    const int ret = deflate(&zs, flush);
+    if (ret == Z_STREAM_ERROR)
+      break;
+    if (zs.avail_out > 0 && zs.avail_in == 0 &&
+        (!last || ret == Z_STREAM_END)) {
+      band.ok = true;
+      break;
+    }
+
+    // Need more space
+    const std::size_t used = band.output.size() - zs.avail_out;
+    band.output.resize(band.output.size() * 2);
+    zs.next_out = band.output.data() + used;
+    zs.avail_out = uInt(band.output.size() - used);
+  }
+  band.output.resize(zs.total_out);
+  deflateEnd(&zs);
+}
+
+// Writes the IDAT chunks compressing bands of rows in several threads
+// and concatenating them in one zlib stream.
+bool write_png_rows_using_threads(png_structp png,
+                                  FileOp* fop,
+                                  const FileAbstractImage* img,
+                                  const int color_type,
+                                  const png_uint_32 width,
+                                  const png_uint_32 height,
+                                  const std::size_t rowbytes,
+                                  const std::size_t bpp,
+                                  const int level,
+                                  const PngOptions::Filter filter)
+{
+  const png_uint_32 rowsPerBand =
+    std::max<png_uint_32>(1, png_uint_32(kBandSize / (rowbytes+1)));
+  const int nbands = int((height + rowsPerBand - 1) / rowsPerBand);
+  const int nthreads = std::clamp(doc::hardware_threads(), 1, nbands);
+
+  // zlib header (deflate with a 32K window)
+  const int flevel = (level < 0 || level == 6 ? 2:
+                      level < 2 ? 0:
+                      level < 6 ? 1: 3);
+  uint8_t header[2] = { 0x78, uint8_t(flevel << 6) };
+  header[1] += 31 - ((header[0]*256 + header[1]) % 31);
+  png_write_chunk(png, (png_const_bytep)"IDAT", header, 2);
+
+  uLong adler = adler32(0, nullptr, 0);
+  for (int i=0; i<nbands; i+=nthreads) {
+    std::vector<PngBand> bands(std::min(nthreads, nbands-i));
+    for (int j=0; j<int(bands.size()); ++j) {
+      PngBand& band = bands[j];
+      band.y1 = png_uint_32(i+j) * rowsPerBand;
+      band.y2 = std::min(height, band.y1 + rowsPerBand);
+    }
+
+    // Compress the bands using the available threads (there can be
+    // fewer threads than bands if this is called from other threads,
+    // e.g. saving several files at the same time)
+    std::atomic<int> next(0);
+    doc::run_workers(
+      int(bands.size()),
+      [&](const int){
+        int j;
+        while ((j = next++) < int(bands.size())) {
+          const bool last = (i+j == nbands-1);
+          compress_png_band(fop, img, color_type, width, height,
+                            rowbytes, bpp, level, filter, last, bands[j]);
+        }
+      });
+
+    for (const PngBand& band : bands) {
+      if (!band.ok) {
+        fop->setError("Error compressing PNG data\n");
+        return false;
+      }
+      png_write_chunk(png, (png_const_bytep)"IDAT",
+                      band.output.data(), band.output.size());
+      adler = adler32_combine(adler, band.adler, band.length);
+    }
+
+    fop->setProgress((double)bands.back().y2 / (double)height);
+  }
+
+  const uint8_t trailer[4] = {
+    uint8_t((adler >> 24) & 0xff),
+    uint8_t((adler >> 16) & 0xff),
+    uint8_t((adler >> 8) & 0xff),
+    uint8_t(adler & 0xff)
+  };
+  png_write_chunk(png, (png_const_bytep)"IDAT", trailer, 4);
+  return true;
+}
+
+} // anonymous namespace
+
 bool PngFormat::onSave(FileOp* fop)
 {
   png_infop info;
@@ -610,6 +999,21 @@ bool PngFormat::onSave(FileOp* fop)
     png_set_unknown_chunks(png, info, &unknowns[0], num_unknowns);
   }
 
+  // Compression options
+  PngOptions::Filter filter = opts->filter();
+  if (filter == PngOptions::Filter::Default) {
+    // Same default filters used by libpng
+    filter = (color_type == PNG_COLOR_TYPE_PALETTE ?
+              PngOptions::Filter::None:
+              PngOptions::Filter::Adaptive);
+  }
+  else {
+    png_set_filter(png, PNG_FILTER_TYPE_BASE,
+                   png_filters_from_options(filter));
+  }
+  if (opts->compressionLevel() >= 0)
+    png_set_compression_level(png, opts->compressionLevel());
+
   if (fop->preserveColorProfile() && spec.colorSpace()) {
     saveColorSpace(png, info, spec.colorSpace().get());
   }
@@ -663,110 +1067,40 @@ bool PngFormat::onSave(FileOp* fop)
   png_write_info(png, info);
   png_set_packing(png);
 
-  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
-
-  for (png_uint_32 y=0; y<height; ++y) {
-    uint8_t* dst_address = row_pointer;
-
-    if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      if (spec.colorMode() == ColorMode::RGB) {
-        auto src_address = (const uint32_t*)img->getScanline(y);
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          a = rgba_geta(c);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
-          *(dst_address++) = rgba_getr(c);
-          *(dst_address++) = rgba_getg(c);
-          *(dst_address++) = rgba_getb(c);
-          *(dst_address++) = a;
-        }
-      }
-      // In case that we are converting an indexed image to RGB just
-      // to convert one pixel with alpha=254.
-      else if (spec.colorMode() == ColorMode::INDEXED) {
-        auto src_address = (const uint8_t*)img->getScanline(y);
-        unsigned int x, c;
-        int r, g, b, a;
-        bool opaque = true;
-
-        for (x=0; x<width; ++x) {
-          c = *(src_address++);
-          fop->sequenceGetColor(c, &r, &g, &b);
-          fop->sequenceGetAlpha(c, &a);
-
-          if (opaque) {
-            if (a < 255)
-              opaque = false;
-            else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-              a = 254;
-          }
-
-          *(dst_address++) = r;
-          *(dst_address++) = g;
-          *(dst_address++) = b;
-          *(dst_address++) = a;
+  // Big images are compressed in several threads
+  if (doc::hardware_threads() > 1 &&
+      std::size_t(width) * height >= kMinPixelsToUseThreads) {
+    const bool result = write_png_rows_using_threads(
+      png, fop, img, color_type, width, height,
+      png_get_rowbytes(png, info),
+      png_get_channels(png, info),
+      opts->compressionLevel(), filter);
+
+    if (result) {
+      // As the IDAT chunks were written manually, we cannot call
+      // png_write_end(), so we write the user chunks after IDAT and
+      // the IEND chunk here.
+      for (const auto& chunk : opts->chunks()) {
+        if (chunk.location & PNG_AFTER_IDAT) {
+          png_byte name[5] = { 0, 0, 0, 0, 0 };
+          std::copy_n(chunk.name.begin(), std::min<std::size_t>(4, chunk.name.size()), name);
+          png_write_chunk(png, name,
+                          (png_const_bytep)chunk.data.data(),
+                          chunk.data.size());
         }
       }
+      png_write_chunk(png, (png_const_bytep)"IEND", nullptr, 0);
     }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB) {
-      auto src_address = (const uint32_t*)img->getScanline(y);
-      unsigned int x, c;
 
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = rgba_getr(c);
-        *(dst_address++) = rgba_getg(c);
-        *(dst_address++) = rgba_getb(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c, a;
-      bool opaque = true;
-
-      for (x=0; x<width; x++) {
-        c = *(src_address++);
-        a = graya_geta(c);
-
-        if (opaque) {
-          if (a < 255)
-            opaque = false;
-          else if (fix_one_alpha_pixel && x == width-1 && y == height-1)
-            a = 254;
-        }
-
-        *(dst_address++) = graya_getv(c);
-        *(dst_address++) = a;
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY) {
-      auto src_address = (const uint16_t*)img->getScanline(y);
-      unsigned int x, c;
-
-      for (x=0; x<width; ++x) {
-        c = *(src_address++);
-        *(dst_address++) = graya_getv(c);
-      }
-    }
-    else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE) {
-      auto src_address = (const uint8_t*)img->getScanline(y);
-      unsigned int x;
+    if (palette)
+      png_free(png, palette);
+    return result;
+  }
 
-      for (x=0; x<width; ++x)
-        *(dst_address++) = *(src_address++);
-    }
+  row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
 
+  for (png_uint_32 y=0; y<height; ++y) {
+    convert_row_to_png(fop, img, color_type, width, height, y, row_pointer);
     png_write_rows(png, &row_pointer, 1);
 
     fop->setProgress((double)(y+1) / (double)(height));
@@ -832,4 +1166,21 @@ void PngFormat::saveColorSpace(png_structp png_ptr, png_infop info_ptr,
 
 #endif  // ENABLE_SAVE
 
+FormatOptionsPtr PngFormat::onAskUserForFormatOptions(FileOp* fop)
+{
+  auto opts = fop->formatOptionsOfDocument<PngOptions>();
+
+  // There is no dialog to configure PNG files, we just use the
+  // compression options from the preferences.
+  if (fop->context() && fop->context()->isUIAvailable()) {
+    auto& pref = Preferences::instance();
+    opts->compressionLevel(std::clamp(pref.png.compressionLevel(), -1, 9));
+    opts->filter(PngOptions::Filter(
+                   std::clamp(pref.png.filter(),
+                              int(PngOptions::Filter::Default),
+                              int(PngOptions::Filter::Adaptive))));
+  }
+  return opts;
+}
+
 } // namespace app
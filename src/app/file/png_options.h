@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -25,6 +25,24 @@ namespace app {
 
     using Chunks = std::vector<Chunk>;
 
+    // Filter applied to each row before compressing it.
+    enum class Filter {
+      Default,                  // Default libpng filter
+      None,
+      Sub,
+      Up,
+      Average,
+      Paeth,
+      Adaptive,                 // Best filter for each row
+    };
+
+    // zlib compression level (0-9), or -1 to use the default level.
+    int compressionLevel() const { return m_compressionLevel; }
+    Filter filter() const { return m_filter; }
+
+    void compressionLevel(int level) { m_compressionLevel = level; }
+    void filter(Filter filter) { m_filter = filter; }
+
     void addChunk(Chunk&& chunk) {
       m_userChunks.emplace_back(std::move(chunk));
     }
@@ -41,6 +59,8 @@ namespace app {
 
   private:
     Chunks m_userChunks;
+    int m_compressionLevel = -1;
+    Filter m_filter = Filter::Default;
   };
 
 } // namespace app
@@ -0,0 +1,160 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/webp_options.h"
+#include "base/fs.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+using namespace app;
+using namespace doc;
+
+// Export time and file size of .webp files. To compare the results
+// with other version of the encoder, run this benchmark in both
+// versions (the "bytes" counter is the size of the saved file).
+//
+// Animations from a directory (e.g. a corpus of .aseprite/.gif
+// files) can be included using the ASEPRITE_WEBP_CORPUS environment
+// variable.
+
+static const char* kOutputFile = "_webp_benchmark.webp";
+
+static void set_webp_options(Doc* doc, const WebPOptions::Type type)
+{
+  auto opts = std::make_shared<WebPOptions>();
+  opts->setType(type);
+  doc->setFormatOptions(opts);
+  doc->setFilename(kOutputFile);
+}
+
+// Animation with a static noisy background and a square that moves
+// over it (only the area of the square changes between frames). Each
+// 4th frame is equal to the previous one.
+static Doc* make_animation(Context* ctx, const int w, const int h,
+                           const int nframes)
+{
+  Sprite* sprite = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  sprite->setTotalFrames(frame_t(nframes));
+
+  ImageRef background(Image::create(IMAGE_RGB, w, h));
+  std::mt19937 rng(w*h);
+  std::uniform_int_distribution<int> dist(0, 31);
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(background.get(), x, y,
+                rgba(128+dist(rng), 64+dist(rng), 32+dist(rng), 255));
+
+  const int size = std::max(1, std::min(w, h) / 4);
+  int pos = 0;
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    if (frame % 4 != 3)
+      pos = (pos + 3) % std::max(1, w - size);
+
+    ImageRef image(Image::createCopy(background.get()));
+    fill_rect(image.get(), pos, h/2 - size/2, pos+size-1, h/2 + size/2,
+              rgba(255, 255, 255, 255));
+
+    if (frame == 0) {
+      layer->cel(frame)->data()->setImage(image, layer);
+    }
+    else {
+      layer->addCel(new Cel(frame, image));
+    }
+  }
+
+  Doc* doc = new Doc(sprite);
+  ctx->documents().add(doc);
+  return doc;
+}
+
+static void BM_SaveWebPAnimation(benchmark::State& state)
+{
+  const auto type = WebPOptions::Type(state.range(0));
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const int nframes = state.range(3);
+
+  Context ctx;
+  std::unique_ptr<Doc> doc(make_animation(&ctx, w, h, nframes));
+  set_webp_options(doc.get(), type);
+
+  for (auto _ : state)
+    save_document(&ctx, doc.get());
+
+  state.counters["bytes"] = double(base::file_size(kOutputFile));
+  doc->close();
+}
+
+static void BM_SaveWebPFile(benchmark::State& state,
+                            const std::string& filename)
+{
+  const auto type = WebPOptions::Type(state.range(0));
+
+  Context ctx;
+  std::unique_ptr<Doc> doc(load_document(&ctx, filename));
+  if (!doc) {
+    state.SkipWithError("Error loading file");
+    return;
+  }
+  set_webp_options(doc.get(), type);
+
+  for (auto _ : state)
+    save_document(&ctx, doc.get());
+
+  state.counters["bytes"] = double(base::file_size(kOutputFile));
+  doc->close();
+}
+
+BENCHMARK(BM_SaveWebPAnimation)
+  ->Args({ WebPOptions::Lossless, 128, 128, 32 })
+  ->Args({ WebPOptions::Lossless, 512, 512, 32 })
+  ->Args({ WebPOptions::Lossy, 128, 128, 32 })
+  ->Args({ WebPOptions::Lossy, 512, 512, 32 })
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+int main(int argc, char* argv[])
+{
+  benchmark::Initialize(&argc, argv);
+
+  if (const char* dir = std::getenv("ASEPRITE_WEBP_CORPUS")) {
+    for (const auto& fn : base::list_files(dir)) {
+      const std::string filename = base::join_path(dir, fn);
+      if (!base::is_file(filename))
+        continue;
+
+      benchmark::RegisterBenchmark(
+        ("BM_SaveWebPFile/" + fn).c_str(), BM_SaveWebPFile, filename)
+        ->Arg(WebPOptions::Lossless)
+        ->Arg(WebPOptions::Lossy)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    }
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  if (base::is_file(kOutputFile))
+    base::delete_file(kOutputFile);
+  return 0;
+}
@@ -23,6 +23,7 @@
 #include "base/convert_to.h"
 #include "base/file_handle.h"
 #include "doc/doc.h"
+#include "doc/parallel.h"
 #include "ui/manager.h"
 
 #include "webp_options.xml.h"
@@ -30,7 +31,13 @@
 #include <cstdio>
 #include <cstdlib>
 #include <algorithm>
+#include <condition_variable>
+#include <exception>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <webp/demux.h>
 #include <webp/mux.h>
@@ -159,9 +166,11 @@ bool WebPFormat::onLoad(FileOp* fop)
   Sprite* sprite = new Sprite(ImageSpec(ColorMode::RGB, w, h), 256);
   LayerImage* layer = new LayerImage(sprite);
   sprite->root()->addLayer(layer);
-  sprite->setTotalFrames(anim_info.frame_count);
+  // Just one frame? (e.g. to generate a thumbnail)
+  const frame_t nframes = (fop->isOneFrame() ? 1: anim_info.frame_count);
+  sprite->setTotalFrames(nframes);
 
-  for (frame_t f=0; f<anim_info.frame_count; ++f) {
+  for (frame_t f=0; f<nframes; ++f) {
     ImageRef image(Image::create(IMAGE_RGB, w, h));
     Cel* cel = new Cel(f, image);
     layer->addCel(cel);
@@ -203,11 +212,12 @@ bool WebPFormat::onLoad(FileOp* fop)
     sprite->setFrameDuration(f, frame_timestamp - prev_timestamp);
 
     prev_timestamp = frame_timestamp;
-    fop->setProgress(double(f) / double(anim_info.frame_count));
+    fop->setProgress(double(f) / double(nframes));
     if (fop->isStop())
       break;
 
-    ++f;
+    if (++f == nframes)
+      break;
   }
   WebPAnimDecoderReset(dec);
 
@@ -239,6 +249,165 @@ struct WriterData {
     : fp(fp), fop(fop), n(n) { }
 };
 
+// Deletes the WebPAnimEncoder when it goes out of scope.
+struct WebPAnimEncoderHolder {
+  WebPAnimEncoder* enc;
+  WebPAnimEncoderHolder(WebPAnimEncoder* enc) : enc(enc) { }
+  ~WebPAnimEncoderHolder() {
+    if (enc)
+      WebPAnimEncoderDelete(enc);
+  }
+  WebPAnimEncoderHolder(const WebPAnimEncoderHolder&) = delete;
+  WebPAnimEncoderHolder& operator=(const WebPAnimEncoderHolder&) = delete;
+};
+
+// Frees the bytes of the assembled WebP data when it goes out of
+// scope.
+struct WebPDataHolder {
+  WebPData data;
+  WebPDataHolder() { WebPDataInit(&data); }
+  ~WebPDataHolder() { WebPDataClear(&data); }
+  WebPDataHolder(const WebPDataHolder&) = delete;
+  WebPDataHolder& operator=(const WebPDataHolder&) = delete;
+};
+
+// Renders the frames to be saved in background threads (a limited
+// number of frames ahead of the frame that is being encoded), the
+// WebPAnimEncoder must receive all frames in order from one thread.
+// Workers stop rendering frames when the FileOp is stopped.
+class WebPFrameRenderer {
+public:
+  WebPFrameRenderer(FileOp* fop, const int w, const int h)
+    : m_fop(fop)
+    , m_sprite(fop->abstractImageToSave())
+    , m_w(w)
+    , m_h(h) {
+    for (frame_t frame : fop->roi().selectedFrames())
+      m_frames.push_back(frame);
+
+    // At least one worker is created (this thread encodes the
+    // frames), more workers only if there are threads available.
+    m_reservedThreads = std::make_unique<doc::ReservedThreads>(
+      std::max(1, int(m_frames.size())));
+    const int nworkers = std::max(1, m_reservedThreads->count());
+    m_maxFramesAhead = 2*nworkers;
+    for (int i=0; i<nworkers; ++i)
+      m_workers.emplace_back([this]{ workerThread(); });
+  }
+
+  ~WebPFrameRenderer() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers)
+      worker.join();
+  }
+
+  int frames() const { return int(m_frames.size()); }
+  frame_t spriteFrame(const int i) const { return m_frames[i]; }
+
+  // Waits the i-th frame to be rendered in BGRA format (or rethrows
+  // the exception that was thrown in a background thread). Returns
+  // nullptr if the FileOp was stopped.
+  ImageRef waitFrame(const int i) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, i]{
+      return (m_error || m_canceled ||
+              m_rendered.find(i) != m_rendered.end());
+    });
+    if (m_error)
+      std::rethrow_exception(m_error);
+    if (m_canceled)
+      return nullptr;
+
+    auto it = m_rendered.find(i);
+    ImageRef frame = std::move(it->second);
+    m_rendered.erase(it);
+
+    // Allow to render more frames
+    m_nextToEncode = i+1;
+    m_cv.notify_all();
+    return frame;
+  }
+
+private:
+  void workerThread() {
+    try {
+      while (true) {
+        int i;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this]{
+            return (m_stop ||
+                    m_nextToRender >= frames() ||
+                    m_nextToRender < m_nextToEncode + m_maxFramesAhead);
+          });
+          if (m_stop || m_nextToRender >= frames())
+            return;
+          if (m_fop->isStop()) {
+            m_canceled = true;
+            m_cv.notify_all();
+            return;
+          }
+          i = m_nextToRender++;
+        }
+
+        ImageRef frame(Image::create(IMAGE_RGB, m_w, m_h));
+        clear_image(frame.get(), frame->maskColor());
+        m_sprite->renderFrame(m_frames[i],
+                              m_fop->roi().frameBounds(m_frames[i]),
+                              frame.get());
+
+        // Switch R <-> B channels because WebPAnimEncoderAssemble()
+        // expects MODE_BGRA pictures.
+        {
+          LockImageBits<RgbTraits> bits(frame.get(), Image::ReadWriteLock);
+          auto it = bits.begin(), end = bits.end();
+          for (; it != end; ++it) {
+            auto c = *it;
+            *it = rgba(rgba_getb(c), // Use blue in red channel
+                       rgba_getg(c),
+                       rgba_getr(c), // Use red in blue channel
+                       rgba_geta(c));
+          }
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_rendered[i] = std::move(frame);
+        m_cv.notify_all();
+      }
+    }
+    catch (...) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_error)
+        m_error = std::current_exception();
+      m_stop = true;
+      m_cv.notify_all();
+    }
+  }
+
+  FileOp* m_fop;
+  const FileAbstractImage* m_sprite;
+  int m_w, m_h;
+  std::vector<frame_t> m_frames;
+  std::unique_ptr<doc::ReservedThreads> m_reservedThreads;
+  std::vector<std::thread> m_workers;
+  int m_maxFramesAhead = 1;
+
+  // Next frame to be rendered/encoded, and rendered frames waiting
+  // to be encoded (accessed with m_mutex locked).
+  int m_nextToRender = 0;
+  int m_nextToEncode = 0;
+  std::map<int, ImageRef> m_rendered;
+  std::exception_ptr m_error;
+  bool m_stop = false;
+  bool m_canceled = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+};
+
 static int progress_report(int percent, const WebPPicture* pic)
 {
   auto wd = (WriterData*)pic->user_data;
@@ -303,7 +472,10 @@ bool WebPFormat::onSave(FileOp* fop)
     (opts->loop() ? 0:  // 0 = infinite
                     1); // 1 = loop once
 
-  ImageRef image(Image::create(IMAGE_RGB, w, h));
+  // Use several threads in the encoder of each frame
+  config.thread_level = 1;
+
+  WebPFrameRenderer renderer(fop, w, h);
 
   const doc::frame_t totalFrames = fop->roi().frames();
   WriterData wd(fp, fop, totalFrames);
@@ -312,33 +484,21 @@ bool WebPFormat::onSave(FileOp* fop)
   pic.width = w;
   pic.height = h;
   pic.use_argb = true;
-  pic.argb = (uint32_t*)image->getPixelAddress(0, 0);
-  pic.argb_stride = image->rowPixels(); // Stride in pixels (not bytes)
   pic.user_data = &wd;
   pic.progress_hook = progress_report;
 
-  WebPAnimEncoder* enc = WebPAnimEncoderNew(w, h, &enc_options);
+  WebPAnimEncoderHolder enc(WebPAnimEncoderNew(w, h, &enc_options));
   int timestamp_ms = 0;
-  for (frame_t frame : fop->roi().selectedFrames()) {
-    // Render the frame in the bitmap
-    clear_image(image.get(), image->maskColor());
-    sprite->renderFrame(frame, fop->roi().frameBounds(frame), image.get());
+  for (int i=0; i<renderer.frames(); ++i) {
+    const frame_t frame = renderer.spriteFrame(i);
+    ImageRef image = renderer.waitFrame(i);
+    if (!image || fop->isStop())
+      return true;
 
-    // Switch R <-> B channels because WebPAnimEncoderAssemble()
-    // expects MODE_BGRA pictures.
-    {
-      LockImageBits<RgbTraits> bits(image.get(), Image::ReadWriteLock);
-      auto it = bits.begin(), end = bits.end();
-      for (; it != end; ++it) {
-        auto c = *it;
-        *it = rgba(rgba_getb(c), // Use blue in red channel
-                   rgba_getg(c),
-                   rgba_getr(c), // Use red in blue channel
-                   rgba_geta(c));
-      }
-    }
+    pic.argb = (uint32_t*)image->getPixelAddress(0, 0);
+    pic.argb_stride = image->rowPixels(); // Stride in pixels (not bytes)
 
-    if (!WebPAnimEncoderAdd(enc, &pic, timestamp_ms, &config)) {
+    if (!WebPAnimEncoderAdd(enc.enc, &pic, timestamp_ms, &config)) {
       if (!fop->isStop()) {
         fop->setError("Error saving frame %d info\n", frame);
         return false;
@@ -350,19 +510,15 @@ bool WebPFormat::onSave(FileOp* fop)
 
     wd.f++;
   }
-  WebPAnimEncoderAdd(enc, nullptr, timestamp_ms, nullptr);
+  WebPAnimEncoderAdd(enc.enc, nullptr, timestamp_ms, nullptr);
 
-  WebPData webp_data;
-  WebPDataInit(&webp_data);
-  WebPAnimEncoderAssemble(enc, &webp_data);
-  WebPAnimEncoderDelete(enc);
+  WebPDataHolder webp_data;
+  WebPAnimEncoderAssemble(enc.enc, &webp_data.data);
 
-  if (fwrite(webp_data.bytes, 1, webp_data.size, fp) != webp_data.size) {
+  if (fwrite(webp_data.data.bytes, 1, webp_data.data.size, fp) != webp_data.data.size) {
     fop->setError("Error saving content into file\n");
     return false;
   }
-
-  WebPDataClear(&webp_data);
   return true;
 }
 
@@ -20,6 +20,7 @@ using namespace doc;
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
+  m_render.setOnionskinCache(&m_onionskinCache);
 }
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
@@ -92,6 +93,9 @@ void SimpleRenderer::setOnionskin(const render::OnionskinOptions& options)
 void SimpleRenderer::disableOnionskin()
 {
   m_render.disableOnionskin();
+
+  // Release the memory used by the onion skin cels
+  m_onionskinCache.invalidate();
 }
 
 void SimpleRenderer::renderSprite(os::Surface* dstSurface,
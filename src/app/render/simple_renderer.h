@@ -61,6 +61,7 @@ namespace app {
                      const doc::BlendMode blendMode) override;
   private:
     Properties m_properties;
+    render::OnionskinCache m_onionskinCache;
     render::Render m_render;
   };
 
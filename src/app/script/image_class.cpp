@@ -31,7 +31,9 @@
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_bits.h"
 #include "doc/image_ref.h"
+#include "doc/layer_tilemap.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "render/render.h"
@@ -39,6 +41,8 @@
 #include <algorithm>
 #include <cstring>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace app {
 namespace script {
@@ -113,6 +117,119 @@ void render_sprite(Image* dst,
               sprite->height()));
 }
 
+// Table of colors to be replaced: original color -> new color
+using ColorMap = std::unordered_map<doc::color_t, doc::color_t>;
+
+// Remaps the pixels using a direct lookup table (for pixel formats
+// with a small range of possible values, e.g. indexed/grayscale).
+template<typename ImageTraits>
+void remap_pixels_with_lut(doc::Image* image, const ColorMap& colorMap,
+                           const int entries)
+{
+  std::vector<doc::color_t> lut(entries);
+  for (int i=0; i<entries; ++i)
+    lut[i] = i;
+  for (const auto& it : colorMap) {
+    if (it.first < doc::color_t(entries))
+      lut[it.first] = it.second;
+  }
+  doc::transform_image<ImageTraits>(
+    image, [&lut](doc::color_t c) -> doc::color_t {
+      return lut[c];
+    });
+}
+
+template<typename ImageTraits>
+void remap_pixels_with_map(doc::Image* image, const ColorMap& colorMap)
+{
+  // Cache the last replaced color as usually there are runs of
+  // pixels with the same color.
+  doc::color_t lastFrom = 0, lastTo = 0;
+  bool hasLast = false;
+  doc::transform_image<ImageTraits>(
+    image, [&](doc::color_t c) -> doc::color_t {
+      if (hasLast && lastFrom == c)
+        return lastTo;
+
+      auto it = colorMap.find(c);
+      lastFrom = c;
+      lastTo = (it != colorMap.end() ? it->second: c);
+      hasLast = true;
+      return lastTo;
+    });
+}
+
+void remap_pixels(doc::Image* image, const ColorMap& colorMap)
+{
+  switch (image->pixelFormat()) {
+    case doc::IMAGE_RGB:
+      remap_pixels_with_map<doc::RgbTraits>(image, colorMap);
+      break;
+    case doc::IMAGE_GRAYSCALE:
+      remap_pixels_with_lut<doc::GrayscaleTraits>(image, colorMap, 0x10000);
+      break;
+    case doc::IMAGE_INDEXED:
+      remap_pixels_with_lut<doc::IndexedTraits>(image, colorMap, 256);
+      break;
+    case doc::IMAGE_BITMAP:
+      remap_pixels_with_lut<doc::BitmapTraits>(image, colorMap, 2);
+      break;
+    case doc::IMAGE_TILEMAP:
+      remap_pixels_with_map<doc::TilemapTraits>(image, colorMap);
+      break;
+  }
+}
+
+// Returns the given rectangle (or the whole image bounds) clipped to
+// the image bounds.
+gfx::Rect get_image_rect_from_arg(lua_State* L, int index, const doc::Image* img)
+{
+  gfx::Rect rc = img->bounds();
+  if (!lua_isnone(L, index))
+    rc &= convert_args_into_rect(L, index);
+  return rc;
+}
+
+// Called when the pixels of an image are modified directly (without
+// a Tx/cmd). Increments the image version, rehashes the tile if it's
+// a tile image, and invalidates the tiles histogram if it's a
+// tilemap of a cel.
+void notify_image_change(lua_State* L, ImageObj* obj)
+{
+  obj->image(L)->incrementVersion();
+
+  if (doc::Cel* cel = obj->cel(L)) {
+    if (cel->layer()->isTilemap()) {
+      if (doc::Tileset* ts = static_cast<doc::LayerTilemap*>(cel->layer())->tileset())
+        ts->invalidateTilesHistogram();
+    }
+  }
+
+  if (obj->tilesetId) {
+    if (doc::Tileset* ts = obj->tileset(L)) {
+      ts->incrementVersion();
+      ts->notifyTileContentChange(obj->ti);
+    }
+  }
+}
+
+// Creates the cmd to copy the "region" from "src" to the image of
+// the given cel. Tilemaps are copied with CopyTilemapRegion to keep
+// the tiles histogram of the tileset updated.
+cmd::CopyRegion* new_copy_region_in_cel_cmd(doc::Cel* cel,
+                                            doc::Image* dst,
+                                            const doc::Image* src,
+                                            const gfx::Region& region,
+                                            const gfx::Point& dstPos)
+{
+  if (cel->layer()->isTilemap()) {
+    return new cmd::CopyTilemapRegion(
+      dst, src, region, dstPos,
+      static_cast<doc::LayerTilemap*>(cel->layer())->tileset());
+  }
+  return new cmd::CopyRegion(dst, src, region, dstPos);
+}
+
 int Image_clone(lua_State* L);
 
 int Image_new(lua_State* L)
@@ -253,6 +370,7 @@ int Image_clear(lua_State* L)
     color = convert_args_into_pixel_color(L, i, img->pixelFormat());
 
   doc::fill_rect(img, rc, color); // Clips the rectangle to the image bounds
+  notify_image_change(L, obj);
   return 0;
 }
 
@@ -270,12 +388,7 @@ int Image_drawPixel(lua_State* L)
   doc::put_pixel(img, x, y, color);
 
   // Rehash tileset
-  if (obj->tilesetId) {
-    if (doc::Tileset* ts = obj->tileset(L)) {
-      ts->incrementVersion();
-      ts->notifyTileContentChange(obj->ti);
-    }
-  }
+  notify_image_change(L, obj);
   return 0;
 }
 
@@ -323,8 +436,8 @@ int Image_drawImage(lua_State* L)
     //      but we need something that does the render and compares
     //      the minimal modified area.
     Tx tx(cel->sprite());
-    tx(new cmd::CopyRegion(
-         dst, tmp_src.get(), gfx::Region(bounds),
+    tx(new_copy_region_in_cel_cmd(
+         cel, dst, tmp_src.get(), gfx::Region(bounds),
          gfx::Point(pos.x + bounds.x, pos.y + bounds.y)));
     tx.commit();
   }
@@ -334,6 +447,7 @@ int Image_drawImage(lua_State* L)
     doc::blend_image(dst, src,
                      pos.x, pos.y,
                      opacity, blendMode);
+    notify_image_change(L, obj);
   }
   return 0;
 }
@@ -357,9 +471,10 @@ int Image_drawSprite(lua_State* L)
 
     int x1, y1, x2, y2;
     if (get_shrink_rect2(&x1, &y1, &x2, &y2, dst, tmp.get())) {
-      tx(new cmd::CopyRect(
-           dst, tmp.get(),
-           gfx::Clip(x1, y1, x1, y1, x2-x1+1, y2-y1+1)));
+      tx(new_copy_region_in_cel_cmd(
+           cel, dst, tmp.get(),
+           gfx::Region(gfx::Rect(x1, y1, x2-x1+1, y2-y1+1)),
+           gfx::Point(0, 0)));
     }
 
     tx.commit();
@@ -368,6 +483,7 @@ int Image_drawSprite(lua_State* L)
   // the source image without undo information.
   else {
     render_sprite(dst, sprite, frame, pos.x, pos.y);
+    notify_image_change(L, obj);
   }
   return 0;
 }
@@ -375,7 +491,12 @@ int Image_drawSprite(lua_State* L)
 int Image_pixels(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
-  push_image_iterator_function(L, obj->image(L), 2);
+  doc::Tileset* tileset = nullptr;
+  if (doc::Cel* cel = obj->cel(L)) {
+    if (cel->layer()->isTilemap())
+      tileset = static_cast<doc::LayerTilemap*>(cel->layer())->tileset();
+  }
+  push_image_iterator_function(L, obj->image(L), 2, tileset);
   return 1;
 }
 
@@ -634,6 +755,139 @@ int Image_flip(lua_State* L)
   }
   else {
     doc::algorithm::flip_image(img, img->bounds(), flipType);
+    notify_image_change(L, obj);
+  }
+  return 0;
+}
+
+int Image_remap(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  // Image:remap{ [fromColor]=toColor, ... }
+  ColorMap colorMap;
+  lua_pushnil(L);
+  while (lua_next(L, 2) != 0) {
+    if (lua_isinteger(L, -2) && lua_isinteger(L, -1)) {
+      colorMap[doc::color_t(lua_tointeger(L, -2))] =
+        doc::color_t(lua_tointeger(L, -1));
+    }
+    lua_pop(L, 1);
+  }
+  if (colorMap.empty())
+    return 0;
+
+  if (auto cel = obj->cel(L)) {
+    ImageRef tmp(Image::createCopy(img));
+    remap_pixels(tmp.get(), colorMap);
+
+    int x1, y1, x2, y2;
+    if (get_shrink_rect2(&x1, &y1, &x2, &y2, img, tmp.get())) {
+      Tx tx(cel->sprite());
+      tx(new_copy_region_in_cel_cmd(
+           cel, img, tmp.get(),
+           gfx::Region(gfx::Rect(x1, y1, x2-x1+1, y2-y1+1)),
+           gfx::Point(0, 0)));
+      tx.commit();
+    }
+  }
+  // If the image is not related to a sprite, we just remap it
+  // without undo information.
+  else {
+    remap_pixels(img, colorMap);
+    notify_image_change(L, obj);
+  }
+  return 0;
+}
+
+// Bytes of a row of "w" pixels without padding. IMAGE_BITMAP rows
+// are bit-packed (8 pixels per byte).
+int get_packed_row_size(const doc::Image* img, const int w)
+{
+  if (img->pixelFormat() == doc::IMAGE_BITMAP)
+    return doc::BitmapTraits::width_bytes(w);
+  else
+    return img->bytesPerPixel() * w;
+}
+
+int Image_getBytes(lua_State* L)
+{
+  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  const gfx::Rect rc = get_image_rect_from_arg(L, 2, img);
+  if (rc.isEmpty()) {
+    lua_pushliteral(L, "");
+    return 1;
+  }
+
+  // Rows of bit-packed bitmaps can start/end in the middle of a
+  // byte, so we copy the area to a new image starting at x=0.
+  const doc::Image* src = img;
+  gfx::Point pt = rc.origin();
+  ImageRef tmp;
+  if (img->pixelFormat() == doc::IMAGE_BITMAP) {
+    tmp.reset(doc::crop_image(img, rc, 0));
+    src = tmp.get();
+    pt = gfx::Point(0, 0);
+  }
+
+  // Rows are packed without padding (rowStride = width*bytesPerPixel)
+  const int rowSize = get_packed_row_size(img, rc.w);
+  luaL_Buffer b;
+  char* dst = luaL_buffinitsize(L, &b, rowSize * rc.h);
+  for (int y=0; y<rc.h; ++y, dst+=rowSize)
+    std::memcpy(dst, src->getPixelAddress(pt.x, pt.y+y), rowSize);
+  luaL_pushresultsize(&b, rowSize * rc.h);
+  return 1;
+}
+
+int Image_setBytes(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  size_t bytes_size;
+  const char* bytes = luaL_checklstring(L, 2, &bytes_size);
+  const gfx::Rect rc = get_image_rect_from_arg(L, 3, img);
+  if (rc.isEmpty())
+    return 0;
+
+  const int rowSize = get_packed_row_size(img, rc.w);
+  const size_t bytes_needed = size_t(rowSize) * rc.h;
+  if (bytes_size != bytes_needed) {
+    lua_pushfstring(L, "Data size does not match: given %I, needed %I.",
+                    lua_Integer(bytes_size), lua_Integer(bytes_needed));
+    return lua_error(L);
+  }
+
+  if (auto cel = obj->cel(L)) {
+    ImageRef tmp(Image::create(img->pixelFormat(), rc.w, rc.h));
+    for (int y=0; y<rc.h; ++y, bytes+=rowSize)
+      std::memcpy(tmp->getPixelAddress(0, y), bytes, rowSize);
+
+    Tx tx(cel->sprite());
+    tx(new_copy_region_in_cel_cmd(
+         cel, img, tmp.get(),
+         gfx::Region(gfx::Rect(0, 0, rc.w, rc.h)),
+         rc.origin()));
+    tx.commit();
+  }
+  // If the image is not related to a sprite, we just copy the bytes
+  // without undo information.
+  else {
+    // Bitmap rows can start/end in the middle of a byte, so they
+    // are copied pixel by pixel from a temporary image.
+    if (img->pixelFormat() == doc::IMAGE_BITMAP) {
+      ImageRef tmp(Image::create(img->pixelFormat(), rc.w, rc.h));
+      for (int y=0; y<rc.h; ++y, bytes+=rowSize)
+        std::memcpy(tmp->getPixelAddress(0, y), bytes, rowSize);
+      doc::copy_image(img, tmp.get(), rc.x, rc.y);
+    }
+    else {
+      for (int y=0; y<rc.h; ++y, bytes+=rowSize)
+        std::memcpy(img->getPixelAddress(rc.x, rc.y+y), bytes, rowSize);
+    }
+    notify_image_change(L, obj);
   }
   return 0;
 }
@@ -676,15 +930,18 @@ int Image_get_bytes(lua_State* L)
 
 int Image_set_bytes(lua_State* L)
 {
-  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  auto obj = get_obj<ImageObj>(L, 1);
+  const auto img = obj->image(L);
   size_t bytes_size, bytes_needed = img->rowBytes() * img->height();
   const char* bytes = lua_tolstring(L, 2, &bytes_size);
 
   if (bytes_size == bytes_needed) {
     std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    notify_image_change(L, obj);
   }
   else {
-    lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
+    lua_pushfstring(L, "Data size does not match: given %I, needed %I.",
+                    lua_Integer(bytes_size), lua_Integer(bytes_needed));
     lua_error(L);
   }
 
@@ -748,6 +1005,9 @@ const luaL_Reg Image_methods[] = {
   { "resize", Image_resize },
   { "shrinkBounds", Image_shrinkBounds },
   { "flip", Image_flip },
+  { "remap", Image_remap },
+  { "getBytes", Image_getBytes },
+  { "setBytes", Image_setBytes },
   { "__gc", Image_gc },
   { "__eq", Image_eq },
   { nullptr, nullptr }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +19,7 @@
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/primitives.h"
+#include "doc/tileset.h"
 
 namespace app {
 namespace script {
@@ -27,10 +28,17 @@ namespace {
 
 template<typename ImageTraits>
 struct ImageIteratorObj {
+  doc::Image* image;
+  // Tileset used by the tilemap image (to invalidate its tiles
+  // histogram when the tilemap is modified)
+  doc::ObjectId tilesetId;
   typename doc::LockImageBits<ImageTraits> bits;
   typename doc::LockImageBits<ImageTraits>::iterator begin, next, end;
-  ImageIteratorObj(const doc::Image* image, const gfx::Rect& bounds)
-    : bits(image, bounds),
+  ImageIteratorObj(const doc::Image* image, const gfx::Rect& bounds,
+                   const doc::ObjectId tilesetId)
+    : image(const_cast<doc::Image*>(image)),
+      tilesetId(tilesetId),
+      bits(image, bounds),
       begin(bits.begin()),
       next(begin),
       end(bits.end()) {
@@ -63,6 +71,12 @@ int ImageIterator_call(lua_State* L)
   // Set value
   else {
     *obj->begin = lua_tointeger(L, 2);
+    // New version to invalidate caches of the image
+    obj->image->incrementVersion();
+    if (obj->tilesetId) {
+      if (auto tileset = doc::get<doc::Tileset>(obj->tilesetId))
+        tileset->invalidateTilesHistogram();
+    }
     return 1;
   }
 }
@@ -137,8 +151,11 @@ static int image_iterator_do_nothing(lua_State* L)
   return 1;
 }
 
-int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex)
+int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex,
+                                 doc::Tileset* tileset)
 {
+  const doc::ObjectId tilesetId = (tileset ? tileset->id(): doc::NullId);
+
   gfx::Rect bounds = image->bounds();
 
   if (!lua_isnone(L, extraArgIndex)) {
@@ -154,19 +171,19 @@ int push_image_iterator_function(lua_State* L, const doc::Image* image, int extr
 
   switch (image->pixelFormat()) {
     case IMAGE_RGB:
-      push_new<RgbImageIterator>(L, image, bounds);
+      push_new<RgbImageIterator>(L, image, bounds, tilesetId);
       lua_pushcclosure(L, image_iterator_step_closure<doc::RgbTraits>, 1);
       return 1;
     case IMAGE_GRAYSCALE:
-      push_new<GrayscaleImageIterator>(L, image, bounds);
+      push_new<GrayscaleImageIterator>(L, image, bounds, tilesetId);
       lua_pushcclosure(L, image_iterator_step_closure<doc::GrayscaleTraits>, 1);
       return 1;
     case IMAGE_INDEXED:
-      push_new<IndexedImageIterator>(L, image, bounds);
+      push_new<IndexedImageIterator>(L, image, bounds, tilesetId);
       lua_pushcclosure(L, image_iterator_step_closure<doc::IndexedTraits>, 1);
       return 1;
     case IMAGE_TILEMAP:
-      push_new<TilemapImageIterator>(L, image, bounds);
+      push_new<TilemapImageIterator>(L, image, bounds, tilesetId);
       lua_pushcclosure(L, image_iterator_step_closure<doc::TilemapTraits>, 1);
       return 1;
     default:
@@ -0,0 +1,380 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/skyline_packer.h"
+
+#include "base/debug.h"
+#include "doc/parallel.h"
+#include "gfx/point.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace app {
+
+namespace {
+
+// Candidate widths (relative to the square root of the total area)
+// tested by bestFit() when there is no fixed width/height.
+const double kMinWidthFactor = 0.75;
+const double kMaxWidthFactor = 1.5;
+const double kWidthFactorStep = 0.05;
+
+const int kUnlimited = std::numeric_limits<int>::max();
+
+// Top edge of the already packed rectangles, as a list of horizontal
+// segments from left to right which cover the whole bin width.
+class Skyline {
+public:
+  Skyline(const int width, const int height)
+    : m_width(width)
+    , m_height(height) {
+    m_segs.push_back(Segment{ 0, 0, width });
+  }
+
+  // Finds the position where the given rectangle has the lowest
+  // bottom edge (in case of a tie, the left-most one).
+  bool insert(const gfx::Size& sz, gfx::Point& pt) {
+    const int n = int(m_segs.size());
+    int bestBottom = kUnlimited;
+    int bestIndex = -1;
+    int bestY = 0;
+
+    for (int i=0; i<n; ++i) {
+      if (m_segs[i].x > m_width - sz.w)
+        break;
+
+      int y = 0;
+      int remaining = sz.w;
+      for (int j=i; remaining > 0; ++j) {
+        ASSERT(j < n);
+        y = std::max(y, m_segs[j].y);
+        // Cannot be better than the best position found
+        if (y >= bestBottom - sz.h || y > m_height - sz.h) {
+          y = -1;
+          break;
+        }
+        remaining -= m_segs[j].w;
+      }
+      if (y < 0)
+        continue;
+
+      bestBottom = y + sz.h;
+      bestIndex = i;
+      bestY = y;
+    }
+
+    if (bestIndex < 0)
+      return false;
+
+    pt.x = m_segs[bestIndex].x;
+    pt.y = bestY;
+    place(bestIndex, Segment{ pt.x, bestBottom, sz.w });
+    return true;
+  }
+
+private:
+  struct Segment {
+    int x, y, w;
+  };
+
+  void place(const int i, const Segment& seg) {
+    const int right = seg.x + seg.w;
+
+    // Remove segments that are completely covered by the new one,
+    // and cut the one that is partially covered.
+    int j = i;
+    while (j < int(m_segs.size()) &&
+           m_segs[j].x + m_segs[j].w <= right)
+      ++j;
+    if (j < int(m_segs.size()) && m_segs[j].x < right) {
+      m_segs[j].w -= right - m_segs[j].x;
+      m_segs[j].x = right;
+    }
+    m_segs.erase(m_segs.begin()+i, m_segs.begin()+j);
+    m_segs.insert(m_segs.begin()+i, seg);
+
+    // Merge with neighbors at the same height
+    int k = i;
+    if (k+1 < int(m_segs.size()) && m_segs[k+1].y == m_segs[k].y) {
+      m_segs[k].w += m_segs[k+1].w;
+      m_segs.erase(m_segs.begin()+k+1);
+    }
+    if (k > 0 && m_segs[k-1].y == m_segs[k].y) {
+      m_segs[k-1].w += m_segs[k].w;
+      m_segs.erase(m_segs.begin()+k);
+    }
+  }
+
+  int m_width;
+  int m_height;
+  std::vector<Segment> m_segs;
+};
+
+} // anonymous namespace
+
+struct SkylinePacker::Result {
+  bool ok = false;
+  gfx::Size used;                  // Used area (without borders)
+  std::vector<gfx::Point> points;  // Position of each rectangle (-1,-1 if it doesn't fit)
+};
+
+SkylinePacker::SkylinePacker(const int borderPadding,
+                             const int shapePadding)
+  : m_borderPadding(borderPadding)
+  , m_shapePadding(shapePadding)
+{
+}
+
+void SkylinePacker::add(const gfx::Size& sz)
+{
+  m_sizes.push_back(sz);
+  m_rects.push_back(gfx::Rect(0, 0, sz.w, sz.h));
+}
+
+gfx::Size SkylinePacker::bestFit(base::task_token& token,
+                                 const int fixedWidth,
+                                 const int fixedHeight)
+{
+  if (fixedWidth > 0 && fixedHeight > 0) {
+    gfx::Size size(fixedWidth, fixedHeight);
+    pack(size, token);
+    return size;
+  }
+
+  // Each rectangle uses its size + shape padding, and the texture
+  // area is reduced by the border padding in both sides (we add one
+  // extra shape padding as the last rectangle doesn't need it).
+  const int borders = 2*m_borderPadding - m_shapePadding;
+
+  // Candidate widths of the area where rectangles are packed
+  std::vector<int> widths;
+  if (fixedWidth > 0) {
+    widths.push_back(fixedWidth - borders);
+  }
+  else if (fixedHeight > 0) {
+    // Pack with a fixed width and transpose the result
+    widths.push_back(fixedHeight - borders);
+  }
+  else {
+    double area = 0.0;
+    int maxWidth = 0;
+    int sumWidth = 0;
+    for (const gfx::Size& sz : m_sizes) {
+      if (sz.w <= 0 || sz.h <= 0)
+        continue;
+      const int w = sz.w + m_shapePadding;
+      const int h = sz.h + m_shapePadding;
+      area += double(w) * double(h);
+      maxWidth = std::max(maxWidth, w);
+      sumWidth += w;
+    }
+
+    const double side = std::sqrt(area);
+    for (double f=kMinWidthFactor;
+         f<kMaxWidthFactor+kWidthFactorStep/2;
+         f+=kWidthFactorStep) {
+      widths.push_back(std::clamp(int(std::ceil(side * f)),
+                                  maxWidth, std::max(maxWidth, sumWidth)));
+    }
+    widths.erase(std::unique(widths.begin(), widths.end()), widths.end());
+  }
+
+  struct Candidate {
+    int width, height;
+    Order order;
+    bool transposed;
+  };
+  std::vector<Candidate> candidates;
+  for (Order order : { Order::Height, Order::MaxSide }) {
+    for (int w : widths) {
+      candidates.push_back(
+        Candidate{ w, kUnlimited, order, (fixedHeight > 0) });
+    }
+  }
+
+  // Pack all candidates (using several threads)
+  const int ncandidates = int(candidates.size());
+  std::vector<Result> results(ncandidates);
+  std::atomic<int> next(0);
+  std::atomic<int> finished(0);
+  std::atomic<bool> canceled(false);
+
+  auto worker = [&](const bool mainThread){
+    int i;
+    while (!canceled && (i = next++) < ncandidates) {
+      const Candidate& c = candidates[i];
+      if (!packCandidate(c.width, c.height, c.order, c.transposed,
+                         results[i], token)) {
+        canceled = true;
+        break;
+      }
+      ++finished;
+      if (mainThread)
+        token.set_progress(float(finished) / ncandidates);
+    }
+  };
+
+  doc::run_workers(
+    std::clamp(m_nthreads > 0 ? m_nthreads: doc::hardware_threads(),
+               1, ncandidates),
+    [&worker](const int i){ worker(i == 0); });
+
+  if (canceled) {
+    std::fill(m_rects.begin(), m_rects.end(), gfx::Rect());
+    return gfx::Size(0, 0);
+  }
+
+  // Choose the best candidate: the one that packs all rectangles in
+  // the smallest area, or the most squared texture in case of a tie
+  // (the first candidate in case of a tie again, so the result
+  // doesn't depend on the threads).
+  int best = -1;
+  gfx::Size bestSize;
+  for (int i=0; i<ncandidates; ++i) {
+    const Result& result = results[i];
+    gfx::Size size(std::max(0, result.used.w + borders),
+                   std::max(0, result.used.h + borders));
+    if (fixedWidth > 0) size.w = fixedWidth;
+    if (fixedHeight > 0) size.h = fixedHeight;
+
+    if (best >= 0) {
+      const Result& bestResult = results[best];
+      if (bestResult.ok != result.ok) {
+        if (bestResult.ok)
+          continue;
+      }
+      else {
+        const double area = double(size.w) * double(size.h);
+        const double bestArea = double(bestSize.w) * double(bestSize.h);
+        if (area > bestArea ||
+            (area == bestArea &&
+             std::max(size.w, size.h) >= std::max(bestSize.w, bestSize.h)))
+          continue;
+      }
+    }
+    best = i;
+    bestSize = size;
+  }
+
+  if (best >= 0)
+    setResult(results[best]);
+  return bestSize;
+}
+
+bool SkylinePacker::pack(const gfx::Size& size,
+                         base::task_token& token)
+{
+  const int borders = 2*m_borderPadding - m_shapePadding;
+  Result result;
+  for (Order order : { Order::Height, Order::MaxSide }) {
+    Result tmp;
+    if (!packCandidate(size.w - borders, size.h - borders,
+                       order, false, tmp, token)) {
+      std::fill(m_rects.begin(), m_rects.end(), gfx::Rect());
+      return false;
+    }
+    if (order == Order::Height || tmp.ok)
+      result = std::move(tmp);
+    if (result.ok)
+      break;
+  }
+  setResult(result);
+  return result.ok;
+}
+
+bool SkylinePacker::packCandidate(const int width,
+                                  const int height,
+                                  const Order order,
+                                  const bool transposed,
+                                  Result& result,
+                                  base::task_token& token) const
+{
+  const int n = int(m_sizes.size());
+  std::vector<gfx::Size> sizes(n);
+  for (int i=0; i<n; ++i) {
+    gfx::Size sz = m_sizes[i];
+    if (sz.w <= 0 || sz.h <= 0)
+      continue;
+    if (transposed)
+      std::swap(sz.w, sz.h);
+    sizes[i] = gfx::Size(sz.w + m_shapePadding,
+                         sz.h + m_shapePadding);
+  }
+
+  // Sort by height (or by the biggest side) from bigger to smaller
+  std::vector<int> indexes(n);
+  std::iota(indexes.begin(), indexes.end(), 0);
+  std::sort(indexes.begin(), indexes.end(),
+            [&sizes, order](const int a, const int b){
+              const gfx::Size& A = sizes[a];
+              const gfx::Size& B = sizes[b];
+              if (order == Order::MaxSide) {
+                const int maxA = std::max(A.w, A.h);
+                const int maxB = std::max(B.w, B.h);
+                if (maxA != maxB)
+                  return (maxA > maxB);
+              }
+              if (A.h != B.h) return (A.h > B.h);
+              if (A.w != B.w) return (A.w > B.w);
+              return (a < b);
+            });
+
+  Skyline skyline(width, height);
+  result.ok = true;
+  result.used = gfx::Size(0, 0);
+  result.points.assign(n, gfx::Point(0, 0));
+
+  for (int k=0; k<n; ++k) {
+    if ((k & 0xff) == 0 && token.canceled())
+      return false;
+
+    const int i = indexes[k];
+    const gfx::Size& sz = sizes[i];
+    if (sz.w <= 0 || sz.h <= 0)
+      continue;
+
+    gfx::Point& pt = result.points[i];
+    if (skyline.insert(sz, pt)) {
+      result.used.w = std::max(result.used.w, pt.x + sz.w);
+      result.used.h = std::max(result.used.h, pt.y + sz.h);
+    }
+    else {
+      pt = gfx::Point(-1, -1);
+      result.ok = false;
+    }
+  }
+
+  if (transposed) {
+    for (gfx::Point& pt : result.points)
+      std::swap(pt.x, pt.y);
+    std::swap(result.used.w, result.used.h);
+  }
+  return true;
+}
+
+void SkylinePacker::setResult(const Result& result)
+{
+  ASSERT(result.points.size() == m_sizes.size());
+  for (int i=0; i<int(m_sizes.size()); ++i) {
+    const gfx::Point& pt = result.points[i];
+    if (pt.x < 0)
+      m_rects[i] = gfx::Rect();
+    else
+      m_rects[i] = gfx::Rect(m_borderPadding + pt.x,
+                             m_borderPadding + pt.y,
+                             m_sizes[i].w, m_sizes[i].h);
+  }
+}
+
+} // namespace app
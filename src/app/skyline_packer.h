@@ -0,0 +1,81 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SKYLINE_PACKER_H_INCLUDED
+#define APP_SKYLINE_PACKER_H_INCLUDED
+#pragma once
+
+#include "base/task.h"
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <vector>
+
+namespace app {
+
+  // Packs rectangles in a texture using the skyline bottom-left
+  // algorithm. Rectangles are sorted by height/width (and by their
+  // index in case of ties), so the result is always the same for the
+  // same input. It has the same interface as gfx::PackingRects, but
+  // each pack operation is O(N*S) (where S is the number of segments
+  // of the skyline) instead of checking all free positions in a
+  // region, so it can be used with thousands of rectangles.
+  class SkylinePacker {
+  public:
+    typedef std::vector<gfx::Rect> Rects;
+    typedef Rects::const_iterator const_iterator;
+
+    SkylinePacker(const int borderPadding = 0,
+                  const int shapePadding = 0);
+
+    // Maximum number of threads used by bestFit() to test different
+    // candidate sizes (0 = number of hardware threads). The result
+    // doesn't depend on the number of threads.
+    void setThreads(const int nthreads) { m_nthreads = nthreads; }
+
+    std::size_t size() const { return m_rects.size(); }
+    bool empty() const { return m_rects.empty(); }
+    const_iterator begin() const { return m_rects.begin(); }
+    const_iterator end() const { return m_rects.end(); }
+    const gfx::Rect& operator[](const int i) const { return m_rects[i]; }
+
+    void add(const gfx::Size& sz);
+
+    // Finds the smallest texture (in area) to pack all rectangles
+    // and packs them in it. If fixedWidth or fixedHeight are
+    // specified, the texture will have that width/height.
+    gfx::Size bestFit(base::task_token& token,
+                      const int fixedWidth = 0,
+                      const int fixedHeight = 0);
+
+    // Packs all rectangles in a texture of the given size (including
+    // the border padding). Returns false if some rectangle doesn't
+    // fit, in that case those rectangles will be empty.
+    bool pack(const gfx::Size& size,
+              base::task_token& token);
+
+  private:
+    struct Result;
+    enum class Order { Height, MaxSide };
+
+    bool packCandidate(const int width,
+                       const int height,
+                       const Order order,
+                       const bool transposed,
+                       Result& result,
+                       base::task_token& token) const;
+    void setResult(const Result& result);
+
+    int m_borderPadding;
+    int m_shapePadding;
+    int m_nthreads = 0;
+    std::vector<gfx::Size> m_sizes;
+    Rects m_rects;
+  };
+
+} // namespace app
+
+#endif
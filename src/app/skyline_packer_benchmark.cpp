@@ -0,0 +1,96 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/skyline_packer.h"
+#include "gfx/packing_rects.h"
+
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+using namespace app;
+
+// Sizes similar to trimmed sprite sheet samples
+static std::vector<gfx::Size> random_sizes(const int n)
+{
+  std::mt19937 rng(n);
+  std::uniform_int_distribution<int> dist(4, 64);
+  std::vector<gfx::Size> sizes(n);
+  for (auto& sz : sizes)
+    sz = gfx::Size(dist(rng), dist(rng));
+  return sizes;
+}
+
+// Packing quality: percentage of the texture used by the rectangles
+template<typename Packer>
+static void set_counters(benchmark::State& state,
+                         const Packer& packer,
+                         const gfx::Size& size)
+{
+  double used = 0.0;
+  for (const gfx::Rect& rc : packer)
+    used += double(rc.w) * double(rc.h);
+
+  state.counters["width"] = size.w;
+  state.counters["height"] = size.h;
+  state.counters["fill"] = 100.0 * used / (double(size.w) * double(size.h));
+}
+
+template<typename Packer>
+static void BM_BestFit(benchmark::State& state)
+{
+  const std::vector<gfx::Size> sizes = random_sizes(state.range(0));
+  gfx::Size size;
+  for (auto _ : state) {
+    Packer packer(2, 1);
+    for (const auto& sz : sizes)
+      packer.add(sz);
+
+    base::task_token token;
+    size = packer.bestFit(token);
+    benchmark::DoNotOptimize(size);
+
+    state.PauseTiming();
+    set_counters(state, packer, size);
+    state.ResumeTiming();
+  }
+}
+
+static void BM_SkylinePackerOneThread(benchmark::State& state)
+{
+  const std::vector<gfx::Size> sizes = random_sizes(state.range(0));
+  for (auto _ : state) {
+    SkylinePacker packer(2, 1);
+    packer.setThreads(1);
+    for (const auto& sz : sizes)
+      packer.add(sz);
+
+    base::task_token token;
+    gfx::Size size = packer.bestFit(token);
+    benchmark::DoNotOptimize(size);
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_BestFit, gfx::PackingRects)
+  ->Arg(100)->Arg(250)->Arg(500)->Arg(1000)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_BestFit, SkylinePacker)
+  ->Arg(100)->Arg(250)->Arg(500)->Arg(1000)->Arg(5000)->Arg(20000)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_SkylinePackerOneThread)
+  ->Arg(100)->Arg(1000)->Arg(5000)->Arg(20000)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
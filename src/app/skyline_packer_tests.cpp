@@ -0,0 +1,93 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/skyline_packer.h"
+#include "gfx/rect_io.h"
+#include "gfx/size_io.h"
+
+#include <random>
+
+using namespace app;
+
+static void add_random_sizes(SkylinePacker& packer, const int n)
+{
+  std::mt19937 rng(n);
+  std::uniform_int_distribution<int> dist(1, 64);
+  for (int i=0; i<n; ++i)
+    packer.add(gfx::Size(dist(rng), dist(rng)));
+}
+
+static void expect_valid_pack(const SkylinePacker& packer,
+                              const gfx::Size& size,
+                              const int borderPadding,
+                              const int shapePadding)
+{
+  const gfx::Rect area(borderPadding, borderPadding,
+                       size.w - 2*borderPadding,
+                       size.h - 2*borderPadding);
+  for (int i=0; i<int(packer.size()); ++i) {
+    const gfx::Rect& a = packer[i];
+    ASSERT_FALSE(a.isEmpty());
+    EXPECT_TRUE(area.contains(a)) << "Rect " << i << " outside the texture";
+
+    for (int j=i+1; j<int(packer.size()); ++j) {
+      const gfx::Rect b = packer[j];
+      EXPECT_FALSE(gfx::Rect(a).enlargeXW(shapePadding).enlargeYH(shapePadding)
+                   .intersects(b)) << "Rects " << i << " and " << j;
+    }
+  }
+}
+
+TEST(SkylinePacker, BestFit)
+{
+  for (int border : { 0, 1, 3 }) {
+    for (int shape : { 0, 1, 2 }) {
+      SkylinePacker packer(border, shape);
+      add_random_sizes(packer, 300);
+
+      base::task_token token;
+      gfx::Size size = packer.bestFit(token);
+      EXPECT_EQ(300, int(packer.size()));
+      expect_valid_pack(packer, size, border, shape);
+    }
+  }
+}
+
+TEST(SkylinePacker, FixedSize)
+{
+  SkylinePacker packer(1, 1);
+  for (int i=0; i<10; ++i)
+    packer.add(gfx::Size(10, 10));
+
+  base::task_token token;
+  EXPECT_EQ(gfx::Size(40, 45), packer.bestFit(token, 40, 0));
+  expect_valid_pack(packer, gfx::Size(40, 45), 1, 1);
+
+  EXPECT_EQ(gfx::Size(45, 40), packer.bestFit(token, 0, 40));
+  expect_valid_pack(packer, gfx::Size(45, 40), 1, 1);
+
+  EXPECT_TRUE(packer.pack(gfx::Size(56, 34), token));
+  expect_valid_pack(packer, gfx::Size(56, 34), 1, 1);
+
+  EXPECT_FALSE(packer.pack(gfx::Size(20, 20), token));
+}
+
+TEST(SkylinePacker, SameResultWithDifferentThreads)
+{
+  SkylinePacker packer1(2, 1);
+  SkylinePacker packerN(2, 1);
+  packer1.setThreads(1);
+  packerN.setThreads(8);
+  add_random_sizes(packer1, 2000);
+  add_random_sizes(packerN, 2000);
+
+  base::task_token token;
+  EXPECT_EQ(packer1.bestFit(token), packerN.bestFit(token));
+  for (int i=0; i<int(packer1.size()); ++i)
+    EXPECT_EQ(packer1[i], packerN[i]);
+}
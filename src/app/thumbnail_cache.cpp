@@ -0,0 +1,302 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/serialization.h"
+#include "base/string.h"
+#include "base/time.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/palette.h"
+#include "doc/palette_io.h"
+#include "doc/string_io.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#define THUMBCACHE_TRACE(...)
+
+namespace app {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+namespace {
+
+const uint32_t kMagicNumber = 0x4d485441; // "ATHM"
+const uint16_t kFileVersion = 2;
+
+// Default maximum size of the whole cache in bytes
+const std::size_t kDefaultMaxSize = 64*1024*1024;
+
+// The cache directory is checked each time this number of
+// thumbnails is saved
+const int kShrinkEachNSaves = 32;
+
+// Number of bytes from the beginning and the end of the original file
+// used to calculate its hash.
+const std::size_t kHashedBytes = 64*1024;
+
+const char* kCacheExtension = "thumb";
+
+// FNV-1a hash of the first and last kHashedBytes of the file, to
+// detect files rewritten with the same size in the same second
+// (without reading the whole file).
+uint64_t calculate_file_hash(const std::string& filename,
+                             const uint64_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  std::ifstream f(FSTREAM_PATH(filename), std::ifstream::binary);
+  if (!f)
+    return 0;
+
+  std::vector<char> buf(kHashedBytes);
+  auto hashBytes = [&hash, &buf](const std::size_t n){
+    for (std::size_t i=0; i<n; ++i) {
+      hash ^= uint8_t(buf[i]);
+      hash *= 0x100000001b3ull;
+    }
+  };
+
+  f.read(&buf[0], buf.size());
+  hashBytes(std::size_t(f.gcount()));
+
+  if (size > 2*kHashedBytes) {
+    f.clear();
+    f.seekg(std::streamoff(size - kHashedBytes));
+    f.read(&buf[0], buf.size());
+    hashBytes(std::size_t(f.gcount()));
+  }
+  else if (size > kHashedBytes) {
+    f.read(&buf[0], buf.size());
+    hashBytes(std::size_t(f.gcount()));
+  }
+  return hash;
+}
+
+// Information of the original file that must match the cached one
+// to consider the thumbnail valid.
+struct FileKey {
+  std::string path;
+  base::Time mtime;
+  uint64_t size = 0;
+  uint64_t hash = 0;
+
+  bool fromFile(const std::string& filename) {
+    if (!base::is_file(filename))
+      return false;
+    path = base::normalize_path(filename);
+    mtime = base::get_modification_time(filename);
+    size = base::file_size(filename);
+    hash = calculate_file_hash(filename, size);
+    return true;
+  }
+
+  void write(std::ostream& os) const {
+    doc::write_string(os, path);
+    write16(os, mtime.year);
+    write8(os, mtime.month);
+    write8(os, mtime.day);
+    write8(os, mtime.hour);
+    write8(os, mtime.minute);
+    write8(os, mtime.second);
+    write32(os, uint32_t(size & 0xffffffff));
+    write32(os, uint32_t(size >> 32));
+    write32(os, uint32_t(hash & 0xffffffff));
+    write32(os, uint32_t(hash >> 32));
+  }
+
+  void read(std::istream& is) {
+    path = doc::read_string(is);
+    mtime.year = read16(is);
+    mtime.month = read8(is);
+    mtime.day = read8(is);
+    mtime.hour = read8(is);
+    mtime.minute = read8(is);
+    mtime.second = read8(is);
+    size = read32(is);
+    size |= (uint64_t(read32(is)) << 32);
+    hash = read32(is);
+    hash |= (uint64_t(read32(is)) << 32);
+  }
+
+  bool operator==(const FileKey& o) const {
+    return (path == o.path &&
+            mtime.year == o.mtime.year &&
+            mtime.month == o.mtime.month &&
+            mtime.day == o.mtime.day &&
+            mtime.hour == o.mtime.hour &&
+            mtime.minute == o.mtime.minute &&
+            mtime.second == o.mtime.second &&
+            size == o.size &&
+            hash == o.hash);
+  }
+};
+
+} // anonymous namespace
+
+ThumbnailCache::ThumbnailCache(const std::string& dir)
+  : m_dir(dir)
+  , m_maxSize(kDefaultMaxSize)
+  , m_saves(0)
+{
+  if (m_dir.empty()) {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+    m_dir = base::get_file_path(rf.getFirstOrCreateDefault());
+  }
+}
+
+bool ThumbnailCache::load(const std::string& filename,
+                          std::unique_ptr<doc::Image>& image,
+                          std::unique_ptr<doc::Palette>& palette) const
+{
+  FileKey key;
+  if (m_dir.empty() || !key.fromFile(filename))
+    return false;
+
+  const std::string fn = cacheFilename(key.path);
+  if (!base::is_file(fn))
+    return false;
+
+  try {
+    std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+    if (read32(s) != kMagicNumber ||
+        read16(s) != kFileVersion)
+      return false;
+
+    FileKey cachedKey;
+    cachedKey.read(s);
+    if (!s || !(cachedKey == key)) {
+      THUMBCACHE_TRACE("THUMBCACHE: Outdated thumbnail %s\n", filename.c_str());
+      return false;
+    }
+
+    palette.reset(doc::read_palette(s));
+    image.reset(doc::read_image(s, false));
+    if (!s || !palette || !image) {
+      palette.reset();
+      image.reset();
+      return false;
+    }
+  }
+  catch (const std::exception&) {
+    palette.reset();
+    image.reset();
+    return false;
+  }
+
+  THUMBCACHE_TRACE("THUMBCACHE: Thumbnail loaded from cache %s\n", filename.c_str());
+  return true;
+}
+
+void ThumbnailCache::save(const std::string& filename,
+                          const doc::Image* image,
+                          const doc::Palette* palette) const
+{
+  ASSERT(image);
+  ASSERT(palette);
+
+  FileKey key;
+  if (m_dir.empty() || !key.fromFile(filename))
+    return;
+
+  const std::string fn = cacheFilename(key.path);
+  try {
+    if (!base::is_directory(m_dir))
+      base::make_all_directories(m_dir);
+
+    std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
+    write32(s, kMagicNumber);
+    write16(s, kFileVersion);
+    key.write(s);
+    doc::write_palette(s, palette);
+    doc::write_image(s, image);
+  }
+  catch (const std::exception&) {
+    // Ignore errors, we'll just generate the thumbnail again the next
+    // time.
+    return;
+  }
+
+  // Don't list the whole directory for each new thumbnail
+  if ((m_saves++ % kShrinkEachNSaves) == 0)
+    shrinkToFit(fn);
+}
+
+void ThumbnailCache::shrinkToFit(const std::string& keepFilename) const
+{
+  std::lock_guard lock(m_shrinkMutex);
+  if (m_dir.empty() || !base::is_directory(m_dir))
+    return;
+
+  struct Entry {
+    std::string fn;
+    base::Time mtime;
+    std::size_t size;
+  };
+  std::vector<Entry> entries;
+  std::size_t total = 0;
+
+  try {
+    for (const auto& item : base::list_files(m_dir)) {
+      if (base::string_to_lower(base::get_file_extension(item)) != kCacheExtension)
+        continue;
+
+      Entry entry;
+      entry.fn = base::join_path(m_dir, item);
+      if (!base::is_file(entry.fn))
+        continue;
+      entry.mtime = base::get_modification_time(entry.fn);
+      entry.size = base::file_size(entry.fn);
+      total += entry.size;
+      entries.push_back(entry);
+    }
+    if (total <= m_maxSize)
+      return;
+
+    // Delete the oldest thumbnails first
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b){
+                return a.mtime < b.mtime;
+              });
+    for (const Entry& entry : entries) {
+      if (total <= m_maxSize)
+        break;
+      if (entry.fn == keepFilename)
+        continue;
+
+      THUMBCACHE_TRACE("THUMBCACHE: Deleting old thumbnail %s\n", entry.fn.c_str());
+      base::delete_file(entry.fn);
+      total -= entry.size;
+    }
+  }
+  catch (const std::exception&) {
+    // Ignore errors deleting thumbnails (e.g. a file that was
+    // deleted by other process), we'll try again later.
+  }
+}
+
+std::string ThumbnailCache::cacheFilename(const std::string& filename) const
+{
+  // Only one entry per original file, a new thumbnail of the same
+  // file (e.g. because it was modified) replaces the old one.
+  const size_t hash = std::hash<std::string>()(filename);
+  return base::join_path(m_dir, fmt::format("{:016x}.{}", hash, kCacheExtension));
+}
+
+} // namespace app
@@ -0,0 +1,72 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace app {
+
+  // Persistent cache of file selector thumbnails stored in the user
+  // directory. Each entry is keyed by the path of the original file,
+  // and it's valid only while the modification time, size, and a
+  // hash of the first/last bytes of that file don't change (the
+  // modification time has a resolution of one second). The cache
+  // is limited to maxSize() bytes, the oldest thumbnails are deleted
+  // when it grows over that limit.
+  //
+  // load()/save() can be called from background threads (the
+  // ThumbnailGenerator workers), but two threads shouldn't save the
+  // thumbnail of the same file at the same time.
+  class ThumbnailCache {
+  public:
+    // Creates the cache in the given directory (or in the default
+    // user directory if "dir" is empty).
+    explicit ThumbnailCache(const std::string& dir = std::string());
+
+    const std::string& dir() const { return m_dir; }
+
+    std::size_t maxSize() const { return m_maxSize; }
+    void setMaxSize(const std::size_t maxSize) { m_maxSize = maxSize; }
+
+    // Returns true if there is an up-to-date thumbnail for the given
+    // file, and returns its image and palette.
+    bool load(const std::string& filename,
+              std::unique_ptr<doc::Image>& image,
+              std::unique_ptr<doc::Palette>& palette) const;
+
+    // Saves the thumbnail image/palette of the given file.
+    void save(const std::string& filename,
+              const doc::Image* image,
+              const doc::Palette* palette) const;
+
+    // Deletes the oldest thumbnails until the cache uses less than
+    // maxSize() bytes (except "keepFilename").
+    void shrinkToFit(const std::string& keepFilename = std::string()) const;
+
+  private:
+    std::string cacheFilename(const std::string& filename) const;
+
+    std::string m_dir;
+    std::size_t m_maxSize;
+    mutable std::atomic<int> m_saves;
+    mutable std::mutex m_shrinkMutex;
+  };
+
+} // namespace app
+
+#endif
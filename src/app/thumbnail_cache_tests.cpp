@@ -0,0 +1,113 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+
+#include <fstream>
+
+using namespace app;
+
+static const char* kCacheDir = "_thumbcache_test";
+
+static void write_file(const std::string& fn, const char c, const int size)
+{
+  std::ofstream f(FSTREAM_PATH(fn), std::ofstream::binary);
+  f << std::string(size, c);
+}
+
+static void delete_cache_dir()
+{
+  if (base::is_directory(kCacheDir)) {
+    for (const auto& item : base::list_files(kCacheDir))
+      base::delete_file(base::join_path(kCacheDir, item));
+    base::remove_directory(kCacheDir);
+  }
+}
+
+static std::size_t cache_size()
+{
+  std::size_t total = 0;
+  for (const auto& item : base::list_files(kCacheDir))
+    total += base::file_size(base::join_path(kCacheDir, item));
+  return total;
+}
+
+TEST(ThumbnailCache, SaveAndLoad)
+{
+  delete_cache_dir();
+  write_file("_thumbcache_a.txt", 'a', 1000);
+
+  ThumbnailCache cache(kCacheDir);
+  std::unique_ptr<doc::Image> image(doc::Image::create(doc::IMAGE_RGB, 4, 4));
+  doc::clear_image(image.get(), doc::rgba(255, 0, 0, 255));
+  doc::Palette palette(0, 16);
+  cache.save("_thumbcache_a.txt", image.get(), &palette);
+
+  std::unique_ptr<doc::Image> image2;
+  std::unique_ptr<doc::Palette> palette2;
+  ASSERT_TRUE(cache.load("_thumbcache_a.txt", image2, palette2));
+  EXPECT_EQ(4, image2->width());
+  EXPECT_EQ(4, image2->height());
+  EXPECT_EQ(doc::rgba(255, 0, 0, 255), doc::get_pixel(image2.get(), 3, 3));
+  EXPECT_EQ(16, palette2->size());
+
+  // Rewritten with the same size (probably in the same second, so
+  // the modification time is the same too)
+  write_file("_thumbcache_a.txt", 'b', 1000);
+  EXPECT_FALSE(cache.load("_thumbcache_a.txt", image2, palette2));
+
+  // Files without thumbnail
+  write_file("_thumbcache_b.txt", 'b', 1000);
+  EXPECT_FALSE(cache.load("_thumbcache_b.txt", image2, palette2));
+  EXPECT_FALSE(cache.load("_thumbcache_nonexistent.txt", image2, palette2));
+
+  base::delete_file("_thumbcache_a.txt");
+  base::delete_file("_thumbcache_b.txt");
+  delete_cache_dir();
+}
+
+TEST(ThumbnailCache, MaxSize)
+{
+  delete_cache_dir();
+
+  ThumbnailCache cache(kCacheDir);
+  std::unique_ptr<doc::Image> image(doc::Image::create(doc::IMAGE_RGB, 32, 32));
+  doc::Palette palette(0, 256);
+
+  // Size of one thumbnail
+  write_file("_thumbcache_0.txt", 'a', 10);
+  cache.save("_thumbcache_0.txt", image.get(), &palette);
+  const std::size_t thumbSize = cache_size();
+  ASSERT_LT(0, thumbSize);
+
+  cache.setMaxSize(3*thumbSize);
+  for (int i=1; i<10; ++i) {
+    const std::string fn = fmt::format("_thumbcache_{}.txt", i);
+    write_file(fn, 'a', 10);
+    cache.save(fn, image.get(), &palette);
+    cache.shrinkToFit();
+    EXPECT_GE(3*thumbSize, cache_size());
+  }
+
+  // The thumbnail that was just saved is kept
+  cache.setMaxSize(1);
+  cache.shrinkToFit(base::join_path(kCacheDir, base::list_files(kCacheDir).front()));
+  EXPECT_EQ(1, base::list_files(kCacheDir).size());
+
+  for (int i=0; i<10; ++i) {
+    const std::string fn = fmt::format("_thumbcache_{}.txt", i);
+    base::delete_file(fn);
+  }
+  delete_cache_dir();
+}
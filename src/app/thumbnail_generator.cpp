@@ -16,6 +16,7 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/thumbnail_cache.h"
 #include "app/util/conversion_to_surface.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
@@ -40,8 +41,10 @@ namespace app {
 
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
+  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue,
+         const ThumbnailCache& cache)
     : m_queue(queue)
+    , m_cache(cache)
     , m_fop(nullptr)
     , m_isDone(false)
     , m_thread([this]{ loadBgThread(); }) {
@@ -85,75 +88,22 @@ private:
         ASSERT(m_fop);
       }
 
-      THUMB_TRACE("FOP loading thumbnail: %s\n",
-                  m_item.fileitem->fileName().c_str());
-
-      // Load the file
-      m_fop->operate(nullptr);
-
-      // Don't call post-load because postLoad() needs user interaction.
-      //m_fop->postLoad();
-
-      // Convert the loaded document into the os::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
+      const std::string filename = m_item.fileitem->fileName();
       std::unique_ptr<Image> thumbnailImage;
       std::unique_ptr<Palette> palette;
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Special case for indexed images:
-        // If the sprite is transparent -> set the transparent color index alpha = 0
-        if (sprite->colorMode() == ColorMode::INDEXED &&
-            !sprite->backgroundLayer()) {
-          int i = sprite->transparentColor();
-          if (i >= 0 && i < int(palette->size()))
-            palette->setEntry(i, doc::rgba(0, 0, 0, 0));
-        }
 
-        const int w = sprite->width()*sprite->pixelRatio().w;
-        const int h = sprite->height()*sprite->pixelRatio().h;
-
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
-        int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
-        if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
-          thumb_w = w;
-          thumb_h = h;
-        }
-        thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
-        thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        thumbnailImage.reset(
-          Image::create(
-            sprite->pixelFormat(), thumb_w, thumb_h));
-
-        render::Projection proj(sprite->pixelRatio(),
-                                render::Zoom(thumb_w, w));
-        render::Render render;
-        render.setBgOptions(render::BgOptions::MakeTransparent());
-        render.setProjection(proj);
-        render.renderSprite(
-          thumbnailImage.get(), sprite, frame_t(0),
-          gfx::Clip(0, 0, 0, 0, w, h));
-
-        // Convert the image to sRGB color space
-        auto cs = sprite->colorSpace();
-        if (m_fop->preserveColorProfile() &&
-            cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
-          app::cmd::convert_color_profile(
-            thumbnailImage.get(), palette.get(),
-            cs, gfx::ColorSpace::MakeSRGB());
-        }
+      // Try to use the thumbnail from the disk cache (when the file
+      // wasn't modified since the thumbnail was generated).
+      if (m_cache.load(filename, thumbnailImage, palette)) {
+        THUMB_TRACE("FOP thumbnail from cache: %s\n", filename.c_str());
       }
+      else {
+        THUMB_TRACE("FOP loading thumbnail: %s\n", filename.c_str());
+        loadThumbnail(thumbnailImage, palette);
 
-      // Close file
-      delete m_fop->releaseDocument();
+        if (thumbnailImage && !m_fop->isStop() && !m_fop->hasError())
+          m_cache.save(filename, thumbnailImage.get(), palette.get());
+      }
 
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
@@ -205,6 +155,75 @@ private:
     ASSERT(!m_fop);
   }
 
+  // Loads the file (only the first frame) and renders its thumbnail.
+  void loadThumbnail(std::unique_ptr<Image>& thumbnailImage,
+                     std::unique_ptr<Palette>& palette) {
+    // Load the file
+    m_fop->operate(nullptr);
+
+    // Don't call post-load because postLoad() needs user interaction.
+    //m_fop->postLoad();
+
+    // Convert the loaded document into the os::Surface.
+    const Sprite* sprite =
+      (m_fop->document() &&
+       m_fop->document()->sprite() ?
+       m_fop->document()->sprite(): nullptr);
+
+    if (!m_fop->isStop() && sprite) {
+      // The palette to convert the Image
+      palette.reset(new Palette(*sprite->palette(frame_t(0))));
+
+      // Special case for indexed images:
+      // If the sprite is transparent -> set the transparent color index alpha = 0
+      if (sprite->colorMode() == ColorMode::INDEXED &&
+          !sprite->backgroundLayer()) {
+        int i = sprite->transparentColor();
+        if (i >= 0 && i < int(palette->size()))
+          palette->setEntry(i, doc::rgba(0, 0, 0, 0));
+      }
+
+      const int w = sprite->width()*sprite->pixelRatio().w;
+      const int h = sprite->height()*sprite->pixelRatio().h;
+
+      // Calculate the thumbnail size
+      int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
+      int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
+      if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
+        thumb_w = w;
+        thumb_h = h;
+      }
+      thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
+      thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
+
+      // Stretch the 'image'
+      thumbnailImage.reset(
+        Image::create(
+          sprite->pixelFormat(), thumb_w, thumb_h));
+
+      render::Projection proj(sprite->pixelRatio(),
+                              render::Zoom(thumb_w, w));
+      render::Render render;
+      render.setBgOptions(render::BgOptions::MakeTransparent());
+      render.setProjection(proj);
+      render.renderSprite(
+        thumbnailImage.get(), sprite, frame_t(0),
+        gfx::Clip(0, 0, 0, 0, w, h));
+
+      // Convert the image to sRGB color space
+      auto cs = sprite->colorSpace();
+      if (m_fop->preserveColorProfile() &&
+          cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
+        app::cmd::convert_color_profile(
+          thumbnailImage.get(), palette.get(),
+          cs, gfx::ColorSpace::MakeSRGB());
+      }
+    }
+
+    // Close file
+    delete m_fop->releaseDocument();
+  }
+
   void loadBgThread() {
     base::this_thread::set_name("thumbnails");
 
@@ -224,6 +243,7 @@ private:
   }
 
   base::concurrent_queue<Item>& m_queue;
+  const ThumbnailCache& m_cache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
@@ -348,7 +368,7 @@ void ThumbnailGenerator::startWorker()
 {
   std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(m_remainingItems, m_cache));
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
+#include "app/thumbnail_cache.h"
 #include "base/concurrent_queue.h"
 
 #include <memory>
@@ -61,6 +62,7 @@ namespace app {
     };
 
     int m_maxWorkers;
+    ThumbnailCache m_cache;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
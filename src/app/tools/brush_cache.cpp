@@ -0,0 +1,151 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/brush_cache.h"
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/image.h"
+
+#include <iterator>
+
+namespace app {
+namespace tools {
+
+using namespace doc;
+
+BrushVariant::BrushVariant(const BrushRef& brush)
+  : BrushVariant(brush.get())
+{
+  m_brushRef = brush;
+}
+
+BrushVariant::BrushVariant(Brush* brush)
+  : m_brush(brush)
+  , m_memSize(sizeof(BrushVariant) + sizeof(Brush))
+{
+  if (m_brush->image())
+    m_memSize += m_brush->image()->getMemSize();
+  if (m_brush->maskBitmap())
+    m_memSize += m_brush->maskBitmap()->getMemSize();
+}
+
+const CompressedImage& BrushVariant::compressedImage(gen::SymmetryMode symmetryMode)
+{
+  std::lock_guard lock(m_mutex);
+
+  const int i = int(symmetryMode);
+  auto& compressPtr = m_compressedImages[i];
+  if (compressPtr)
+    return *compressPtr;
+
+  switch (symmetryMode) {
+    case gen::SymmetryMode::NONE:
+      m_images[i].reset();
+      compressPtr.reset(new CompressedImage(m_brush->image(),
+                                            m_brush->maskBitmap(),
+                                            false));
+      break;
+    case gen::SymmetryMode::HORIZONTAL:
+    case gen::SymmetryMode::VERTICAL: {
+      m_images[i].reset(Image::createCopy(m_brush->image()));
+      algorithm::FlipType flip =
+        (symmetryMode == gen::SymmetryMode::HORIZONTAL)?
+          algorithm::FlipType::FlipHorizontal:
+          algorithm::FlipType::FlipVertical;
+      algorithm::flip_image(m_images[i].get(), m_images[i]->bounds(), flip);
+      compressPtr.reset(new CompressedImage(m_images[i].get(),
+                                            m_brush->maskBitmap(),
+                                            false));
+      break;
+    }
+    case gen::SymmetryMode::BOTH: {
+      m_images[i].reset(Image::createCopy(m_brush->image()));
+      algorithm::flip_image(m_images[i].get(),
+                            m_images[i]->bounds(),
+                            algorithm::FlipType::FlipVertical);
+      algorithm::flip_image(m_images[i].get(),
+                            m_images[i]->bounds(),
+                            algorithm::FlipType::FlipHorizontal);
+      compressPtr.reset(new CompressedImage(m_images[i].get(),
+                                            m_brush->maskBitmap(),
+                                            false));
+      break;
+    }
+  }
+
+  if (m_images[i])
+    m_memSize += m_images[i]->getMemSize();
+  m_memSize += sizeof(CompressedImage)
+    + sizeof(CompressedImage::Scanline)*std::distance(compressPtr->begin(),
+                                                      compressPtr->end());
+  return *compressPtr;
+}
+
+std::size_t BrushVariant::memSize() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_memSize;
+}
+
+// static
+BrushCache* BrushCache::instance()
+{
+  static BrushCache singleton;
+  return &singleton;
+}
+
+BrushVariantRef BrushCache::getBrush(BrushType type, int size, int angle)
+{
+  std::lock_guard lock(m_mutex);
+
+  const Key key = { type, size, angle };
+  auto it = m_map.find(key);
+  if (it != m_map.end()) {
+    // Move the entry to the front (most recently used)
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->variant;
+  }
+
+  auto variant = std::make_shared<BrushVariant>(
+    std::make_shared<Brush>(type, size, angle));
+  m_entries.push_front(Entry{ key, variant });
+  m_map[key] = m_entries.begin();
+
+  shrinkToFit();
+  return variant;
+}
+
+void BrushCache::clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_map.clear();
+}
+
+void BrushCache::shrinkToFit()
+{
+  // Variants grow when new scanlines are generated, so we have to
+  // recalculate the total memory each time.
+  std::size_t memSize = 0;
+  for (const auto& entry : m_entries)
+    memSize += entry.variant->memSize();
+
+  // Remove least recently used brushes (we always keep the first
+  // one, the brush that was just requested)
+  while (memSize > kMaxMemSize && m_entries.size() > 1) {
+    const Entry& entry = m_entries.back();
+    memSize -= entry.variant->memSize();
+    m_map.erase(entry.key);
+    m_entries.pop_back();
+  }
+}
+
+} // namespace tools
+} // namespace app
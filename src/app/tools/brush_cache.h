@@ -0,0 +1,105 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TOOLS_BRUSH_CACHE_H_INCLUDED
+#define APP_TOOLS_BRUSH_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/pref/preferences.h"
+#include "doc/brush.h"
+#include "doc/brush_type.h"
+#include "doc/compressed_image.h"
+#include "doc/image_ref.h"
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace app {
+namespace tools {
+
+// A brush with its scanlines (CompressedImage) for each symmetry
+// mode. The scanlines are generated lazily the first time they are
+// requested (a variant can be shared between strokes, so this is
+// guarded by a mutex).
+class BrushVariant {
+public:
+  // Creates scanlines for a brush owned by someone else (e.g. the
+  // ToolLoop brush).
+  explicit BrushVariant(doc::Brush* brush);
+  explicit BrushVariant(const doc::BrushRef& brush);
+
+  doc::Brush* brush() const { return m_brush; }
+  const doc::BrushRef& brushRef() const { return m_brushRef; }
+
+  const doc::CompressedImage& compressedImage(gen::SymmetryMode symmetryMode);
+
+  // Approximated number of bytes used by this variant (it grows as
+  // new scanlines are generated for other symmetry modes).
+  std::size_t memSize() const;
+
+private:
+  doc::Brush* m_brush;
+  doc::BrushRef m_brushRef;
+  // Flipped copies of the brush image (the CompressedImage keeps a
+  // pointer to its source image, so we keep them alive here).
+  std::array<doc::ImageRef, 4> m_images;
+  std::array<std::unique_ptr<doc::CompressedImage>, 4> m_compressedImages;
+  std::size_t m_memSize;
+  mutable std::mutex m_mutex;
+};
+
+typedef std::shared_ptr<BrushVariant> BrushVariantRef;
+
+// Cache of brushes generated by dynamics (size/angle changes) shared
+// between strokes, so we don't have to regenerate the same brush
+// image and its scanlines for each point of a fast stroke.
+class BrushCache {
+public:
+  // Maximum number of bytes used by all cached brushes.
+  static const std::size_t kMaxMemSize = 16*1024*1024;
+
+  static BrushCache* instance();
+
+  // Returns a brush of the given type/size/angle, creating it if it
+  // doesn't exist in the cache. The returned brush must not be
+  // modified (it's shared with other strokes).
+  BrushVariantRef getBrush(doc::BrushType type, int size, int angle);
+
+  void clear();
+
+private:
+  struct Key {
+    doc::BrushType type;
+    int size;
+    int angle;
+    bool operator<(const Key& o) const {
+      if (type != o.type) return type < o.type;
+      if (size != o.size) return size < o.size;
+      return angle < o.angle;
+    }
+  };
+  struct Entry {
+    Key key;
+    BrushVariantRef variant;
+  };
+  typedef std::list<Entry> Entries; // Most recently used first
+
+  BrushCache() { }
+  void shrinkToFit();
+
+  std::mutex m_mutex;
+  Entries m_entries;
+  std::map<Key, Entries::iterator> m_map;
+};
+
+} // namespace tools
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -7,11 +7,10 @@
 
 #include "app/util/wrap_point.h"
 
+#include "app/tools/brush_cache.h"
 #include "app/tools/ink.h"
-#include "doc/algorithm/flip_image.h"
 #include "render/gradient.h"
 
-#include <array>
 #include <memory>
 
 namespace app {
@@ -63,9 +62,8 @@ public:
 
 class BrushPointShape : public PointShape {
   bool m_firstPoint;
-  Brush* m_lastBrush;
+  BrushVariantRef m_lastBrush;
   BrushType m_origBrushType;
-  std::array<std::shared_ptr<CompressedImage>, 4> m_compressedImages;
   // For dynamics
   DynamicsOptions m_dynamics;
   bool m_useDynamics;
@@ -78,7 +76,7 @@ public:
 
   void preparePointShape(ToolLoop* loop) override {
     m_firstPoint = true;
-    m_lastBrush = nullptr;
+    m_lastBrush.reset();
     m_origBrushType = loop->getBrush()->type();
 
     m_dynamics = loop->getDynamics();
@@ -177,15 +175,17 @@ public:
       if ((brush->size() != size) ||
           (brush->angle() != angle && m_origBrushType != kCircleBrushType) ||
           (m_hasDynamicGradient && pt.gradient != m_lastGradientValue)) {
-        // TODO cache brushes
-        BrushRef newBrush = std::make_shared<Brush>(
-          m_origBrushType, size, angle);
+        BrushRef newBrush;
 
         // Dynamic gradient with dithering
         bool prepareInk = false;
         if (m_hasDynamicGradient && !ink->isEraser() &&
             (m_dynamics.ditheringMatrix.rows() > 1 ||
              m_dynamics.ditheringMatrix.cols() > 1)) {
+          // Dithering brushes depend on the gradient value, so they
+          // cannot be shared with other points/strokes.
+          newBrush = std::make_shared<Brush>(
+            m_origBrushType, size, angle);
           convert_bitmap_brush_to_dithering_brush(
             newBrush.get(),
             loop->sprite()->pixelFormat(),
@@ -193,8 +193,14 @@ public:
             pt.gradient,
             m_secondaryColor,
             m_primaryColor);
+          m_lastBrush = std::make_shared<BrushVariant>(newBrush);
           prepareInk = true;
         }
+        else {
+          m_lastBrush = BrushCache::instance()->getBrush(
+            m_origBrushType, size, angle);
+          newBrush = m_lastBrush->brushRef();
+        }
         m_lastGradientValue = pt.gradient;
 
         loop->setBrush(newBrush);
@@ -207,11 +213,8 @@ public:
       }
     }
 
-    // TODO cache compressed images (or remove them completelly)
-    if (m_lastBrush != brush) {
-      m_lastBrush = brush;
-      m_compressedImages.fill(nullptr);
-    }
+    if (!m_lastBrush || m_lastBrush->brush() != brush)
+      m_lastBrush = std::make_shared<BrushVariant>(brush);
 
     x += brush->bounds().x;
     y += brush->bounds().y;
@@ -230,20 +233,28 @@ public:
       }
     }
 
+    // The pattern origin is used only by image brushes. Other brushes
+    // can come from the BrushCache (shared with other strokes), so
+    // they must not be modified.
+    const bool hasPattern = (brush->type() == kImageBrushType);
     if (int(loop->getTiledMode()) & int(TiledMode::X_AXIS)) {
-      int wrappedPatternOriginX = wrap_value(brush->patternOrigin().x, loop->sprite()->width()) % brush->bounds().w;
-      brush->setPatternOrigin(gfx::Point(wrappedPatternOriginX, brush->patternOrigin().y));
+      if (hasPattern) {
+        int wrappedPatternOriginX = wrap_value(brush->patternOrigin().x, loop->sprite()->width()) % brush->bounds().w;
+        brush->setPatternOrigin(gfx::Point(wrappedPatternOriginX, brush->patternOrigin().y));
+      }
       x = wrap_value(x, loop->sprite()->width());
     }
     if (int(loop->getTiledMode()) & int(TiledMode::Y_AXIS)) {
-      int wrappedPatternOriginY = wrap_value(brush->patternOrigin().y, loop->sprite()->height()) % brush->bounds().h;
-      brush->setPatternOrigin(gfx::Point(brush->patternOrigin().x, wrappedPatternOriginY));
+      if (hasPattern) {
+        int wrappedPatternOriginY = wrap_value(brush->patternOrigin().y, loop->sprite()->height()) % brush->bounds().h;
+        brush->setPatternOrigin(gfx::Point(brush->patternOrigin().x, wrappedPatternOriginY));
+      }
       y = wrap_value(y, loop->sprite()->height());
     }
 
     ink->prepareForPointShape(loop, m_firstPoint, x, y);
 
-    for (auto scanline : getCompressedImage(pt.symmetry)) {
+    for (auto scanline : m_lastBrush->compressedImage(pt.symmetry)) {
       int u = x+scanline.x;
       ink->prepareVForPointShape(loop, y+scanline.y);
       doInkHline(u, y+scanline.y, u+scanline.w-1, loop);
@@ -256,48 +267,6 @@ public:
     area.x += x;
     area.y += y;
   }
-
-private:
-  CompressedImage& getCompressedImage(gen::SymmetryMode symmetryMode) {
-    auto& compressPtr = m_compressedImages[int(symmetryMode)];
-    if (!compressPtr) {
-      switch (symmetryMode) {
-        case gen::SymmetryMode::NONE: {
-          compressPtr.reset(new CompressedImage(m_lastBrush->image(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-        case gen::SymmetryMode::HORIZONTAL:
-        case gen::SymmetryMode::VERTICAL: {
-          std::unique_ptr<Image> tempImage(Image::createCopy(m_lastBrush->image()));
-          doc::algorithm::FlipType flip =
-            (symmetryMode == gen::SymmetryMode::HORIZONTAL)?
-              doc::algorithm::FlipType::FlipHorizontal:
-              doc::algorithm::FlipType::FlipVertical;
-          doc::algorithm::flip_image(tempImage.get(), tempImage->bounds(), flip);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-        case gen::SymmetryMode::BOTH: {
-          std::unique_ptr<Image> tempImage(Image::createCopy(m_lastBrush->image()));
-          doc::algorithm::flip_image(tempImage.get(),
-                                     tempImage->bounds(),
-                                     doc::algorithm::FlipType::FlipVertical);
-          doc::algorithm::flip_image(tempImage.get(),
-                                     tempImage->bounds(),
-                                     doc::algorithm::FlipType::FlipHorizontal);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-      }
-    }
-    return *compressPtr;
-  }
 };
 
 class FloodFillPointShape : public PointShape {
@@ -44,6 +44,7 @@ using namespace filters;
 ToolLoopManager::ToolLoopManager(ToolLoop* toolLoop)
   : m_toolLoop(toolLoop)
   , m_canceled(false)
+  , m_delayDirtyAreaUpdates(false)
   , m_brush0(*toolLoop->getBrush())
   , m_dynamics(toolLoop->getDynamics())
 {
@@ -65,6 +66,9 @@ void ToolLoopManager::cancel()
 
 void ToolLoopManager::end()
 {
+  if (!m_canceled)
+    flushDirtyArea();
+
   if (m_canceled)
     m_toolLoop->rollback();
   else
@@ -167,6 +171,97 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 }
 
 void ToolLoopManager::movement(Pointer pointer)
+{
+  stabilizePointer(pointer);
+
+  m_lastPointer = pointer;
+
+  if (isCanceled())
+    return;
+
+  Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
+  m_toolLoop->getController()->movement(m_toolLoop, m_stroke, spritePoint);
+
+  std::string statusText;
+  m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
+  m_toolLoop->updateStatusBar(statusText.c_str());
+
+  doLoopStep(false);
+}
+
+void ToolLoopManager::movement(const std::vector<Pointer>& pointers)
+{
+  if (pointers.size() == 1 || !canCoalesceSteps()) {
+    for (const Pointer& pointer : pointers) {
+      movement(pointer);
+      if (isCanceled())
+        break;
+    }
+    return;
+  }
+
+  if (isCanceled())
+    return;
+
+  Steps steps;
+  steps.reserve(pointers.size());
+
+  for (Pointer pointer : pointers) {
+    stabilizePointer(pointer);
+
+    m_lastPointer = pointer;
+
+    Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
+    m_toolLoop->getController()->movement(m_toolLoop, m_stroke, spritePoint);
+
+    Step step;
+    m_toolLoop->getController()->getStrokeToInterwine(m_stroke, step.stroke);
+    // The speed is used by the ink when the points are joined, so we
+    // have to restore it for each step.
+    step.hasSpeed = true;
+    step.speed = gfx::Point(pointer.velocity().x,
+                            pointer.velocity().y);
+    steps.push_back(std::move(step));
+  }
+
+  std::string statusText;
+  m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
+  m_toolLoop->updateStatusBar(statusText.c_str());
+
+  doLoopSteps(steps, false);
+}
+
+bool ToolLoopManager::canCoalesceSteps() const
+{
+  // We can join several steps only when each trace is accumulated
+  // over the previous one and the source image is not modified
+  // between steps (i.e. TracePolicy::Accumulate). Dynamics are
+  // excluded as the brush (and the dirty area of each step) can
+  // change for each point.
+  return (m_toolLoop->getTracePolicy() == TracePolicy::Accumulate &&
+          m_toolLoop->getController()->isFreehand() &&
+          !m_toolLoop->getFilled() &&
+          !useDynamics());
+}
+
+void ToolLoopManager::setDelayDirtyAreaUpdates(bool state)
+{
+  m_delayDirtyAreaUpdates = state;
+  if (!state)
+    flushDirtyArea();
+}
+
+void ToolLoopManager::flushDirtyArea()
+{
+  if (m_pendingDirtyArea.isEmpty())
+    return;
+
+  gfx::Region dirtyArea;
+  std::swap(dirtyArea, m_pendingDirtyArea);
+  m_toolLoop->updateDirtyArea(dirtyArea);
+}
+
+void ToolLoopManager::stabilizePointer(Pointer& pointer)
 {
   // Filter points with the stabilizer
   if (m_dynamics.stabilizer && m_dynamics.stabilizerFactor > 0) {
@@ -186,41 +281,41 @@ void ToolLoopManager::movement(Pointer pointer)
                       pointer.type(),
                       pointer.pressure());
   }
-
-  m_lastPointer = pointer;
-
-  if (isCanceled())
-    return;
-
-  Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
-  m_toolLoop->getController()->movement(m_toolLoop, m_stroke, spritePoint);
-
-  std::string statusText;
-  m_toolLoop->getController()->getStatusBarText(m_toolLoop, m_stroke, statusText);
-  m_toolLoop->updateStatusBar(statusText.c_str());
-
-  doLoopStep(false);
 }
 
 void ToolLoopManager::doLoopStep(bool lastStep)
 {
   // Original set of points to interwine (original user stroke,
   // relative to sprite origin).
-  Stroke main_stroke;
+  Steps steps(1);
   if (!lastStep)
-    m_toolLoop->getController()->getStrokeToInterwine(m_stroke, main_stroke);
+    m_toolLoop->getController()->getStrokeToInterwine(m_stroke, steps[0].stroke);
   else
-    main_stroke = m_stroke;
+    steps[0].stroke = m_stroke;
+
+  doLoopSteps(steps, lastStep);
+}
+
+void ToolLoopManager::doLoopSteps(Steps& steps, bool lastStep)
+{
+  ASSERT(!steps.empty());
+  ASSERT(steps.size() == 1 || canCoalesceSteps());
 
   // Calculate the area to be updated in all document observers.
   Symmetry* symmetry = m_toolLoop->getSymmetry();
-  Strokes strokes;
-  if (symmetry)
-    symmetry->generateStrokes(main_stroke, strokes, m_toolLoop);
-  else
-    strokes.push_back(main_stroke);
+  Strokes allStrokes;
+  for (Step& step : steps) {
+    if (symmetry)
+      symmetry->generateStrokes(step.stroke, step.strokes, m_toolLoop);
+    else
+      step.strokes.push_back(step.stroke);
+
+    allStrokes.insert(allStrokes.end(),
+                      step.strokes.begin(),
+                      step.strokes.end());
+  }
 
-  calculateDirtyArea(strokes);
+  calculateDirtyArea(allStrokes);
 
   // If we are not in the last step (when the mouse button is
   // released) we are only showing a preview of the tool, so we can
@@ -249,30 +344,41 @@ void ToolLoopManager::doLoopStep(bool lastStep)
     m_toolLoop->validateSrcImage(m_dirtyArea);
   }
 
-  m_toolLoop->getInk()->prepareForStrokes(m_toolLoop, strokes);
-
   // True when we have to fill
   const bool fillStrokes =
     (m_toolLoop->getFilled() &&
      (lastStep || m_toolLoop->getPreviewFilled()));
 
-  // Invalidate the whole destination image area.
-  if (m_toolLoop->getTracePolicy() == TracePolicy::Last ||
-      fillStrokes) {
-    // Copy source to destination (reset all the previous
-    // traces). Useful for tools like Line and Ellipse (we keep the
-    // last trace only) or to draw the final result in contour tool
-    // (the final result is filled).
-    m_toolLoop->invalidateDstImage();
-  }
+  for (std::size_t i=0; i<steps.size(); ++i) {
+    Step& step = steps[i];
 
-  m_toolLoop->validateDstImage(m_dirtyArea);
+    if (step.hasSpeed)
+      m_toolLoop->setSpeed(step.speed);
 
-  // Join or fill user points
-  if (fillStrokes)
-    m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
-  else
-    m_toolLoop->getIntertwine()->joinStroke(m_toolLoop, main_stroke);
+    m_toolLoop->getInk()->prepareForStrokes(m_toolLoop, step.strokes);
+
+    // The destination image is validated just one time for all the
+    // coalesced steps (the dirty area contains all the steps).
+    if (i == 0) {
+      // Invalidate the whole destination image area.
+      if (m_toolLoop->getTracePolicy() == TracePolicy::Last ||
+          fillStrokes) {
+        // Copy source to destination (reset all the previous
+        // traces). Useful for tools like Line and Ellipse (we keep the
+        // last trace only) or to draw the final result in contour tool
+        // (the final result is filled).
+        m_toolLoop->invalidateDstImage();
+      }
+
+      m_toolLoop->validateDstImage(m_dirtyArea);
+    }
+
+    // Join or fill user points
+    if (fillStrokes)
+      m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, step.stroke);
+    else
+      m_toolLoop->getIntertwine()->joinStroke(m_toolLoop, step.stroke);
+  }
 
   if (m_toolLoop->getTracePolicy() == TracePolicy::Overlap) {
     // Copy destination to source (yes, destination to source). In
@@ -282,7 +388,16 @@ void ToolLoopManager::doLoopStep(bool lastStep)
 
   if (!m_dirtyArea.isEmpty()) {
     m_toolLoop->validateDstTileset(m_dirtyArea);
-    m_toolLoop->updateDirtyArea(m_dirtyArea);
+
+    // The last step is always notified immediately (the mouse button
+    // was released).
+    if (m_delayDirtyAreaUpdates && !lastStep) {
+      m_pendingDirtyArea.createUnion(m_pendingDirtyArea, m_dirtyArea);
+    }
+    else {
+      flushDirtyArea();
+      m_toolLoop->updateDirtyArea(m_dirtyArea);
+    }
   }
 
   TOOL_TRACE("ToolLoopManager::doLoopStep dirtyArea", m_dirtyArea.bounds());
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -78,10 +78,40 @@ public:
   // Should be called each time the user moves the mouse inside the editor.
   void movement(Pointer pointer);
 
+  // Same as movement() but for several pointers that were queued at
+  // the same time (e.g. events from a high-frequency tablet). If
+  // canCoalesceSteps() is true, all the points are joined in just one
+  // loop step (one validation of src/dst images and one dirty area).
+  void movement(const std::vector<Pointer>& pointers);
+
+  // Returns true if several movements can be processed in one loop
+  // step with exactly the same result as processing them one by one.
+  bool canCoalesceSteps() const;
+
+  // If it's true, the dirty area of each loop step is accumulated
+  // and the ToolLoop is notified (ToolLoop::updateDirtyArea()) only
+  // when flushDirtyArea() is called (e.g. at the display refresh
+  // rate).
+  void setDelayDirtyAreaUpdates(bool state);
+  bool hasPendingDirtyArea() const { return !m_pendingDirtyArea.isEmpty(); }
+  void flushDirtyArea();
+
   const Pointer& lastPointer() const { return m_lastPointer; }
 
 private:
+  // Points to be joined in a loop step, with the speed of the
+  // pointer that generated them (when several steps are coalesced).
+  struct Step {
+    Stroke stroke;
+    Strokes strokes;            // Strokes generated with symmetry
+    bool hasSpeed = false;
+    gfx::Point speed;
+  };
+  typedef std::vector<Step> Steps;
+
   void doLoopStep(bool lastStep);
+  void doLoopSteps(Steps& steps, bool lastStep);
+  void stabilizePointer(Pointer& pointer);
   void snapToGrid(Stroke::Pt& pt);
   Stroke::Pt getSpriteStrokePt(const Pointer& pointer);
   bool useDynamics() const;
@@ -95,6 +125,8 @@ private:
   Pointer m_lastPointer;
   gfx::Region m_dirtyArea;
   gfx::Region m_nextDirtyArea;
+  gfx::Region m_pendingDirtyArea;
+  bool m_delayDirtyAreaUpdates;
   doc::Brush m_brush0;
   DynamicsOptions m_dynamics;
   gfx::PointF m_stabilizerCenter;
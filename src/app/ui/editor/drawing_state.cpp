@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -45,6 +45,10 @@ namespace app {
 
 using namespace ui;
 
+// Interval (in milliseconds) used to notify the painted area to the
+// editor while we paint with freehand tools (~60 fps).
+static const int kUpdateDirtyAreaInterval = 16;
+
 static int get_delay_interval_for_tool_loop(tools::ToolLoop* toolLoop)
 {
   if (toolLoop->getTracePolicy() == tools::TracePolicy::Last) {
@@ -71,7 +75,17 @@ DrawingState::DrawingState(Editor* editor,
   , m_mouseMoveReceived(false)
   , m_mousePressedReceived(false)
   , m_processScrollChange(true)
+  , m_alive(std::make_shared<bool>(true))
+  , m_updateDirtyAreaTimer(kUpdateDirtyAreaInterval)
 {
+  m_updateDirtyAreaTimer.Tick.connect([this]{ onUpdateDirtyAreaTimer(); });
+
+  // Freehand tools notify the painted area at the display refresh
+  // rate (tools like Line, Rectangle, etc. are already delayed by
+  // the DelayedMouseMove).
+  if (get_delay_interval_for_tool_loop(toolLoop) == 0)
+    m_toolLoopManager->setDelayDirtyAreaUpdates(true);
+
   m_beforeCmdConn =
     UIContext::instance()->BeforeCommandExecution.connect(
       &DrawingState::onBeforeCommandExecution, this);
@@ -131,12 +145,14 @@ void DrawingState::initToolLoop(Editor* editor,
 void DrawingState::sendMovementToToolLoop(const tools::Pointer& pointer)
 {
   ASSERT(m_toolLoopManager);
+  processPendingPointers();
   m_lastPointer = pointer;
   m_toolLoopManager->movement(pointer);
 }
 
 void DrawingState::notifyToolLoopModifiersChange(Editor* editor)
 {
+  processPendingPointers();
   if (!m_toolLoopManager->isCanceled())
     m_toolLoopManager->notifyToolLoopModifiersChange();
 }
@@ -172,6 +188,9 @@ bool DrawingState::onMouseDown(Editor* editor, MouseMessage* msg)
 
   m_mousePressedReceived = true;
 
+  // Process pending movements before the new button press.
+  processPendingPointers();
+
   // Notify the mouse button down to the tool loop manager.
   m_toolLoopManager->pressButton(pointer);
 
@@ -202,6 +221,7 @@ bool DrawingState::onMouseUp(Editor* editor, MouseMessage* msg)
 
   m_lastPointer = pointer_from_msg(editor, msg, m_velocity.velocity());
   m_delayedMouseMove.onMouseUp(msg);
+  processPendingPointers();
 
   // Selection tools with Replace mode are cancelled with a simple click.
   // ("one point" controller selection tool i.e. the magic wand, and
@@ -325,6 +345,8 @@ bool DrawingState::onKeyDown(Editor* editor, KeyMessage* msg)
 
 bool DrawingState::onKeyUp(Editor* editor, KeyMessage* msg)
 {
+  processPendingPointers();
+
   // Cancel loop pressing Esc key...
   if (msg->scancode() == ui::kKeyEsc ||
       // Cancel "Shift on freehand" line preview when the Shift key is
@@ -383,9 +405,61 @@ bool DrawingState::getGridBounds(Editor* editor, gfx::Rect& gridBounds)
 
 void DrawingState::handleMouseMovement()
 {
-  // Notify mouse movement to the tool
   ASSERT(m_toolLoopManager);
-  m_toolLoopManager->movement(m_lastPointer);
+
+  // Notify mouse movement to the tool
+  if (!m_toolLoopManager->canCoalesceSteps()) {
+    processPendingPointers();
+    m_toolLoopManager->movement(m_lastPointer);
+  }
+  // Queue the movement so all the mouse messages received in the
+  // same batch are processed in one loop step (useful for
+  // high-frequency tablets).
+  else {
+    m_pendingPointers.push_back(m_lastPointer);
+    if (m_pendingPointers.size() == 1) {
+      std::weak_ptr<bool> alive(m_alive);
+      ui::execute_from_ui_thread([this, alive]{
+        if (alive.lock())
+          processPendingPointers();
+      });
+    }
+  }
+
+  if (m_toolLoopManager->hasPendingDirtyArea() &&
+      !m_updateDirtyAreaTimer.isRunning()) {
+    m_updateDirtyAreaTimer.start();
+  }
+}
+
+void DrawingState::processPendingPointers()
+{
+  if (m_pendingPointers.empty())
+    return;
+
+  std::vector<tools::Pointer> pointers;
+  std::swap(pointers, m_pendingPointers);
+
+  if (!m_toolLoopManager || m_toolLoopManager->isCanceled())
+    return;
+
+  HideBrushPreview hide(m_editor->brushPreview());
+  m_toolLoopManager->movement(pointers);
+
+  if (m_toolLoopManager->hasPendingDirtyArea() &&
+      !m_updateDirtyAreaTimer.isRunning()) {
+    m_updateDirtyAreaTimer.start();
+  }
+}
+
+void DrawingState::onUpdateDirtyAreaTimer()
+{
+  m_updateDirtyAreaTimer.stop();
+
+  if (m_toolLoopManager) {
+    HideBrushPreview hide(m_editor->brushPreview());
+    m_toolLoopManager->flushDirtyArea();
+  }
 }
 
 bool DrawingState::canInterpretMouseMovementAsJustOneClick()
@@ -446,6 +520,11 @@ void DrawingState::destroyLoopIfCanceled(Editor* editor)
 
 void DrawingState::destroyLoop(Editor* editor)
 {
+  if (editor)
+    processPendingPointers();
+  m_pendingPointers.clear();
+  m_updateDirtyAreaTimer.stop();
+
   if (editor)
     editor->renderEngine().removePreviewImage();
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -15,7 +15,10 @@
 #include "app/ui/editor/standby_state.h"
 #include "base/time.h"
 #include "obs/connection.h"
+#include "ui/timer.h"
+
 #include <memory>
+#include <vector>
 
 namespace app {
   namespace tools {
@@ -68,6 +71,8 @@ namespace app {
 
   private:
     void handleMouseMovement();
+    void processPendingPointers();
+    void onUpdateDirtyAreaTimer();
     bool canInterpretMouseMovementAsJustOneClick();
     bool canExecuteCommands();
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
@@ -113,6 +118,19 @@ namespace app {
     // Locks the scroll
     bool m_processScrollChange;
 
+    // Pointers received from mouse/tablet messages that weren't sent
+    // to the ToolLoopManager yet. All pointers received in the same
+    // batch of UI messages are processed in one loop step.
+    std::vector<tools::Pointer> m_pendingPointers;
+
+    // Used to check if the DrawingState is still alive when the
+    // pending pointers are processed from the UI thread.
+    std::shared_ptr<bool> m_alive;
+
+    // Notifies the painted area to the editor at the display refresh
+    // rate (instead of one time for each mouse message).
+    ui::Timer m_updateDirtyAreaTimer;
+
     obs::scoped_connection m_beforeCmdConn;
   };
 
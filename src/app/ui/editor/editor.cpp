@@ -44,6 +44,7 @@
 #include "app/ui/editor/moving_pixels_state.h"
 #include "app/ui/editor/pixels_movement.h"
 #include "app/ui/editor/play_state.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/editor/standby_state.h"
 #include "app/ui/editor/zooming_state.h"
@@ -53,6 +54,7 @@
 #include "app/ui/timeline/timeline.h"
 #include "app/ui/toolbar.h"
 #include "app/ui_context.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/layer_utils.h"
 #include "app/util/tile_flags_utils.h"
 #include "base/chrono.h"
@@ -162,6 +164,7 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   , m_flashing(Flashing::None)
   , m_aniSpeed(1.0)
   , m_isPlaying(false)
+  , m_playbackCache(nullptr)
   , m_showGuidesThisCel(nullptr)
   , m_showAutoCelGuides(false)
   , m_tagFocusBand(-1)
@@ -737,10 +740,35 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         maxw, maxh, m_document->osColorSpace());
     }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    // Use the frame rendered in background by the PlayState if it's
+    // ready (only for the simple renderer/new engine, which renders
+    // the sprite without zoom, and when there is nothing else to
+    // show over the sprite).
+    ImageRef cachedFrame;
+    if (m_playbackCache &&
+        canUsePlaybackCache() &&
+        (!extraCel || extraCel->type() == render::ExtraType::NONE)) {
+      PlaybackCache::Options opts;
+      opts.bg = EditorRender::getBgOptions(m_document, IMAGE_RGB);
+      opts.newBlend = pref.experimental.newBlend();
+      opts.nonactiveLayersOpacity = otherLayersOpacity();
+      opts.selectedLayerId = (m_layer ? m_layer->id(): doc::NullId);
+      m_playbackCache->setOptions(opts);
+
+      cachedFrame = m_playbackCache->frame(m_frame);
+    }
+
+    if (cachedFrame) {
+      convert_image_to_surface(
+        cachedFrame.get(), m_sprite->palette(m_frame),
+        rendered.get(), rc2.x, rc2.y, 0, 0, rc2.w, rc2.h);
+    }
+    else {
+      m_renderEngine->setProjection(
+        newEngine ? render::Projection(): m_proj);
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    }
 
     m_renderEngine->removeExtraImage();
 
@@ -2867,6 +2895,22 @@ bool Editor::isPlaying() const
   return m_isPlaying;
 }
 
+void Editor::setPlaybackCache(PlaybackCache* cache)
+{
+  m_playbackCache = cache;
+}
+
+bool Editor::canUsePlaybackCache() const
+{
+  const bool onionskin =
+    ((m_flags & kShowOnionskin) == kShowOnionskin &&
+     m_docPref.onionskin.active());
+
+  return (isUsingNewRenderEngine() &&
+          !m_renderEngine->properties().renderBgOnScreen &&
+          !onionskin);
+}
+
 void Editor::showAnimationSpeedMultiplierPopup()
 {
   const bool wasPlaying = isPlaying();
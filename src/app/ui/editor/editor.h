@@ -61,6 +61,7 @@ namespace app {
   class EditorCustomizationDelegate;
   class EditorRender;
   class PixelsMovement;
+  class PlaybackCache;
   class Site;
   class Transformation;
 
@@ -279,6 +280,16 @@ namespace app {
     void stop();
     bool isPlaying() const;
 
+    // Frames rendered in background to be used while the animation
+    // is playing (set by the PlayState).
+    void setPlaybackCache(PlaybackCache* cache);
+
+    // Returns true if the editor can show frames from a
+    // PlaybackCache with its current render options (new render
+    // engine, no onion skin, and the background is not painted on
+    // the screen).
+    bool canUsePlaybackCache() const;
+
     // Shows a popup menu to change the editor animation speed.
     void showAnimationSpeedMultiplierPopup();
     double getAnimationSpeedMultiplier() const;
@@ -469,6 +480,7 @@ namespace app {
     // Animation speed multiplier.
     double m_aniSpeed;
     bool m_isPlaying;
+    PlaybackCache* m_playbackCache;
 
     // The Cel that is above the mouse if the Ctrl (or Cmd) key is
     // pressed (move key).
@@ -78,6 +78,12 @@ void EditorRender::setProjection(const render::Projection& projection)
 }
 
 void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
+{
+  m_renderer->setBgOptions(getBgOptions(doc, pixelFormat));
+}
+
+// static
+render::BgOptions EditorRender::getBgOptions(Doc* doc, doc::PixelFormat pixelFormat)
 {
   DocumentPreferences& docPref = Preferences::instance().document(doc);
   render::BgType bgType;
@@ -120,7 +126,7 @@ void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
   bg.color1 = color_utils::color_for_image_without_alpha(docPref.bg.color1(), pixelFormat);
   bg.color2 = color_utils::color_for_image_without_alpha(docPref.bg.color2(), pixelFormat);
   bg.stripeSize = tile;
-  m_renderer->setBgOptions(bg);
+  return bg;
 }
 
 void EditorRender::setTransparentBackground()
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "doc/pixel_format.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
+#include "render/bg_options.h"
 #include "render/extra_type.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
@@ -63,6 +64,9 @@ namespace app {
     void setupBackground(Doc* doc, doc::PixelFormat pixelFormat);
     void setTransparentBackground();
 
+    // Background options for the given document preferences.
+    static render::BgOptions getBgOptions(Doc* doc, doc::PixelFormat pixelFormat);
+
     void setSelectedLayer(const doc::Layer* layer);
 
     void setPreviewImage(const doc::Layer* layer,
@@ -13,15 +13,19 @@
 
 #include "app/commands/command.h"
 #include "app/commands/commands.h"
+#include "app/i18n/strings.h"
 #include "app/loop_tag.h"
 #include "app/pref/preferences.h"
 #include "app/tools/ink.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/editor/editor_customization_delegate.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/skin/skin_theme.h"
+#include "app/ui/status_bar.h"
 #include "app/ui_context.h"
 #include "doc/tag.h"
+#include "fmt/format.h"
 #include "ui/manager.h"
 #include "ui/message.h"
 #include "ui/system.h"
@@ -42,6 +46,7 @@ PlayState::PlayState(const bool playOnce,
   , m_nextFrameTime(-1)
   , m_refFrame(0)
   , m_tag(nullptr)
+  , m_playbackCacheProgress(-1)
 {
   m_playTimer.Tick.connect(&PlayState::onPlaybackTick, this);
 
@@ -51,6 +56,14 @@ PlayState::PlayState(const bool playOnce,
     &PlayState::onBeforeCommandExecution, this);
 }
 
+PlayState::~PlayState()
+{
+  // Just in case the editor is destroyed while it's playing, or this
+  // state is destroyed without leaving it (e.g. we've left it to go
+  // to the ScrollingState and the states history is replaced).
+  stopPlaybackCache();
+}
+
 Tag* PlayState::playingTag() const
 {
   return m_tag;
@@ -117,6 +130,8 @@ void PlayState::onEnterState(Editor* editor)
     m_nextFrameTime = getNextFrameTime();
     m_curFrameTick = base::current_tick();
     m_playTimer.start();
+
+    startPlaybackCache();
   }
 }
 
@@ -126,6 +141,7 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
   // (we keep playing the animation).
   if (!m_toScroll) {
     m_playTimer.stop();
+    stopPlaybackCache();
 
     if (m_playOnce || Preferences::instance().general.rewindOnStop())
       m_editor->setFrame(m_refFrame);
@@ -236,6 +252,18 @@ void PlayState::onPlaybackTick()
   }
 
   m_curFrameTick = base::current_tick();
+
+  // Start/stop rendering frames in background if the editor options
+  // changed while playing (e.g. the onion skin was enabled).
+  if (m_playTimer.isRunning() &&
+      m_editor->canUsePlaybackCache() != (m_playbackCache != nullptr)) {
+    if (m_playbackCache)
+      stopPlaybackCache();
+    else
+      startPlaybackCache();
+  }
+
+  updatePlaybackCacheProgress();
 }
 
 // Before executing any command, we stop the animation
@@ -275,4 +303,72 @@ double PlayState::getNextFrameTime()
     / m_editor->getAnimationSpeedMultiplier(); // The "speed multiplier" is a "duration divider"
 }
 
+std::vector<doc::frame_t> PlayState::getPlaybackFrames() const
+{
+  const Sprite* sprite = m_editor->sprite();
+  const frame_t nframes = sprite->totalFrames();
+  std::vector<frame_t> frames;
+  std::vector<bool> added(nframes, false);
+
+  // Simulate the playback on a copy of the current one, with a limit
+  // of steps for tags that are repeated several times.
+  doc::Playback playback = m_playback;
+  frame_t frame = m_editor->frame();
+  for (int step=0; step<4*nframes; ++step) {
+    if (frame < 0 || frame >= nframes)
+      break;
+
+    if (!added[frame]) {
+      added[frame] = true;
+      frames.push_back(frame);
+      if (frames.size() == std::size_t(nframes))
+        break;
+    }
+
+    frame = playback.nextFrame();
+    if (playback.isStopped())
+      break;
+  }
+  return frames;
+}
+
+void PlayState::startPlaybackCache()
+{
+  // Single frame sprites don't need a cache, and we don't render
+  // frames that the editor cannot use (e.g. with onion skin).
+  if (m_editor->sprite()->totalFrames() < 2 ||
+      !m_editor->canUsePlaybackCache())
+    return;
+
+  m_playbackCache = std::make_unique<PlaybackCache>(
+    m_editor->document(), getPlaybackFrames());
+  m_playbackCacheProgress = -1;
+  m_editor->setPlaybackCache(m_playbackCache.get());
+}
+
+void PlayState::stopPlaybackCache()
+{
+  if (m_playbackCache) {
+    m_editor->setPlaybackCache(nullptr);
+    m_playbackCache.reset();
+  }
+}
+
+void PlayState::updatePlaybackCacheProgress()
+{
+  if (!m_playbackCache ||
+      m_playbackCache->totalFrames() == 0 ||
+      !m_editor->isActive())
+    return;
+
+  const int progress = 100 * m_playbackCache->readyFrames()
+                           / m_playbackCache->totalFrames();
+  if (progress == m_playbackCacheProgress)
+    return;
+
+  m_playbackCacheProgress = progress;
+  StatusBar::instance()->setStatusText(
+    0, fmt::format(Strings::statusbar_tips_playback_cache(), progress));
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,9 @@
 #include "obs/connection.h"
 #include "ui/timer.h"
 
+#include <memory>
+#include <vector>
+
 namespace doc {
   class Tag;
 }
@@ -23,12 +26,14 @@ namespace doc {
 namespace app {
 
   class CommandExecutionEvent;
+  class PlaybackCache;
 
   class PlayState : public StateWithWheelBehavior {
   public:
     PlayState(const bool playOnce,
               const bool playAll,
               const bool playSubtags);
+    ~PlayState();
 
     doc::Tag* playingTag() const;
 
@@ -51,6 +56,14 @@ namespace app {
 
     double getNextFrameTime();
 
+    // Frames that will be played from the current frame (in order
+    // and without repetitions).
+    std::vector<doc::frame_t> getPlaybackFrames() const;
+
+    void startPlaybackCache();
+    void stopPlaybackCache();
+    void updatePlaybackCacheProgress();
+
     Editor* m_editor;
     doc::Playback m_playback;
     bool m_playOnce;
@@ -68,6 +81,10 @@ namespace app {
     doc::Tag* m_tag;
 
     obs::scoped_connection m_ctxConn;
+
+    // Frames rendered in background threads for this playback
+    std::unique_ptr<PlaybackCache> m_playbackCache;
+    int m_playbackCacheProgress;
   };
 
 } // namespace app
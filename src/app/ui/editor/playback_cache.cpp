@@ -0,0 +1,310 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/playback_cache.h"
+
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/doc_snapshot.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/render_plan.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "render/render.h"
+
+#include <algorithm>
+#include <set>
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+// Milliseconds that a worker waits to read the document (to create
+// a snapshot), if the lock cannot be obtained (e.g. the document is
+// being modified) the frame is tried again later.
+const int kLockTimeout = 100;
+
+// Collects the ID/version of each object that is used to render the
+// given frame, so we can know if a rendered frame is outdated.
+void calc_frame_state(const Sprite* sprite,
+                      const frame_t frame,
+                      std::vector<uint32_t>& state)
+{
+  const Palette* pal = sprite->palette(frame);
+
+  state.clear();
+  state.push_back(uint32_t(sprite->pixelFormat()));
+  state.push_back(sprite->transparentColor());
+  state.push_back(pal->id());
+  state.push_back(pal->version());
+
+  RenderPlan plan;
+  plan.addLayer(sprite->root(), frame);
+
+  for (const auto& item : plan.items()) {
+    const Layer* layer = item.layer;
+    state.push_back(layer->id());
+    state.push_back(layer->version());
+    state.push_back(uint32_t(layer->flags()));
+
+    const Cel* cel = (item.cel ? item.cel: layer->cel(frame));
+    if (!cel)
+      continue;
+
+    const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+    state.push_back(imgLayer->opacity());
+    state.push_back(uint32_t(imgLayer->blendMode()));
+    state.push_back(cel->id());
+    state.push_back(cel->version());
+    state.push_back(cel->data()->id());
+    state.push_back(cel->data()->version());
+    state.push_back(cel->x());
+    state.push_back(cel->y());
+    state.push_back(cel->opacity());
+    state.push_back(cel->zIndex());
+
+    const Image* image = cel->image();
+    state.push_back(image ? image->id(): 0);
+    state.push_back(image ? image->version(): 0);
+
+    if (layer->isTilemap()) {
+      const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset();
+      state.push_back(tileset ? tileset->id(): 0);
+      state.push_back(tileset ? tileset->version(): 0);
+    }
+  }
+}
+
+} // anonymous namespace
+
+bool PlaybackCache::Options::operator==(const Options& o) const
+{
+  return (bg.type == o.bg.type &&
+          bg.zoom == o.bg.zoom &&
+          bg.colorPixelFormat == o.bg.colorPixelFormat &&
+          bg.color1 == o.bg.color1 &&
+          bg.color2 == o.bg.color2 &&
+          bg.stripeSize == o.bg.stripeSize &&
+          newBlend == o.newBlend &&
+          nonactiveLayersOpacity == o.nonactiveLayersOpacity &&
+          selectedLayerId == o.selectedLayerId);
+}
+
+PlaybackCache::PlaybackCache(Doc* doc,
+                             const std::vector<frame_t>& frames)
+  : m_doc(doc)
+  , m_sprite(doc->sprite())
+  , m_frames(frames)
+  , m_hasOptions(false)
+  , m_generation(0)
+  , m_stop(false)
+{
+  // Keep only the frames that fit in the memory budget (the first
+  // frames to be played have priority).
+  const std::size_t frameSize =
+    std::size_t(m_sprite->width()) * m_sprite->height() * 4;
+  const std::size_t maxFrames = (frameSize > 0 ? kMaxMemSize / frameSize: 0);
+  if (m_frames.size() > maxFrames)
+    m_frames.resize(maxFrames);
+
+  if (m_frames.empty())
+    return;
+
+  // The UI thread isn't included in the shared budget of threads
+  m_reservedThreads = std::make_unique<doc::ReservedThreads>(
+    std::min(4, int(m_frames.size())));
+  const int nthreads = std::max(1, m_reservedThreads->count());
+  for (int i=0; i<nthreads; ++i)
+    m_threads.emplace_back([this]{ workerThread(); });
+}
+
+PlaybackCache::~PlaybackCache()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_pending.clear();
+  }
+  m_cv.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+void PlaybackCache::setOptions(const Options& options)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_hasOptions && m_options == options)
+    return;
+
+  m_options = options;
+  m_hasOptions = true;
+  restart();
+}
+
+ImageRef PlaybackCache::frame(const frame_t frame)
+{
+  FrameState state;
+  calc_frame_state(m_sprite, frame, state);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(frame);
+  if (it == m_entries.end())
+    return nullptr;
+
+  if (it->second.state != state) {
+    m_entries.erase(it);
+
+    // Render this frame again as soon as possible
+    m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), frame),
+                    m_pending.end());
+    m_pending.push_front(frame);
+    m_cv.notify_one();
+    return nullptr;
+  }
+  return it->second.image;
+}
+
+int PlaybackCache::readyFrames() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return int(m_entries.size());
+}
+
+// Discards all rendered frames (m_mutex must be locked)
+void PlaybackCache::restart()
+{
+  ++m_generation;
+  m_entries.clear();
+  m_pending.assign(m_frames.begin(), m_frames.end());
+  m_cv.notify_all();
+}
+
+void PlaybackCache::workerThread()
+{
+  render::Render render;
+  render.setRefLayersVisiblity(true);
+
+  while (true) {
+    frame_t frame;
+    Options options;
+    int generation;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]{ return m_stop || !m_pending.empty(); });
+      if (m_stop)
+        return;
+
+      frame = m_pending.front();
+      m_pending.pop_front();
+      options = m_options;
+      generation = m_generation;
+    }
+
+    Entry entry;
+    std::shared_ptr<DocSnapshot> snapshot;
+    try {
+      snapshot = snapshotForFrame(frame, entry.state);
+    }
+    catch (const LockedDocException&) {
+      // The document is being modified, we'll try again later
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_stop && generation == m_generation)
+        m_pending.push_back(frame);
+      continue;
+    }
+    catch (const std::exception&) {
+      // Not enough memory, this frame will be rendered live
+      continue;
+    }
+
+    // Render the frame from the snapshot without locking the document
+    try {
+      const Sprite* sprite = snapshot->doc()->sprite();
+      const Layer* selectedLayer = nullptr;
+      if (options.selectedLayerId != NullId) {
+        for (const Layer* layer : sprite->allLayers()) {
+          if (layer->id() == options.selectedLayerId) {
+            selectedLayer = layer;
+            break;
+          }
+        }
+      }
+
+      entry.image.reset(Image::create(IMAGE_RGB,
+                                      sprite->width(),
+                                      sprite->height()));
+
+      render.setBgOptions(options.bg);
+      render.setNewBlend(options.newBlend);
+      render.setNonactiveLayersOpacity(options.nonactiveLayersOpacity);
+      render.setSelectedLayer(selectedLayer);
+      render.renderSprite(entry.image.get(), sprite, frame);
+    }
+    catch (const std::exception&) {
+      // Not enough memory, this frame will be rendered live
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Discard frames rendered with old options (they were already
+    // added to m_pending again by restart()).
+    if (generation == m_generation)
+      m_entries[frame] = std::move(entry);
+  }
+}
+
+// Returns a snapshot of the document that contains the current state
+// of the given frame. The document is locked only to calculate the
+// state of the frame and to create a new snapshot if the last one is
+// outdated. Throws a LockedDocException if the document cannot be
+// read.
+std::shared_ptr<DocSnapshot> PlaybackCache::snapshotForFrame(const frame_t frame,
+                                                             FrameState& state)
+{
+  std::unique_lock<std::mutex> lock(m_snapshotMutex);
+  const DocReader reader(m_doc, kLockTimeout);
+
+  calc_frame_state(m_sprite, frame, state);
+  if (m_snapshot) {
+    FrameState snapshotState;
+    calc_frame_state(m_snapshot->doc()->sprite(), frame, snapshotState);
+    if (snapshotState == state)
+      return m_snapshot;
+  }
+
+  // Copy only the images used in the frames of the playback range
+  std::set<ObjectId> images;
+  const LayerList layers = m_sprite->allLayers();
+  for (const frame_t fr : m_frames) {
+    for (const Layer* layer : layers) {
+      const Cel* cel = layer->cel(fr);
+      if (cel && cel->image())
+        images.insert(cel->image()->id());
+    }
+  }
+
+  auto snapshot = std::make_shared<DocSnapshot>();
+  snapshot->create(m_doc,
+                   [&images](const Object* obj){
+                     return (obj->type() == ObjectType::Image &&
+                             images.find(obj->id()) == images.end());
+                   });
+  m_snapshot = snapshot;
+  return snapshot;
+}
+
+} // namespace app
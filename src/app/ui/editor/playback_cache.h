@@ -0,0 +1,117 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/parallel.h"
+#include "render/bg_options.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+  class Sprite;
+}
+
+namespace app {
+  class Doc;
+  class DocSnapshot;
+
+  // Renders the frames of the playback range in background threads
+  // (in the same order they will be played), so the Editor can just
+  // blit them while the animation is playing instead of rendering
+  // each frame in the UI thread when it's due.
+  //
+  // Frames are rendered from a DocSnapshot, so the document is locked
+  // only to check if the snapshot is outdated (or to create a new
+  // one), and not while the frames are rendered.
+  class PlaybackCache {
+  public:
+    // Maximum number of bytes used by all rendered frames. Frames
+    // that don't fit in this budget are rendered live.
+    static const std::size_t kMaxMemSize = 256*1024*1024;
+
+    // Render options used by the Editor, rendered frames are valid
+    // only for these options.
+    struct Options {
+      render::BgOptions bg;
+      bool newBlend = false;
+      int nonactiveLayersOpacity = 255;
+      doc::ObjectId selectedLayerId = doc::NullId;
+
+      bool operator==(const Options& o) const;
+      bool operator!=(const Options& o) const { return !operator==(o); }
+    };
+
+    // Frames are rendered in the given order after the first call
+    // to setOptions().
+    PlaybackCache(Doc* doc,
+                  const std::vector<doc::frame_t>& frames);
+    ~PlaybackCache();
+
+    // Discards all rendered frames if the options are different.
+    void setOptions(const Options& options);
+
+    // Returns the rendered frame (with the sprite size) or nullptr
+    // if it's not ready yet. If the frame was modified after it was
+    // rendered, it's discarded and rendered again.
+    doc::ImageRef frame(const doc::frame_t frame);
+
+    int readyFrames() const;
+    int totalFrames() const { return int(m_frames.size()); }
+
+  private:
+    // IDs/versions of all the objects used to render a frame
+    typedef std::vector<uint32_t> FrameState;
+
+    struct Entry {
+      FrameState state;
+      doc::ImageRef image;
+    };
+
+    void workerThread();
+    void restart();
+    std::shared_ptr<DocSnapshot> snapshotForFrame(const doc::frame_t frame,
+                                                  FrameState& state);
+
+    Doc* m_doc;
+    const doc::Sprite* m_sprite;
+    std::vector<doc::frame_t> m_frames;
+
+    // Everything below is guarded by m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Options m_options;
+    bool m_hasOptions;
+    int m_generation;
+    std::deque<doc::frame_t> m_pending;
+    std::map<doc::frame_t, Entry> m_entries;
+    bool m_stop;
+
+    // Last snapshot of the document used to render frames (guarded
+    // by m_snapshotMutex)
+    std::mutex m_snapshotMutex;
+    std::shared_ptr<DocSnapshot> m_snapshot;
+
+    std::unique_ptr<doc::ReservedThreads> m_reservedThreads;
+    std::vector<std::thread> m_threads;
+  };
+
+} // namespace app
+
+#endif
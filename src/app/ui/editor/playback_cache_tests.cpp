@@ -0,0 +1,151 @@
+// Aseprite
+// Copyright (C) 2023  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/test_context.h"
+#include "app/ui/editor/playback_cache.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+#include "render/render.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace app;
+using namespace doc;
+
+typedef std::unique_ptr<Doc> DocPtr;
+
+// Waits until the given frame is rendered by the cache (or a timeout)
+static ImageRef wait_frame(PlaybackCache& cache, const frame_t frame)
+{
+  for (int i=0; i<500; ++i) {
+    if (ImageRef image = cache.frame(frame))
+      return image;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return nullptr;
+}
+
+static void expect_rendered_frame(const Sprite* sprite,
+                                  const frame_t frame,
+                                  const Image* image)
+{
+  std::unique_ptr<Image> expected(
+    Image::create(IMAGE_RGB, sprite->width(), sprite->height()));
+  render::Render render;
+  render.setRefLayersVisiblity(true);
+  render.renderSprite(expected.get(), sprite, frame);
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), image));
+}
+
+static DocPtr make_doc(TestContextT<Context>& ctx)
+{
+  DocPtr doc(ctx.documents().add(8, 8, ColorMode::RGB));
+  Sprite* sprite = doc->sprite();
+  LayerImage* layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  clear_image(layer->cel(0)->image(), rgba(255, 0, 0, 255));
+
+  sprite->setTotalFrames(frame_t(2));
+  ImageRef image(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image.get(), rgba(0, 0, 255, 255));
+  layer->addCel(new Cel(frame_t(1), image));
+  return doc;
+}
+
+TEST(PlaybackCache, RenderFrames)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc = make_doc(ctx);
+  Sprite* sprite = doc->sprite();
+
+  PlaybackCache cache(doc.get(), { 0, 1 });
+  EXPECT_EQ(2, cache.totalFrames());
+  cache.setOptions(PlaybackCache::Options());
+
+  for (frame_t fr=0; fr<2; ++fr) {
+    ImageRef image = wait_frame(cache, fr);
+    ASSERT_TRUE(image != nullptr);
+    expect_rendered_frame(sprite, fr, image.get());
+  }
+  EXPECT_EQ(2, cache.readyFrames());
+}
+
+TEST(PlaybackCache, InvalidateModifiedFrames)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc = make_doc(ctx);
+  Sprite* sprite = doc->sprite();
+
+  PlaybackCache cache(doc.get(), { 0, 1 });
+  cache.setOptions(PlaybackCache::Options());
+  ASSERT_TRUE(wait_frame(cache, 0) != nullptr);
+  ASSERT_TRUE(wait_frame(cache, 1) != nullptr);
+
+  // Modify the first frame, the old rendered frame is discarded
+  {
+    const DocWriter writer(doc.get(), 1000);
+    Image* image = sprite->root()->firstLayer()->cel(0)->image();
+    put_pixel(image, 2, 3, rgba(0, 255, 0, 255));
+    image->incrementVersion();
+  }
+  EXPECT_TRUE(cache.frame(0) == nullptr);
+
+  ImageRef frame0 = wait_frame(cache, 0);
+  ASSERT_TRUE(frame0 != nullptr);
+  EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(frame0.get(), 2, 3));
+  expect_rendered_frame(sprite, 0, frame0.get());
+
+  // The second frame is still valid
+  ImageRef frame1 = cache.frame(1);
+  ASSERT_TRUE(frame1 != nullptr);
+  expect_rendered_frame(sprite, 1, frame1.get());
+
+  // Different options discard all frames
+  PlaybackCache::Options options;
+  options.nonactiveLayersOpacity = 128;
+  cache.setOptions(options);
+  frame1 = wait_frame(cache, 1);
+  ASSERT_TRUE(frame1 != nullptr);
+  EXPECT_EQ(rgba(0, 0, 255, 128), get_pixel(frame1.get(), 0, 0));
+}
+
+TEST(PlaybackCache, DontRenderWhileDocIsLocked)
+{
+  TestContextT<Context> ctx;
+  DocPtr doc = make_doc(ctx);
+  Sprite* sprite = doc->sprite();
+
+  PlaybackCache cache(doc.get(), { 0, 1 });
+  {
+    // The document is being modified, workers cannot read it
+    const DocWriter writer(doc.get(), 1000);
+    cache.setOptions(PlaybackCache::Options());
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(0, cache.readyFrames());
+
+    Image* image = sprite->root()->firstLayer()->cel(1)->image();
+    put_pixel(image, 0, 0, rgba(0, 255, 0, 255));
+    image->incrementVersion();
+  }
+
+  // Frames are rendered when the document is unlocked
+  ImageRef frame1 = wait_frame(cache, 1);
+  ASSERT_TRUE(frame1 != nullptr);
+  expect_rendered_frame(sprite, 1, frame1.get());
+
+  ASSERT_TRUE(wait_frame(cache, 0) != nullptr);
+
+  // Rendered frames can be used while the document is locked
+  const DocWriter writer(doc.get(), 1000);
+  EXPECT_TRUE(cache.frame(0) != nullptr);
+  EXPECT_TRUE(cache.frame(1) != nullptr);
+}
@@ -33,6 +33,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/mask.h"
 #include "doc/palette.h"
+#include "doc/parallel.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "doc/tileset.h"
@@ -45,6 +46,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -83,22 +85,6 @@ void mask_image(Image* image, Image* bitmap)
   }
 }
 
-template<typename ImageTraits>
-void create_region_with_differences_templ(const Image* a,
-                                          const Image* b,
-                                          const gfx::Rect& bounds,
-                                          gfx::Region& output)
-{
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    for (int x=bounds.x; x<bounds.x2(); ++x) {
-      if (get_pixel_fast<ImageTraits>(a, x, y) !=
-          get_pixel_fast<ImageTraits>(b, x, y)) {
-        output.createUnion(output, gfx::Region(gfx::Rect(x, y, 1, 1)));
-      }
-    }
-  }
-}
-
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
 void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
@@ -120,156 +106,28 @@ struct Mod {
   gfx::Region tileRgn;
 };
 
-class DoFlip {
-public:
-  DoFlip(const doc::ImageRef& image,
-         const doc::algorithm::FlipType flipType)
-    : m_image(image.get())
-    , m_flipType(flipType) {
-  }
-  ~DoFlip() {
-    reset();
-  }
-  void flip() {
-    m_flipped = !m_flipped;
-    doc::algorithm::flip_image(m_image,
-                               m_image->bounds(),
-                               m_flipType);
-  }
-  void reset() {
-    if (m_flipped)
-      flip();
-  }
-  bool operator!() const {
-    return !m_flipped;
-  }
-private:
-  doc::Image* m_image;
-  bool m_flipped = false;
-  doc::algorithm::FlipType m_flipType;
-};
-
-// This is a terrible way to find tiles, i.e. flipping several times
-// the image, instead of searching for flipped hashes. In the future
-// we could try to improve it.
-bool find_tile(doc::Tileset* tileset,
-               doc::ImageRef& tileImage,
-               doc::tile_index& tileIndex,
-               doc::tile_flags& tileFlags)
-{
-  // Find without flags
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = 0;
-    return true;
-  }
-
-  if (tileset->matchFlags() == 0) // In case we don't allow flipped tiles
-    return false;
-
-  DoFlip x(tileImage, doc::algorithm::FlipHorizontal);
-
-  // Find with X flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    x.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip;
-      return true;
-    }
-    x.reset();
-  }
-
-  // Find with Y flip
-  DoFlip y(tileImage, doc::algorithm::FlipVertical);
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    y.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_yflip;
-      return true;
-    }
-
-    if (tileset->matchFlags() & doc::tile_f_xflip) {
-      // Find with X+Y flip
-      x.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip;
-        return true;
-      }
-      x.reset();
-    }
-    y.reset();
-  }
-
-  // Check if we can match diagonal flips
-  if ((tileset->matchFlags() & doc::tile_f_dflip) == 0)
-    return false;
-
-  // Find with D flip
-  DoFlip d(tileImage, doc::algorithm::FlipDiagonal);
-  d.flip();
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = doc::tile_f_dflip;
-    return true;
-  }
-
-  // Find with X+D flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    d.reset();
-    x.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip | doc::tile_f_dflip;
-      return true;
-    }
-
-    // Find with X+Y+D flip
-    if (tileset->matchFlags() & doc::tile_f_yflip) {
-      d.reset();
-      y.flip();
-      d.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip | doc::tile_f_dflip;
-        return true;
-      }
-    }
-  }
+// A tile of the source image that is converted to a tilemap entry in
+// draw_image_into_new_tilemap_cel().
+struct TileToConvert {
+  gfx::Point tilePt;
+  ImageRef tileImage;
+  tile_index tileIndex = notile;
+  tile_flags tileFlags = 0;
+  bool found = false;
 
-  // Find with Y+D flip only
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    d.reset();
-    x.reset();
-    if (!y)
-      y.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags =  doc::tile_f_yflip | doc::tile_f_dflip;
-      return true;
-    }
-  }
+  TileToConvert(const gfx::Point& tilePt) : tilePt(tilePt) { }
+};
 
-  // DoFlip destructors will reset the image.
-  return false;
-}
+// Minimum number of tiles to process in each thread when we convert
+// an image to a tilemap.
+const int kMinTilesPerThread = 256;
 
 } // anonymous namespace
 
-void create_region_with_differences(const Image* a,
-                                    const Image* b,
-                                    const gfx::Rect& bounds,
-                                    gfx::Region& output)
-{
-  ASSERT(a->pixelFormat() == b->pixelFormat());
-  switch (a->pixelFormat()) {
-    case IMAGE_RGB: create_region_with_differences_templ<RgbTraits>(a, b, bounds, output); break;
-    case IMAGE_GRAYSCALE: create_region_with_differences_templ<GrayscaleTraits>(a, b, bounds, output); break;
-    case IMAGE_INDEXED: create_region_with_differences_templ<IndexedTraits>(a, b, bounds, output); break;
-  }
-}
-
 static void remove_unused_tiles_from_tileset(
   CmdSequence* cmds,
   doc::Tileset* tileset,
-  std::vector<size_t>& tilesHistogram,
-  const std::vector<bool>& modifiedTileIndexes);
+  const std::vector<bool>& unusedTiles);
 
 doc::ImageRef crop_cel_image(
   const doc::Cel* cel,
@@ -519,24 +377,58 @@ void draw_image_into_new_tilemap_cel(
     ASSERT(tilemapBounds.h == newTilemap->height());
   }
 
-  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds))) {
-    const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePt);
-    doc::ImageRef tileImage(
-      doc::crop_image(srcImage,
-                      tilePtInCanvas.x-srcImagePos.x,
-                      tilePtInCanvas.y-srcImagePos.y,
-                      tileSize.w, tileSize.h,
-                      srcImage->maskColor()));
-    if (grid.hasMask())
-      mask_image(tileImage.get(), grid.mask().get());
+  std::vector<TileToConvert> tiles;
+  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds)))
+    tiles.push_back(TileToConvert(tilePt));
+
+  // Crop each tile from the source image and search it in the
+  // existent tiles of the tileset. This can be done in parallel as
+  // the tileset is not modified in this step.
+  tileset->prepareToFindTiles();
+
+  auto findTiles = [&tiles, &grid, tileSize, tileset,
+                    srcImage, srcImagePos](const int begin,
+                                           const int end) {
+    for (int i=begin; i<end; ++i) {
+      TileToConvert& tile = tiles[i];
+      const gfx::Point tilePtInCanvas = grid.tileToCanvas(tile.tilePt);
+      tile.tileImage.reset(
+        doc::crop_image(srcImage,
+                        tilePtInCanvas.x-srcImagePos.x,
+                        tilePtInCanvas.y-srcImagePos.y,
+                        tileSize.w, tileSize.h,
+                        srcImage->maskColor()));
+      if (grid.hasMask())
+        mask_image(tile.tileImage.get(), grid.mask().get());
+
+      preprocess_transparent_pixels(tile.tileImage.get());
+
+      tile.found = tileset->findTileIndex(tile.tileImage,
+                                          tile.tileIndex,
+                                          tile.tileFlags);
 
-    preprocess_transparent_pixels(tileImage.get());
+      // We don't need the image of tiles that were found without
+      // flips (it's just memory for big images)
+      if (tile.found && tile.tileFlags == 0)
+        tile.tileImage.reset();
+    }
+  };
+
+  doc::parallel_for(int(tiles.size()), kMinTilesPerThread, findTiles);
 
-    doc::tile_index tileIndex;
-    doc::tile_flags tileFlag = 0;
+  // Add new tiles in the same order as tiles appear in the image (so
+  // the result is deterministic).
+  bool newTiles = false;
+  for (const TileToConvert& tile : tiles) {
+    doc::tile_index tileIndex = tile.tileIndex;
+    doc::tile_flags tileFlag = tile.tileFlags;
 
-    if (!find_tile(tileset, tileImage, tileIndex, tileFlag)) {
-      auto addTile = new cmd::AddTile(tileset, tileImage);
+    // Tiles that weren't found can be a new tile that we've just
+    // added, and flipped tiles could match a new tile with a
+    // preferred flip, so we search them again.
+    if ((!tile.found || (tile.tileFlags != 0 && newTiles)) &&
+        !tileset->findTileIndex(tile.tileImage, tileIndex, tileFlag)) {
+      auto addTile = new cmd::AddTile(tileset, tile.tileImage);
 
       if (cmds)
         cmds->executeAndAdd(addTile);
@@ -546,6 +438,7 @@ void draw_image_into_new_tilemap_cel(
       }
 
       tileIndex = addTile->tileIndex();
+      newTiles = true;
 
       if (!cmds)
         delete addTile;
@@ -557,8 +450,8 @@ void draw_image_into_new_tilemap_cel(
     // crash report about an "access violation". So now we've added
     // some checks to the operation.
     {
-      const int u = tilePt.x-tilemapBounds.x;
-      const int v = tilePt.y-tilemapBounds.y;
+      const int u = tile.tilePt.x-tilemapBounds.x;
+      const int v = tile.tilePt.y-tilemapBounds.y;
       ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
       doc::put_pixel(newTilemap.get(), u, v,
                      doc::tile(tileIndex, tileFlag));
@@ -646,18 +539,23 @@ void modify_tilemap_cel_region(
     regionToPatch -= gfx::Region(grid.tileToCanvas(oldTilemapBounds));
     regionToPatch |= region;
 
-    std::vector<bool> modifiedTileIndexes(tileset->size(), false);
-    std::vector<size_t> tilesHistogram(tileset->size(), 0);
-    if (tilesetMode == TilesetMode::Auto) {
-      for_each_tile_using_tileset(
-        tileset, [tileset, &tilesHistogram](const doc::tile_t t){
-                   if (t != doc::notile) {
-                     doc::tile_index ti = doc::tile_geti(t);
-                     if (ti >= 0 && ti < tileset->size())
-                       ++tilesHistogram[ti];
-                   }
-                 });
-    }
+    const doc::tile_index tilesetSize = tileset->size();
+
+    // References to each tile before this modification (kept updated
+    // by the cmds that modify tilemaps) and the changes made in this
+    // modification (only for the modified tiles).
+    const std::vector<size_t>* usedTiles = nullptr;
+    std::map<doc::tile_index, int> tilesDelta;
+    if (tilesetMode == TilesetMode::Auto)
+      usedTiles = &tileset->tilesHistogram();
+
+    auto tileRefs = [usedTiles, &tilesDelta](const doc::tile_index ti) -> size_t {
+      size_t refs = (ti < usedTiles->size() ? (*usedTiles)[ti]: 0);
+      auto it = tilesDelta.find(ti);
+      if (it != tilesDelta.end())
+        refs += it->second;
+      return refs;
+    };
 
     for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(regionToPatch)) {
       const int u = tilePt.x-newTilemapBounds.x;
@@ -683,15 +581,15 @@ void modify_tilemap_cel_region(
       doc::tile_index tileIndex;
       doc::tile_flags tileFlag = 0;
 
-      if (find_tile(tileset, tileImage, tileIndex, tileFlag)) {
+      if (tileset->findTileIndex(tileImage, tileIndex, tileFlag)) {
         // We can re-use an existent tile (tileIndex) from the tileset
       }
       else if (tilesetMode == TilesetMode::Auto &&
                t != doc::notile &&
-               ti >= 0 && ti < tilesHistogram.size() &&
+               ti >= 0 && ti < tilesetSize &&
                // If the tile is just used once, we can modify this
                // same tile
-               tilesHistogram[ti] == 1) {
+               tileRefs(ti) == 1) {
         // Common case: Re-utilize the same tile in Auto mode.
         tileIndex = ti;
         cmds->executeAndAdd(
@@ -712,17 +610,15 @@ void modify_tilemap_cel_region(
       }
 
       // If the tile changed, we have to remove the old tile index
-      // (ti) from the histogram count.
+      // (ti) from the histogram count. It indicates that the tile
+      // "ti" was modified to "tileIndex", so then, in case that we
+      // have to remove tiles, we can check the ones that were
+      // modified & are unused.
       if (tilesetMode == TilesetMode::Auto &&
           t != doc::notile &&
-          ti >= 0 && ti < tilesHistogram.size() &&
+          ti >= 0 && ti < tilesetSize &&
           ti != tileIndex) {
-        --tilesHistogram[ti];
-
-        // It indicates that the tile "ti" was modified to
-        // "tileIndex", so then, in case that we have to remove tiles,
-        // we can check the ones that were modified & are unused.
-        modifiedTileIndexes[ti] = true;
+        --tilesDelta[ti];
       }
 
       OPS_TRACE(" - tile %d -> %d\n",
@@ -737,13 +633,25 @@ void modify_tilemap_cel_region(
         // We add the new one tileIndex in the histogram count.
         if (tilesetMode == TilesetMode::Auto &&
             tile != doc::notile &&
-            tileIndex >= 0 && tileIndex < tilesHistogram.size() &&
+            tileIndex >= 0 && tileIndex < tilesetSize &&
             ti != tileIndex) {
-          ++tilesHistogram[tileIndex];
+          ++tilesDelta[tileIndex];
         }
       }
     }
 
+    // Modified tiles that aren't used anymore (this must be
+    // calculated before modifying the tilemap, as the tileset
+    // histogram is updated by the cmds)
+    std::vector<bool> unusedTiles;
+    if (tilesetMode == TilesetMode::Auto) {
+      unusedTiles.resize(tilesetSize, false);
+      for (const auto& it : tilesDelta) {
+        if (it.second < 0 && tileRefs(it.first) == 0)
+          unusedTiles[it.first] = true;
+      }
+    }
+
     if (newTilemap->width() != cel->image()->width() ||
         newTilemap->height() != cel->image()->height()) {
       gfx::Point newPos = grid.tileToCanvas(newTilemapBounds.origin());
@@ -756,19 +664,17 @@ void modify_tilemap_cel_region(
     }
     else if (!tilePtsRgn.isEmpty()) {
       cmds->executeAndAdd(
-        new cmd::CopyRegion(
+        new cmd::CopyTilemapRegion(
           cel->image(),
           newTilemap.get(),
           tilePtsRgn,
-          gfx::Point(0, 0)));
+          gfx::Point(0, 0),
+          tilemapLayer->tileset()));
     }
 
     // Remove unused tiles
-    if (tilesetMode == TilesetMode::Auto) {
-      remove_unused_tiles_from_tileset(cmds, tileset,
-                                       tilesHistogram,
-                                       modifiedTileIndexes);
-    }
+    if (tilesetMode == TilesetMode::Auto)
+      remove_unused_tiles_from_tileset(cmds, tileset, unusedTiles);
 
     doc->notifyTilesetChanged(tileset);
   }
@@ -951,41 +857,36 @@ void clear_mask_from_cel(CmdSequence* cmds,
 static void remove_unused_tiles_from_tileset(
   CmdSequence* cmds,
   doc::Tileset* tileset,
-  std::vector<size_t>& tilesHistogram,
-  const std::vector<bool>& modifiedTileIndexes)
+  const std::vector<bool>& unusedTiles)
 {
   OPS_TRACE("remove_unused_tiles_from_tileset\n");
 
-  int n = tileset->size();
+  // Tiles used after the modification of the tilemaps (the histogram
+  // was updated by the cmds that modified the tilemaps)
+  const std::vector<size_t>& usedTiles = tileset->tilesHistogram();
+  const int n = std::max<int>(tileset->size(), usedTiles.size());
+
 #ifdef _DEBUG
   // Histogram just to check that we've a correct tilesHistogram
-  std::vector<size_t> tilesHistogram2(n, 0);
-#endif
-
+  std::vector<size_t> tilesHistogram2(tileset->size(), 0);
   for_each_tile_using_tileset(
     tileset,
-    [&n
-#ifdef _DEBUG
-     , &tilesHistogram2
-#endif
-     ](const doc::tile_t t){
+    [&tilesHistogram2](const doc::tile_t t){
       if (t != doc::notile) {
         const doc::tile_index ti = doc::tile_geti(t);
-        n = std::max<int>(n, ti+1);
-#ifdef _DEBUG
         // This check is necessary in case the tilemap has a reference
         // to a tile outside the valid range (e.g. when we resize the
         // tileset deleting tiles that will not be present anymore)
         if (ti >= 0 && ti < tilesHistogram2.size())
           ++tilesHistogram2[ti];
-#endif
       }
     });
 
-#ifdef _DEBUG
-  for (int k=0; k<tilesHistogram.size(); ++k) {
-    OPS_TRACE("comparing [%d] -> %d vs %d\n", k, tilesHistogram[k], tilesHistogram2[k]);
-    ASSERT(tilesHistogram[k] == tilesHistogram2[k]);
+  for (int k=0; k<tilesHistogram2.size(); ++k) {
+    OPS_TRACE("comparing [%d] -> %d vs %d\n", k,
+              (k < usedTiles.size() ? usedTiles[k]: 0), tilesHistogram2[k]);
+    ASSERT(tilesHistogram2[k] == (k < usedTiles.size() ? usedTiles[k]: 0));
+    ASSERT(k >= unusedTiles.size() || !unusedTiles[k] || tilesHistogram2[k] == 0);
   }
 #endif
 
@@ -993,11 +894,9 @@ static void remove_unused_tiles_from_tileset(
   doc::tile_index ti, tj;
   ti = tj = 0;
   for (; ti<remap.size(); ++ti) {
-    OPS_TRACE(" - ti=%d tj=%d tilesHistogram[%d]=%d\n",
-              ti, tj, ti, (ti < tilesHistogram.size() ? tilesHistogram[ti]: 0));
-    if (ti < tilesHistogram.size() &&
-        tilesHistogram[ti] == 0 &&
-        modifiedTileIndexes[ti]) {
+    OPS_TRACE(" - ti=%d tj=%d unused=%d\n",
+              ti, tj, (ti < unusedTiles.size() ? int(unusedTiles[ti]): 0));
+    if (ti < unusedTiles.size() && unusedTiles[ti]) {
       cmds->executeAndAdd(new cmd::RemoveTile(tileset, tj));
       // Map to nothing, so the map can be invertible
       remap.notile(ti);
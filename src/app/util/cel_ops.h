@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -35,11 +35,6 @@ namespace app {
   typedef std::function<doc::ImageRef(const doc::ImageRef& origTile,
                                       const gfx::Rect& tileBoundsInCanvas)> GetTileImageFunc;
 
-  void create_region_with_differences(const doc::Image* a,
-                                      const doc::Image* b,
-                                      const gfx::Rect& bounds,
-                                      gfx::Region& output);
-
   // Creates a new image of the given cel
   doc::ImageRef crop_cel_image(
     const doc::Cel* cel,
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2023  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This program is distributed under the terms of
@@ -21,8 +21,13 @@
 #include "os/surface_format.h"
 
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
+
 namespace app {
 
 using namespace doc;
@@ -53,29 +58,37 @@ uint32_t convert_color_to_surface<GrayscaleTraits, os::kRgbaSurfaceFormat>(color
     ((graya_geta(c) << fd->alphaShift) & fd->alphaMask);
 }
 
-template<>
-uint32_t convert_color_to_surface<IndexedTraits, os::kRgbaSurfaceFormat>(color_t c0, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  color_t c = (c0 == spec.maskColor() ? 0 : palette->getEntry(c0));
-  return
-    ((rgba_getr(c) << fd->redShift  ) & fd->redMask  ) |
-    ((rgba_getg(c) << fd->greenShift) & fd->greenMask) |
-    ((rgba_getb(c) << fd->blueShift ) & fd->blueMask ) |
-    ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
-}
+// Surface values for each palette entry precalculated, so indexed
+// and bitmap images can be converted with just one table lookup per
+// pixel (without the palette access and the mask color check).
+class PaletteLut {
+public:
+  PaletteLut(const Palette* palette,
+             const ImageSpec& spec,
+             const os::SurfaceFormatData* fd) {
+    for (int i=0; i<int(m_lut.size()); ++i)
+      m_lut[i] = convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(
+        palette->getEntry(i), palette, spec, fd);
+
+    if (spec.colorMode() == ColorMode::INDEXED) {
+      const color_t mask = spec.maskColor();
+      if (mask >= 0 && mask < int(m_lut.size()))
+        m_lut[mask] = convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(
+          0, palette, spec, fd);
+    }
+  }
 
-template<>
-uint32_t convert_color_to_surface<BitmapTraits, os::kRgbaSurfaceFormat>(color_t c0, const Palette* palette, const ImageSpec& spec, const os::SurfaceFormatData* fd) {
-  color_t c = palette->getEntry(c0);
-  return
-    ((rgba_getr(c) << fd->redShift  ) & fd->redMask  ) |
-    ((rgba_getg(c) << fd->greenShift) & fd->greenMask) |
-    ((rgba_getb(c) << fd->blueShift ) & fd->blueMask ) |
-    ((rgba_geta(c) << fd->alphaShift) & fd->alphaMask);
-}
+  uint32_t operator()(color_t c) const {
+    return m_lut[c & 0xff];
+  }
 
-template<typename ImageTraits, typename AddressType>
+private:
+  std::array<uint32_t, 256> m_lut;
+};
+
+template<typename ImageTraits, typename AddressType, typename Converter>
 void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
-  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Converter& convert)
 {
   const LockImageBits<ImageTraits> bits(image, gfx::Rect(src_x, src_y, w, h));
   typename LockImageBits<ImageTraits>::const_iterator src_it = bits.begin();
@@ -88,7 +101,7 @@ void convert_image_to_surface_templ(const Image* image, os::Surface* dst,
     for (int u=0; u<w; ++u) {
       ASSERT(src_it != src_end);
 
-      *dst_address = convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(*src_it, palette, image->spec(), fd);
+      *dst_address = convert(*src_it);
       ++dst_address;
       ++src_it;
     }
@@ -107,31 +120,128 @@ struct Address24bpp
   }
 };
 
-template<typename ImageTraits>
+template<typename ImageTraits, typename Converter>
 void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
-  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const os::SurfaceFormatData* fd,
+  const Converter& convert)
 {
   switch (fd->bitsPerPixel) {
 
     case 8:
-      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint8_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 15:
     case 16:
-      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint16_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 24:
-      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, Address24bpp>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
 
     case 32:
-      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, fd);
+      convert_image_to_surface_templ<ImageTraits, uint32_t*>(image, surface, src_x, src_y, dst_x, dst_y, w, h, convert);
       break;
   }
 }
 
+template<typename ImageTraits>
+void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
+  int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
+{
+  const ImageSpec& spec = image->spec();
+  convert_image_to_surface_selector<ImageTraits>(
+    image, surface, src_x, src_y, dst_x, dst_y, w, h, fd,
+    [palette, &spec, fd](color_t c) -> uint32_t {
+      return convert_color_to_surface<ImageTraits, os::kRgbaSurfaceFormat>(c, palette, spec, fd);
+    });
+}
+
+// True if the surface is 32bpp with 8-bit channels in the same
+// order as doc::rgba() colors.
+bool is_rgba_surface(const os::SurfaceFormatData& fd)
+{
+  return (fd.bitsPerPixel == 32 &&
+          gfx::ColorRShift == fd.redShift &&
+          gfx::ColorGShift == fd.greenShift &&
+          gfx::ColorBShift == fd.blueShift &&
+          gfx::ColorAShift == fd.alphaShift);
+}
+
+// True if the surface is 32bpp with 8-bit channels in BGRA order
+// (red and blue swapped).
+bool is_bgra_surface(const os::SurfaceFormatData& fd)
+{
+  return (fd.bitsPerPixel == 32 &&
+          gfx::ColorBShift == fd.redShift &&
+          gfx::ColorGShift == fd.greenShift &&
+          gfx::ColorRShift == fd.blueShift &&
+          gfx::ColorAShift == fd.alphaShift);
+}
+
+// Converts a row of RGBA pixels to BGRA swapping the R/B bytes.
+void convert_rgba_row_to_bgra(const uint32_t* src, uint32_t* dst, int w)
+{
+  int x = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+  // Use SSE2
+  const __m128i gaMask = _mm_set1_epi32(0xff00ff00);
+  const __m128i rbMask = _mm_set1_epi32(0x000000ff);
+  for (; x+4<=w; x+=4, src+=4, dst+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)src);
+    const __m128i ga = _mm_and_si128(c, gaMask);
+    const __m128i r = _mm_and_si128(c, rbMask);
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(c, 16), rbMask);
+    _mm_storeu_si128((__m128i*)dst,
+                     _mm_or_si128(ga, _mm_or_si128(_mm_slli_epi32(r, 16), b)));
+  }
+#endif
+  for (; x<w; ++x, ++src, ++dst) {
+    const uint32_t c = *src;
+    *dst = (c & 0xff00ff00) | ((c & 0xff) << 16) | ((c >> 16) & 0xff);
+  }
+}
+
+// Converts a row of gray+alpha pixels to RGBA or BGRA (as R=G=B, both
+// layouts produce the same bytes).
+void convert_gray_row_to_rgba(const uint16_t* src, uint32_t* dst, int w)
+{
+  int x = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+  // Use SSE2: each gray pixel is (v | a<<8), so we interleave (v | v<<8)
+  // in the low 16 bits with the original pixel in the high 16 bits.
+  const __m128i vMask = _mm_set1_epi16(0x00ff);
+  for (; x+8<=w; x+=8, src+=8, dst+=8) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)src);
+    __m128i vv = _mm_and_si128(c, vMask);
+    vv = _mm_or_si128(vv, _mm_slli_epi16(vv, 8));
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(vv, c));
+    _mm_storeu_si128((__m128i*)(dst+4), _mm_unpackhi_epi16(vv, c));
+  }
+#endif
+  for (; x<w; ++x, ++src, ++dst) {
+    const uint32_t v = graya_getv(*src);
+    const uint32_t a = graya_geta(*src);
+    *dst = (v * 0x010101) | (a << 24);
+  }
+}
+
+// Converts a row of 8-bit indexes with the palette lookup table.
+void convert_indexed_row_to_surface(const uint8_t* src, uint32_t* dst, int w,
+                                    const PaletteLut& lut)
+{
+  int x = 0;
+  for (; x+4<=w; x+=4, src+=4, dst+=4) {
+    dst[0] = lut(src[0]);
+    dst[1] = lut(src[1]);
+    dst[2] = lut(src[2]);
+    dst[3] = lut(src[3]);
+  }
+  for (; x<w; ++x, ++src, ++dst)
+    *dst = lut(*src);
+}
+
 } // anonymous namespace
 
 
@@ -169,14 +279,14 @@ void convert_image_to_surface(
   os::SurfaceFormatData fd;
   surface->getFormat(&fd);
 
+  const bool rgba = is_rgba_surface(fd);
+  const bool bgra = is_bgra_surface(fd);
+
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB:
-      // Fast path
-      if (gfx::ColorRShift == fd.redShift &&
-          gfx::ColorGShift == fd.greenShift &&
-          gfx::ColorBShift == fd.blueShift &&
-          gfx::ColorAShift == fd.alphaShift) {
+      // Fast paths
+      if (rgba) {
         for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
           uint8_t* src_address = image->getPixelAddress(src_x, src_y);
           uint8_t* dst_address = surface->getData(dst_x, dst_y);
@@ -186,20 +296,50 @@ void convert_image_to_surface(
         }
         return;
       }
+      if (bgra) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_rgba_row_to_bgra(
+            (const uint32_t*)image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w);
+        }
+        return;
+      }
       convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
     case IMAGE_GRAYSCALE:
+      // Fast path
+      if (rgba || bgra) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_gray_row_to_rgba(
+            (const uint16_t*)image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w);
+        }
+        return;
+      }
       convert_image_to_surface_selector<GrayscaleTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
-    case IMAGE_INDEXED:
-      convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+    case IMAGE_INDEXED: {
+      const PaletteLut lut(palette, image->spec(), &fd);
+      // Fast path
+      if (fd.bitsPerPixel == 32) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_indexed_row_to_surface(
+            image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w, lut);
+        }
+        return;
+      }
+      convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd, lut);
       break;
+    }
 
-    case IMAGE_BITMAP:
-      convert_image_to_surface_selector<BitmapTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
+    case IMAGE_BITMAP: {
+      const PaletteLut lut(palette, image->spec(), &fd);
+      convert_image_to_surface_selector<BitmapTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, &fd, lut);
       break;
+    }
 
     default:
       ASSERT(false);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -352,10 +352,10 @@ void ExpandCelCanvas::commit()
         // Patch tiles
         for (tile_index ti=1; ti<srcTileset->size(); ++ti) {
           gfx::Region diffRgn;
-          create_region_with_differences(srcTileset->get(ti).get(),
-                                         m_dstTileset->get(ti).get(),
-                                         m_dstTileset->get(ti)->bounds(),
-                                         diffRgn);
+          doc::create_region_with_differences(srcTileset->get(ti).get(),
+                                              m_dstTileset->get(ti).get(),
+                                              m_dstTileset->get(ti)->bounds(),
+                                              diffRgn);
           if (!diffRgn.isEmpty()) {
             m_cmds->executeAndAdd(
               new cmd::CopyTileRegion(
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2023  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -19,9 +19,12 @@ namespace app {
   // elements)
   class OpenBatchOfFiles {
   public:
+    // The given config is used to load files from a non-UI thread
+    // (nullptr = use the preferences).
     void open(Context* ctx,
               const std::string& fn,
-              const bool oneFrame) {
+              const bool oneFrame,
+              const FileOpConfig* config = nullptr) {
       Params params;
       params.set("filename", fn.c_str());
 
@@ -42,6 +45,7 @@ namespace app {
         }
       }
 
+      m_cmd.setFileOpConfig(config);
       if (ctx->isUIAvailable())
         ctx->executeCommandFromMenuOrShortcut(&m_cmd, params);
       else
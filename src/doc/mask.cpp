@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,10 +12,18 @@
 #include "doc/mask.h"
 
 #include "base/memory.h"
+#include "doc/cel.h"
 #include "doc/image_impl.h"
+#include "doc/parallel.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 
@@ -43,6 +51,206 @@ namespace {
     a.shrink();
   }
 
+  // Returns true if the union of both rectangles is a rectangle too.
+  bool union_is_rect(const gfx::Rect& a, const gfx::Rect& b) {
+    if (a.contains(b) || b.contains(a))
+      return true;
+    if (a.x == b.x && a.w == b.w)
+      return (a.y <= b.y2() && b.y <= a.y2());
+    if (a.y == b.y && a.h == b.h)
+      return (a.x <= b.x2() && b.x <= a.x2());
+    return false;
+  }
+
+  // Minimum number of rows that each thread processes in byColor()
+  const int kMinRowsPerThread = 64;
+
+  // Sets in "bits" one bit for each pixel of the "src" row that
+  // matches the given color with the given tolerance (the first
+  // pixel is the least significant bit, as in BitmapTraits).
+  template<typename ImageTraits>
+  void match_row_by_color(const typename ImageTraits::pixel_t* src, int w,
+                          color_t color, int fuzziness, uint8_t* bits) {
+    static_assert(false && sizeof(ImageTraits), "Invalid image format");
+  }
+
+  inline int abs_diff(int a, int b) {
+    return (a > b ? a - b: b - a);
+  }
+
+  template<>
+  void match_row_by_color<RgbTraits>(const uint32_t* src, int w,
+                                     color_t color, int fuzziness, uint8_t* bits) {
+    int x = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+    // Use SSE2 to compare 8 pixels at the same time
+    const __m128i c = _mm_set1_epi32(int(color));
+    const __m128i f = _mm_set1_epi8(char(fuzziness));
+    const __m128i ones = _mm_set1_epi32(-1);
+    auto match4 = [&](const uint32_t* p) -> int {
+      const __m128i v = _mm_loadu_si128((const __m128i*)p);
+      const __m128i d = _mm_or_si128(_mm_subs_epu8(v, c), _mm_subs_epu8(c, v));
+      // All channels with difference <= fuzziness
+      __m128i ok = _mm_cmpeq_epi8(_mm_max_epu8(d, f), f);
+      ok = _mm_cmpeq_epi32(ok, ones);
+      return _mm_movemask_ps(_mm_castsi128_ps(ok));
+    };
+    for (; x+8<=w; x+=8)
+      bits[x/8] = uint8_t(match4(src+x) | (match4(src+x+4) << 4));
+#endif
+    std::fill(bits+x/8, bits+(w+7)/8, 0);
+
+    const int r = rgba_getr(color);
+    const int g = rgba_getg(color);
+    const int b = rgba_getb(color);
+    const int a = rgba_geta(color);
+    for (; x<w; ++x) {
+      const color_t c = src[x];
+      if (abs_diff(rgba_getr(c), r) <= fuzziness &&
+          abs_diff(rgba_getg(c), g) <= fuzziness &&
+          abs_diff(rgba_getb(c), b) <= fuzziness &&
+          abs_diff(rgba_geta(c), a) <= fuzziness)
+        bits[x/8] |= (1 << (x & 7));
+    }
+  }
+
+  template<>
+  void match_row_by_color<GrayscaleTraits>(const uint16_t* src, int w,
+                                           color_t color, int fuzziness, uint8_t* bits) {
+    int x = 0;
+#if defined(__x86_64__) || defined(_WIN64)
+    // Use SSE2 to compare 8 pixels at the same time
+    const __m128i c = _mm_set1_epi16(short(color));
+    const __m128i f = _mm_set1_epi8(char(fuzziness));
+    const __m128i ones = _mm_set1_epi16(-1);
+    const __m128i zero = _mm_setzero_si128();
+    for (; x+8<=w; x+=8) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(src+x));
+      const __m128i d = _mm_or_si128(_mm_subs_epu8(v, c), _mm_subs_epu8(c, v));
+      __m128i ok = _mm_cmpeq_epi8(_mm_max_epu8(d, f), f);
+      ok = _mm_cmpeq_epi16(ok, ones);
+      bits[x/8] = uint8_t(_mm_movemask_epi8(_mm_packs_epi16(ok, zero)));
+    }
+#endif
+    std::fill(bits+x/8, bits+(w+7)/8, 0);
+
+    const int k = graya_getv(color);
+    const int a = graya_geta(color);
+    for (; x<w; ++x) {
+      const color_t c = src[x];
+      if (abs_diff(graya_getv(c), k) <= fuzziness &&
+          abs_diff(graya_geta(c), a) <= fuzziness)
+        bits[x/8] |= (1 << (x & 7));
+    }
+  }
+
+  template<>
+  void match_row_by_color<IndexedTraits>(const uint8_t* src, int w,
+                                         color_t color, int fuzziness, uint8_t* bits) {
+    int x = 0;
+    // Indexes outside [0,255] cannot be compared with 8-bit lanes
+    if (color <= 255) {
+#if defined(__x86_64__) || defined(_WIN64)
+      // Use SSE2 to compare 16 pixels at the same time
+      const __m128i c = _mm_set1_epi8(char(color));
+      const __m128i f = _mm_set1_epi8(char(fuzziness));
+      for (; x+16<=w; x+=16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src+x));
+        const __m128i d = _mm_or_si128(_mm_subs_epu8(v, c), _mm_subs_epu8(c, v));
+        const int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(d, f), f));
+        bits[x/8] = uint8_t(m & 0xff);
+        bits[x/8+1] = uint8_t(m >> 8);
+      }
+#endif
+    }
+    std::fill(bits+x/8, bits+(w+7)/8, 0);
+
+    for (; x<w; ++x) {
+      if (abs_diff(src[x], int(color)) <= fuzziness)
+        bits[x/8] |= (1 << (x & 7));
+    }
+  }
+
+  // Copies (or ORs if "accumulate" is true) the "bits" of a row with
+  // "w" pixels in the given "dst" bitmap row starting at pixel "dx".
+  void put_row_bits(uint8_t* bits, int w, uint8_t* dst, int dx, bool accumulate) {
+    const int nbytes = (w+7)/8;
+    // Clear bits after the last pixel
+    if (w & 7)
+      bits[nbytes-1] &= uint8_t((1 << (w & 7)) - 1);
+
+    dst += dx / 8;
+    const int shift = (dx & 7);
+    if (!accumulate) {
+      ASSERT(shift == 0);
+      std::copy(bits, bits+nbytes, dst);
+    }
+    else if (shift == 0) {
+      for (int i=0; i<nbytes; ++i)
+        dst[i] |= bits[i];
+    }
+    else {
+      // Last byte of "dst" that can be modified
+      const int last = ((dx & 7) + w - 1) / 8;
+      for (int i=0; i<nbytes; ++i) {
+        dst[i] |= uint8_t(bits[i] << shift);
+        if (i+1 <= last)
+          dst[i+1] |= uint8_t(bits[i] >> (8-shift));
+      }
+    }
+  }
+
+  template<typename ImageTraits>
+  void mask_rows_by_color(const Image* src, Image* dst, const gfx::Point& offset,
+                          color_t color, int fuzziness, bool accumulate,
+                          int y1, int y2) {
+    const int w = src->width();
+    std::vector<uint8_t> bits((w+7)/8);
+    for (int y=y1; y<y2; ++y) {
+      match_row_by_color<ImageTraits>(
+        (const typename ImageTraits::pixel_t*)src->getPixelAddress(0, y),
+        w, color, fuzziness, bits.data());
+      put_row_bits(bits.data(), w,
+                   dst->getPixelAddress(0, offset.y+y), offset.x,
+                   accumulate);
+    }
+  }
+
+  // Sets the pixels of the "dst" bitmap (at the given offset) that
+  // match the given color in the "src" image. Rows are processed in
+  // bands by several threads.
+  template<typename ImageTraits>
+  void mask_image_by_color_templ(const Image* src, Image* dst, const gfx::Point& offset,
+                                 color_t color, int fuzziness, bool accumulate) {
+    parallel_for(
+      src->height(), kMinRowsPerThread,
+      [=](const int y1, const int y2){
+        mask_rows_by_color<ImageTraits>(src, dst, offset, color, fuzziness,
+                                        accumulate, y1, y2);
+      });
+  }
+
+  void mask_image_by_color(const Image* src, Image* dst, const gfx::Point& offset,
+                           color_t color, int fuzziness, bool accumulate) {
+    switch (src->pixelFormat()) {
+      case IMAGE_RGB:
+        mask_image_by_color_templ<RgbTraits>(src, dst, offset, color, fuzziness, accumulate);
+        break;
+      case IMAGE_GRAYSCALE:
+        mask_image_by_color_templ<GrayscaleTraits>(src, dst, offset, color, fuzziness, accumulate);
+        break;
+      case IMAGE_INDEXED:
+        mask_image_by_color_templ<IndexedTraits>(src, dst, offset, color, fuzziness, accumulate);
+        break;
+      default:
+        // Other formats select the whole image
+        fill_rect(dst, offset.x, offset.y,
+                  offset.x+src->width()-1,
+                  offset.y+src->height()-1, 1);
+        break;
+    }
+  }
+
 } // namespace namespace
 
 Mask::Mask()
@@ -98,7 +306,7 @@ void Mask::unfreeze()
 bool Mask::isRectangular() const
 {
   if (!m_bitmap)
-    return false;
+    return !m_bounds.isEmpty();
 
   LockImageBits<BitmapTraits> bits(m_bitmap.get());
   LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
@@ -118,14 +326,14 @@ void Mask::copyFrom(const Mask* sourceMask)
   clear();
   setName(sourceMask->name().c_str());
 
-  if (sourceMask->bitmap()) {
+  if (!sourceMask->isEmpty()) {
     // Add all the area of "mask"
     add(sourceMask->bounds());
 
-    // And copy the "mask" bitmap (m_bitmap can be nullptr if this is
-    // frozen, so add() doesn't created the bitmap)
-    if (m_bitmap)
-      copy_image(m_bitmap.get(), sourceMask->m_bitmap.get());
+    // And copy the "mask" bitmap (this mask can be empty if it's
+    // frozen, so add() doesn't add the area)
+    if (!isEmpty() && sourceMask->m_bitmap)
+      m_bitmap.reset(Image::createCopy(sourceMask->m_bitmap.get()));
   }
 }
 
@@ -137,13 +345,21 @@ void Mask::offsetOrigin(int dx, int dy)
 void Mask::clear()
 {
   m_bitmap.reset();
+  m_rectBitmap.reset();
   m_bounds = gfx::Rect(0, 0, 0, 0);
 }
 
 void Mask::invert()
 {
-  if (!m_bitmap)
+  if (isEmpty())
+    return;
+
+  // All pixels of a plain rectangle are unselected
+  if (!m_bitmap && m_freeze_count == 0) {
+    clear();
     return;
+  }
+  materialize();
 
   LockImageBits<BitmapTraits> bits(m_bitmap.get());
   LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
@@ -161,14 +377,18 @@ void Mask::replace(const gfx::Rect& bounds)
     return;
   }
 
+  // The bitmap is created when it's needed
   m_bounds = bounds;
-
-  m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
-  clear_image(m_bitmap.get(), 1);
+  m_bitmap.reset();
 }
 
 void Mask::add(const doc::Mask& mask)
 {
+  if (mask.isPlainRectangle() && m_freeze_count == 0) {
+    add(mask.bounds());
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -178,6 +398,11 @@ void Mask::add(const doc::Mask& mask)
 
 void Mask::subtract(const doc::Mask& mask)
 {
+  if (mask.isPlainRectangle() && m_freeze_count == 0) {
+    subtract(mask.bounds());
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -190,6 +415,11 @@ void Mask::subtract(const doc::Mask& mask)
 
 void Mask::intersect(const doc::Mask& mask)
 {
+  if (mask.isPlainRectangle() && m_freeze_count == 0) {
+    intersect(mask.bounds());
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -199,13 +429,29 @@ void Mask::intersect(const doc::Mask& mask)
 
 void Mask::add(const gfx::Rect& bounds)
 {
-  if (m_freeze_count == 0)
+  if (bounds.isEmpty())
+    return;
+
+  if (m_freeze_count == 0) {
+    // Keep plain rectangles without bitmap
+    if (isEmpty()) {
+      m_bounds = bounds;
+      m_bitmap.reset();
+      return;
+    }
+    if (!m_bitmap && union_is_rect(m_bounds, bounds)) {
+      m_bounds |= bounds;
+      return;
+    }
     reserve(bounds);
+  }
 
-  // m_bitmap can be nullptr if we have m_freeze_count > 0
-  if (!m_bitmap)
+  // The mask can be empty if we have m_freeze_count > 0
+  if (isEmpty())
     return;
 
+  materialize();
+
   fill_rect(m_bitmap.get(),
             bounds.x-m_bounds.x,
             bounds.y-m_bounds.y,
@@ -215,9 +461,42 @@ void Mask::add(const gfx::Rect& bounds)
 
 void Mask::subtract(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty() || !m_bounds.intersects(bounds))
     return;
 
+  // Plain rectangles keep being rectangles if a whole side is
+  // removed
+  if (!m_bitmap && m_freeze_count == 0) {
+    const gfx::Rect& rc = m_bounds;
+    if (bounds.contains(rc)) {
+      clear();
+      return;
+    }
+    if (bounds.x <= rc.x && bounds.x2() >= rc.x2()) {
+      if (bounds.y <= rc.y) {
+        m_bounds.h = rc.y2() - bounds.y2();
+        m_bounds.y = bounds.y2();
+        return;
+      }
+      if (bounds.y2() >= rc.y2()) {
+        m_bounds.h = bounds.y - rc.y;
+        return;
+      }
+    }
+    if (bounds.y <= rc.y && bounds.y2() >= rc.y2()) {
+      if (bounds.x <= rc.x) {
+        m_bounds.w = rc.x2() - bounds.x2();
+        m_bounds.x = bounds.x2();
+        return;
+      }
+      if (bounds.x2() >= rc.x2()) {
+        m_bounds.w = bounds.x - rc.x;
+        return;
+      }
+    }
+  }
+  materialize();
+
   fill_rect(m_bitmap.get(),
     bounds.x-m_bounds.x,
     bounds.y-m_bounds.y,
@@ -229,11 +508,20 @@ void Mask::subtract(const gfx::Rect& bounds)
 
 void Mask::intersect(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
   gfx::Rect newBounds = m_bounds.createIntersection(bounds);
 
+  // Plain rectangles just change their bounds
+  if (!m_bitmap) {
+    if (newBounds.isEmpty())
+      clear();
+    else
+      m_bounds = newBounds;
+    return;
+  }
+
   Image* image = NULL;
 
   if (!newBounds.isEmpty()) {
@@ -251,108 +539,34 @@ void Mask::intersect(const gfx::Rect& bounds)
   shrink();
 }
 
-void Mask::byColor(const Image *src, int color, int fuzziness)
+void Mask::byColor(const Image* src, int color, int fuzziness)
 {
-  replace(src->bounds());
-
-  Image* dst = m_bitmap.get();
-
-  switch (src->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      color_t c;
-
-      dst_r = rgba_getr(color);
-      dst_g = rgba_getg(color);
-      dst_b = rgba_getb(color);
-      dst_a = rgba_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_r = rgba_getr(c);
-        src_g = rgba_getg(c);
-        src_b = rgba_getb(c);
-        src_a = rgba_geta(c);
-
-        if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-              (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-              (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_k, src_a;
-      int dst_k, dst_a;
-      color_t c;
+  m_bounds = src->bounds();
+  m_bitmap.reset(Image::create(IMAGE_BITMAP, m_bounds.w, m_bounds.h, m_buffer));
 
-      dst_k = graya_getv(color);
-      dst_a = graya_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_k = graya_getv(c);
-        src_a = graya_geta(c);
-
-        if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
+  mask_image_by_color(src, m_bitmap.get(), gfx::Point(0, 0),
+                      color, fuzziness, false);
+  shrink();
+}
 
-    case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      color_t c, min, max;
+void Mask::byColor(const std::vector<const Cel*>& cels, int color, int fuzziness)
+{
+  clear();
 
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
+  gfx::Rect bounds;
+  for (const Cel* cel : cels)
+    bounds |= cel->bounds();
+  if (bounds.isEmpty())
+    return;
 
-        if (color > fuzziness)
-          min = color-fuzziness;
-        else
-          min = 0;
-        max = color + fuzziness;
+  // Create the bitmap for all cels just once
+  reserve(bounds);
 
-        if (!((c >= min) && (c <= max)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
+  for (const Cel* cel : cels) {
+    mask_image_by_color(cel->image(), m_bitmap.get(),
+                        cel->position() - bounds.origin(),
+                        color, fuzziness, true);
   }
-
   shrink();
 }
 
@@ -383,7 +597,7 @@ void Mask::crop(const Image *image)
   int done;
   color_t old_color;
 
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
   beg_x1 = m_bounds.x;
@@ -421,16 +635,44 @@ void Mask::crop(const Image *image)
 #undef ADVANCE
 }
 
+void Mask::createRectBitmap()
+{
+  ASSERT(!m_bitmap);
+  ASSERT(!m_bounds.isEmpty());
+
+  m_bitmap.reset(Image::create(IMAGE_BITMAP, m_bounds.w, m_bounds.h, m_buffer));
+  clear_image(m_bitmap.get(), 1);
+}
+
+const Image* Mask::rectBitmap() const
+{
+  ASSERT(!m_bitmap);
+  ASSERT(!m_bounds.isEmpty());
+
+  // The bitmap of a plain rectangle depends only on its size. It
+  // doesn't use m_buffer because it's not modified with m_bitmap.
+  std::lock_guard lock(m_rectBitmapMutex);
+  if (!m_rectBitmap ||
+      m_rectBitmap->width() != m_bounds.w ||
+      m_rectBitmap->height() != m_bounds.h) {
+    m_rectBitmap.reset(Image::create(IMAGE_BITMAP, m_bounds.w, m_bounds.h));
+    clear_image(m_rectBitmap.get(), 1);
+  }
+  return m_rectBitmap.get();
+}
+
 void Mask::reserve(const gfx::Rect& bounds)
 {
   ASSERT(!bounds.isEmpty());
 
-  if (!m_bitmap) {
+  if (isEmpty()) {
     m_bounds = bounds;
     m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
     clear_image(m_bitmap.get(), 0);
   }
   else {
+    materialize();
+
     gfx::Rect newBounds = m_bounds.createUnion(bounds);
 
     if (m_bounds != newBounds) {
@@ -452,6 +694,10 @@ void Mask::shrink()
   if (m_freeze_count > 0)
     return;
 
+  // Plain rectangles are already shrunk
+  if (!m_bitmap)
+    return;
+
 #define SHRINK_SIDE(u_begin, u_op, u_final, u_add,                      \
                     v_begin, v_op, v_final, v_add, U, V, var)           \
   {                                                                     \
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2023 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,9 +16,12 @@
 #include "doc/primitives.h"
 #include "gfx/rect.h"
 
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace doc {
+  class Cel;
 
   // Represents the selection (selected pixels, 0/1, 0=non-selected, 1=selected)
   //
@@ -34,21 +37,37 @@ namespace doc {
     void setName(const char *name);
     const std::string& name() const { return m_name; }
 
-    const Image* bitmap() const { return m_bitmap.get(); }
-    Image* bitmap() { return m_bitmap.get(); }
+    // Rectangular masks (e.g. "Select All" or a rectangular
+    // selection) don't have a bitmap until it's requested for the
+    // first time with these functions. The const version doesn't
+    // modify the mask (so it can be called from several threads),
+    // it returns a shared bitmap with all pixels selected.
+    const Image* bitmap() const {
+      if (m_bitmap || m_bounds.isEmpty())
+        return m_bitmap.get();
+      return rectBitmap();
+    }
+    Image* bitmap() { materialize(); return m_bitmap.get(); }
 
     // Returns true if the mask is completely empty (i.e. nothing
     // selected)
     bool isEmpty() const {
-      return (!m_bitmap ? true: false);
+      return m_bounds.isEmpty();
+    }
+
+    // Returns true if the mask is a rectangle that doesn't have a
+    // bitmap yet (all pixels inside the bounds are selected).
+    bool isPlainRectangle() const {
+      return (!m_bitmap && !m_bounds.isEmpty());
     }
 
     // Returns true if the point is inside the mask
     bool containsPoint(int u, int v) const {
-      return (m_bitmap.get() &&
+      return (!m_bounds.isEmpty() &&
               u >= m_bounds.x && u < m_bounds.x+m_bounds.w &&
               v >= m_bounds.y && v < m_bounds.y+m_bounds.h &&
-              get_pixel(m_bitmap.get(), u-m_bounds.x, v-m_bounds.y));
+              (!m_bitmap ||
+               get_pixel(m_bitmap.get(), u-m_bounds.x, v-m_bounds.y)));
     }
 
     gfx::Point origin() const { return m_bounds.origin(); }
@@ -93,6 +112,10 @@ namespace doc {
     void intersect(const gfx::Rect& bounds);
 
     void byColor(const Image* image, int color, int fuzziness);
+
+    // Selects the pixels that match the given color in all the given
+    // cels (e.g. the cels of one layer in several frames).
+    void byColor(const std::vector<const Cel*>& cels, int color, int fuzziness);
     void crop(const Image* image);
 
     // Reserves a rectangle to draw onto the bitmap (you should call
@@ -109,12 +132,24 @@ namespace doc {
   private:
     void initialize();
 
+    // Creates the bitmap of a plain rectangle mask
+    void materialize() {
+      if (!m_bitmap && !m_bounds.isEmpty())
+        createRectBitmap();
+    }
+    void createRectBitmap();
+    const Image* rectBitmap() const;
+
     int m_freeze_count;
     std::string m_name;           // Mask name
     gfx::Rect m_bounds;           // Region bounds
-    ImageRef m_bitmap;            // Bitmapped image mask
+    ImageRef m_bitmap;            // Bitmapped image mask (nullptr for empty or plain rectangle masks)
     ImageBufferPtr m_buffer;      // Buffer used in m_bitmap
 
+    // Bitmap returned by bitmap() const for plain rectangle masks
+    mutable std::mutex m_rectBitmapMutex;
+    mutable ImageRef m_rectBitmap;
+
     Mask& operator=(const Mask& mask);
   };
 
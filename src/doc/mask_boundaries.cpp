@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,14 +12,55 @@
 #include "doc/mask_boundaries.h"
 
 #include "doc/image_impl.h"
+#include "doc/primitives.h"
+#include "doc/primitives_fast.h"
+#include "gfx/region.h"
+
+#include <cstdint>
 
 namespace doc {
 
+namespace {
+
+// Returns the bounds of the area of "a" that is outside "c" ("c"
+// must be inside "a").
+gfx::Rect bounds_outside(const gfx::Rect& a, const gfx::Rect& c)
+{
+  if (c.isEmpty())
+    return a;
+  if (c == a)
+    return gfx::Rect();
+
+  gfx::Rect r = a;
+  // Only strips at the top/bottom
+  if (c.x == a.x && c.w == a.w) {
+    if (c.y == a.y) {
+      r.y = c.y2();
+      r.h = a.y2() - c.y2();
+    }
+    else if (c.y2() == a.y2())
+      r.h = c.y - a.y;
+  }
+  // Only strips at the left/right
+  else if (c.y == a.y && c.h == a.h) {
+    if (c.x == a.x) {
+      r.x = c.x2();
+      r.w = a.x2() - c.x2();
+    }
+    else if (c.x2() == a.x2())
+      r.w = c.x - a.x;
+  }
+  return r;
+}
+
+} // anonymous namespace
+
 void MaskBoundaries::reset()
 {
   m_segs.clear();
   if (!m_path.isEmpty())
     m_path.rewind();
+  m_bitmap.reset();
 }
 
 void MaskBoundaries::regen(const Image* bitmap)
@@ -339,12 +381,168 @@ void MaskBoundaries::regen(const Image* bitmap)
   ASSERT(prevIt == bits.end());
 }
 
+void MaskBoundaries::regen(const Image* bitmap, const gfx::Point& origin)
+{
+  const gfx::Rect newBounds(origin, bitmap->size());
+  gfx::Rect area;
+
+  if (m_bitmap) {
+    const gfx::Rect oldBounds(m_origin, m_bitmap->size());
+
+    // The bitmap was just moved
+    if (oldBounds.size() == newBounds.size() &&
+        is_same_image(m_bitmap.get(), bitmap)) {
+      if (origin != m_origin)
+        offset(origin.x - m_origin.x,
+               origin.y - m_origin.y);
+      return;
+    }
+
+    // Modified pixels inside the common area
+    const gfx::Rect common = (oldBounds & newBounds);
+    if (!common.isEmpty()) {
+      gfx::Region diff;
+      if (oldBounds == newBounds) {
+        create_region_with_differences(m_bitmap.get(), bitmap,
+                                       bitmap->bounds(), diff);
+      }
+      else {
+        const ImageRef a(crop_image(m_bitmap.get(),
+                                    gfx::Rect(common).offset(-m_origin), 0));
+        const ImageRef b(crop_image(bitmap,
+                                    gfx::Rect(common).offset(-origin), 0));
+        create_region_with_differences(a.get(), b.get(), a->bounds(), diff);
+      }
+      if (!diff.isEmpty())
+        area = diff.bounds().offset(common.origin());
+    }
+
+    // Pixels that are only in one of the bitmaps
+    area |= bounds_outside(oldBounds, common);
+    area |= bounds_outside(newBounds, common);
+  }
+
+  // Regenerate everything if there is no previous bitmap or the
+  // modified area is too big.
+  if (!m_bitmap ||
+      2 * std::int64_t(area.w) * area.h > std::int64_t(newBounds.w) * newBounds.h) {
+    regen(bitmap);
+    offset(origin.x, origin.y);
+  }
+  else if (!area.isEmpty()) {
+    regenArea(bitmap, origin, area);
+  }
+
+  m_bitmap.reset(Image::createCopy(bitmap));
+  m_origin = origin;
+}
+
+void MaskBoundaries::regen(const gfx::Rect& bounds)
+{
+  reset();
+  if (bounds.isEmpty())
+    return;
+
+  m_segs.push_back(Segment(true, gfx::Rect(bounds.x, bounds.y, bounds.w, 0)));
+  m_segs.push_back(Segment(true, gfx::Rect(bounds.x, bounds.y, 0, bounds.h)));
+  m_segs.push_back(Segment(false, gfx::Rect(bounds.x, bounds.y2(), bounds.w, 0)));
+  m_segs.push_back(Segment(false, gfx::Rect(bounds.x2(), bounds.y, 0, bounds.h)));
+}
+
+// Regenerates the segments around the given modified "area" of
+// pixels (in the same coordinates as segments). The segments can
+// change are the horizontal edges in rows [area.y, area.y2()] and
+// the vertical edges in columns [area.x, area.x2()].
+void MaskBoundaries::regenArea(const Image* bitmap,
+                               const gfx::Point& origin,
+                               const gfx::Rect& area)
+{
+  const int x1 = area.x, x2 = area.x2();
+  const int y1 = area.y, y2 = area.y2();
+
+  // Remove the part of each segment that is inside the area (keeping
+  // the parts of the segment that are outside)
+  list_type segs;
+  segs.reserve(m_segs.size());
+  for (const Segment& seg : m_segs) {
+    const gfx::Rect& rc = seg.bounds();
+    if (seg.horizontal()) {
+      if (rc.y >= y1 && rc.y <= y2 && rc.x < x2 && rc.x2() > x1) {
+        if (rc.x < x1)
+          segs.push_back(Segment(seg.open(), gfx::Rect(rc.x, rc.y, x1-rc.x, 0)));
+        if (rc.x2() > x2)
+          segs.push_back(Segment(seg.open(), gfx::Rect(x2, rc.y, rc.x2()-x2, 0)));
+        continue;
+      }
+    }
+    else {
+      if (rc.x >= x1 && rc.x <= x2 && rc.y < y2 && rc.y2() > y1) {
+        if (rc.y < y1)
+          segs.push_back(Segment(seg.open(), gfx::Rect(rc.x, rc.y, 0, y1-rc.y)));
+        if (rc.y2() > y2)
+          segs.push_back(Segment(seg.open(), gfx::Rect(rc.x, y2, 0, rc.y2()-y2)));
+        continue;
+      }
+    }
+    segs.push_back(seg);
+  }
+  m_segs = std::move(segs);
+
+  const gfx::Rect bounds(origin, bitmap->size());
+  auto pixel = [bitmap, &bounds, &origin](int x, int y) -> bool {
+    return (bounds.contains(gfx::Point(x, y)) &&
+            get_pixel_fast<BitmapTraits>(bitmap, x-origin.x, y-origin.y));
+  };
+
+  // New horizontal segments (edges between rows y-1 and y)
+  for (int y=y1; y<=y2; ++y) {
+    int hseg = -1;
+    for (int x=x1; x<x2; ++x) {
+      const bool color = pixel(x, y);
+      if (color != pixel(x, y-1)) {
+        if (hseg >= 0 && m_segs[hseg].open() == color)
+          ++m_segs[hseg].m_bounds.w;
+        else {
+          m_segs.push_back(Segment(color, gfx::Rect(x, y, 1, 0)));
+          hseg = int(m_segs.size()-1);
+        }
+      }
+      else
+        hseg = -1;
+    }
+  }
+
+  // New vertical segments (edges between columns x-1 and x)
+  for (int x=x1; x<=x2; ++x) {
+    int vseg = -1;
+    for (int y=y1; y<y2; ++y) {
+      const bool color = pixel(x, y);
+      if (color != pixel(x-1, y)) {
+        if (vseg >= 0 && m_segs[vseg].open() == color)
+          ++m_segs[vseg].m_bounds.h;
+        else {
+          m_segs.push_back(Segment(color, gfx::Rect(x, y, 0, 1)));
+          vseg = int(m_segs.size()-1);
+        }
+      }
+      else
+        vseg = -1;
+    }
+  }
+
+  // The path will be re-created in the next createPathIfNeeeded()
+  if (!m_path.isEmpty())
+    m_path.rewind();
+}
+
 void MaskBoundaries::offset(int x, int y)
 {
   for (Segment& seg : m_segs)
     seg.offset(x, y);
 
   m_path.offset(x, y);
+  m_origin.x += x;
+  m_origin.y += y;
 }
 
 void MaskBoundaries::createPathIfNeeeded()
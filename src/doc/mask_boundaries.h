@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2023 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,7 +9,9 @@
 #define DOC_MASK_BOUNDARIES_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
 #include "gfx/path.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 
 #include <vector>
@@ -47,6 +49,16 @@ namespace doc {
     void reset();
     void regen(const Image* bitmap);
 
+    // Regenerates the boundaries of the given bitmap placed at the
+    // given origin. Only the area that is different from the bitmap
+    // of the previous call is regenerated (segments outside that
+    // area are kept), and if the bitmap is the same but in other
+    // position, the segments are just offset.
+    void regen(const Image* bitmap, const gfx::Point& origin);
+
+    // Boundaries of a rectangular selection (without bitmap).
+    void regen(const gfx::Rect& bounds);
+
     const_iterator begin() const { return m_segs.begin(); }
     const_iterator end() const { return m_segs.end(); }
     iterator begin() { return m_segs.begin(); }
@@ -58,8 +70,17 @@ namespace doc {
     void createPathIfNeeeded();
 
   private:
+    void regenArea(const Image* bitmap,
+                   const gfx::Point& origin,
+                   const gfx::Rect& area);
+
     list_type m_segs;
     gfx::Path m_path;
+
+    // Copy of the bitmap used in the last regen(bitmap, origin) call
+    // to know which area was modified in the next call.
+    ImageRef m_bitmap;
+    gfx::Point m_origin;
   };
 
 } // namespace doc
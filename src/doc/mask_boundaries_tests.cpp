@@ -0,0 +1,131 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/mask_boundaries.h"
+#include "doc/primitives.h"
+
+#include <set>
+#include <tuple>
+
+using namespace doc;
+
+namespace {
+
+// Unit edges (x, y, horizontal, open) of all segments
+using Edges = std::set<std::tuple<int, int, bool, bool>>;
+
+Edges get_edges(const MaskBoundaries& boundaries)
+{
+  Edges edges;
+  for (const auto& seg : boundaries) {
+    const gfx::Rect& rc = seg.bounds();
+    if (seg.horizontal()) {
+      for (int x=rc.x; x<rc.x2(); ++x)
+        edges.insert(std::make_tuple(x, rc.y, true, seg.open()));
+    }
+    else {
+      for (int y=rc.y; y<rc.y2(); ++y)
+        edges.insert(std::make_tuple(rc.x, y, false, seg.open()));
+    }
+  }
+  return edges;
+}
+
+Edges get_full_regen_edges(const Image* bitmap, const gfx::Point& origin)
+{
+  MaskBoundaries boundaries;
+  boundaries.regen(bitmap);
+  boundaries.offset(origin.x, origin.y);
+  return get_edges(boundaries);
+}
+
+} // anonymous namespace
+
+TEST(MaskBoundaries, RegenModifiedArea)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 64, 32));
+  clear_image(bitmap.get(), 0);
+  fill_rect(bitmap.get(), 4, 4, 20, 20, 1);
+  fill_rect(bitmap.get(), 30, 2, 50, 10, 1);
+
+  MaskBoundaries boundaries;
+  const gfx::Point origin(10, 20);
+  boundaries.regen(bitmap.get(), origin);
+  EXPECT_EQ(get_full_regen_edges(bitmap.get(), origin), get_edges(boundaries));
+
+  // Add pixels in a small area (touching existing boundaries)
+  fill_rect(bitmap.get(), 18, 10, 32, 14, 1);
+  boundaries.regen(bitmap.get(), origin);
+  EXPECT_EQ(get_full_regen_edges(bitmap.get(), origin), get_edges(boundaries));
+
+  // Remove pixels
+  fill_rect(bitmap.get(), 6, 6, 8, 8, 0);
+  put_pixel(bitmap.get(), 40, 5, 0);
+  boundaries.regen(bitmap.get(), origin);
+  EXPECT_EQ(get_full_regen_edges(bitmap.get(), origin), get_edges(boundaries));
+}
+
+TEST(MaskBoundaries, RegenBiggerBitmap)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 40, 30));
+  clear_image(bitmap.get(), 0);
+  fill_rect(bitmap.get(), 0, 0, 39, 29, 1);
+  fill_rect(bitmap.get(), 10, 10, 12, 12, 0);
+
+  MaskBoundaries boundaries;
+  boundaries.regen(bitmap.get(), gfx::Point(0, 0));
+
+  // The bitmap is enlarged to the right (e.g. adding a rectangle
+  // to the selection)
+  ImageRef bitmap2(crop_image(bitmap.get(), 0, 0, 48, 30, 0));
+  fill_rect(bitmap2.get(), 42, 4, 47, 8, 1);
+  boundaries.regen(bitmap2.get(), gfx::Point(0, 0));
+  EXPECT_EQ(get_full_regen_edges(bitmap2.get(), gfx::Point(0, 0)),
+            get_edges(boundaries));
+
+  // The bitmap is reduced from the top-left corner
+  ImageRef bitmap3(crop_image(bitmap2.get(), 2, 3, 46, 27, 0));
+  boundaries.regen(bitmap3.get(), gfx::Point(2, 3));
+  EXPECT_EQ(get_full_regen_edges(bitmap3.get(), gfx::Point(2, 3)),
+            get_edges(boundaries));
+}
+
+TEST(MaskBoundaries, MoveDoesntRegen)
+{
+  ImageRef bitmap(Image::create(IMAGE_BITMAP, 16, 16));
+  clear_image(bitmap.get(), 0);
+  fill_rect(bitmap.get(), 2, 2, 12, 12, 1);
+
+  MaskBoundaries boundaries;
+  boundaries.regen(bitmap.get(), gfx::Point(0, 0));
+  const auto nsegs = std::distance(boundaries.begin(), boundaries.end());
+
+  boundaries.regen(bitmap.get(), gfx::Point(5, -3));
+  EXPECT_EQ(nsegs, std::distance(boundaries.begin(), boundaries.end()));
+  EXPECT_EQ(get_full_regen_edges(bitmap.get(), gfx::Point(5, -3)),
+            get_edges(boundaries));
+
+  // Offset boundaries manually (e.g. when the selection is being
+  // moved) and then regen with the final position
+  boundaries.offset(1, 1);
+  boundaries.regen(bitmap.get(), gfx::Point(6, -2));
+  EXPECT_EQ(get_full_regen_edges(bitmap.get(), gfx::Point(6, -2)),
+            get_edges(boundaries));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,201 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/image_ref.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(Mask, PlainRectangle)
+{
+  Mask mask;
+  EXPECT_TRUE(mask.isEmpty());
+  EXPECT_FALSE(mask.isPlainRectangle());
+
+  mask.replace(gfx::Rect(0, 0, 16384, 16384));
+  EXPECT_FALSE(mask.isEmpty());
+  EXPECT_TRUE(mask.isPlainRectangle());
+  EXPECT_TRUE(mask.isRectangular());
+  EXPECT_TRUE(mask.containsPoint(16383, 0));
+  EXPECT_FALSE(mask.containsPoint(16384, 0));
+
+  mask.intersect(gfx::Rect(10, 20, 30, 40));
+  EXPECT_TRUE(mask.isPlainRectangle());
+  EXPECT_EQ(gfx::Rect(10, 20, 30, 40), mask.bounds());
+
+  // Union of rectangles that is a rectangle
+  mask.add(gfx::Rect(10, 60, 30, 10));
+  EXPECT_TRUE(mask.isPlainRectangle());
+  EXPECT_EQ(gfx::Rect(10, 20, 30, 50), mask.bounds());
+
+  // Remove the left side
+  mask.subtract(gfx::Rect(0, 0, 15, 100));
+  EXPECT_TRUE(mask.isPlainRectangle());
+  EXPECT_EQ(gfx::Rect(15, 20, 25, 50), mask.bounds());
+
+  // Remove the bottom side
+  mask.subtract(gfx::Rect(0, 60, 100, 100));
+  EXPECT_TRUE(mask.isPlainRectangle());
+  EXPECT_EQ(gfx::Rect(15, 20, 25, 40), mask.bounds());
+
+  Mask copy(mask);
+  EXPECT_TRUE(copy.isPlainRectangle());
+  EXPECT_EQ(mask.bounds(), copy.bounds());
+
+  mask.invert();
+  EXPECT_TRUE(mask.isEmpty());
+}
+
+TEST(Mask, MaterializeBitmap)
+{
+  Mask mask;
+  mask.replace(gfx::Rect(2, 3, 8, 4));
+  EXPECT_TRUE(mask.isPlainRectangle());
+
+  // A hole in the middle needs a bitmap
+  mask.subtract(gfx::Rect(4, 4, 2, 2));
+  EXPECT_FALSE(mask.isPlainRectangle());
+  EXPECT_FALSE(mask.isRectangular());
+  EXPECT_EQ(gfx::Rect(2, 3, 8, 4), mask.bounds());
+  EXPECT_TRUE(mask.containsPoint(3, 4));
+  EXPECT_FALSE(mask.containsPoint(4, 4));
+  EXPECT_FALSE(mask.containsPoint(5, 5));
+  EXPECT_TRUE(mask.containsPoint(6, 5));
+
+  // Requesting the bitmap creates it
+  Mask rect;
+  rect.replace(gfx::Rect(0, 0, 4, 4));
+  const Image* bitmap = rect.bitmap();
+  ASSERT_TRUE(bitmap != nullptr);
+  EXPECT_FALSE(rect.isPlainRectangle());
+  EXPECT_TRUE(rect.isRectangular());
+  EXPECT_EQ(1u, get_pixel(bitmap, 0, 0));
+  EXPECT_EQ(1u, get_pixel(bitmap, 3, 3));
+
+  // Operations between masks
+  Mask other;
+  other.replace(gfx::Rect(2, 2, 4, 4));
+  mask.add(other);
+  EXPECT_TRUE(mask.containsPoint(4, 4));
+  EXPECT_TRUE(mask.containsPoint(5, 5));
+
+  other.replace(gfx::Rect(0, 0, 6, 100));
+  mask.intersect(other);
+  EXPECT_EQ(gfx::Rect(2, 2, 4, 5), mask.bounds());
+}
+
+TEST(Mask, ConstBitmapFromThreads)
+{
+  Mask mask;
+  mask.replace(gfx::Rect(5, 5, 64, 32));
+  const Mask* constMask = &mask;
+
+  // bitmap() const doesn't modify the mask, so several threads can
+  // get the bitmap of the same plain rectangle at the same time
+  std::vector<const Image*> bitmaps(8, nullptr);
+  std::vector<std::thread> threads;
+  for (int i=0; i<int(bitmaps.size()); ++i)
+    threads.emplace_back([constMask, &bitmaps, i]{
+      bitmaps[i] = constMask->bitmap();
+    });
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_TRUE(mask.isPlainRectangle());
+  for (const Image* bitmap : bitmaps) {
+    ASSERT_TRUE(bitmap != nullptr);
+    EXPECT_EQ(bitmaps[0], bitmap);
+    EXPECT_EQ(64, bitmap->width());
+    EXPECT_EQ(32, bitmap->height());
+    EXPECT_EQ(1u, get_pixel(bitmap, 0, 0));
+    EXPECT_EQ(1u, get_pixel(bitmap, 63, 31));
+  }
+
+  // A new size creates a new bitmap
+  mask.intersect(gfx::Rect(0, 0, 10, 10));
+  const Image* bitmap = constMask->bitmap();
+  EXPECT_EQ(5, bitmap->width());
+  EXPECT_EQ(5, bitmap->height());
+  EXPECT_TRUE(mask.isPlainRectangle());
+}
+
+TEST(Mask, ByColor)
+{
+  const int w = 37, h = 5;
+  for (const PixelFormat fmt : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    ImageRef image(Image::create(fmt, w, h));
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        const int v = (x*7 + y*13) % 64;
+        put_pixel(image.get(), x, y,
+                  fmt == IMAGE_RGB ? rgba(v, 2*v, 255-v, 255):
+                  fmt == IMAGE_GRAYSCALE ? graya(v, 255): v);
+      }
+    }
+
+    const int v0 = 30, fuzziness = 5;
+    const color_t color =
+      (fmt == IMAGE_RGB ? rgba(v0, 2*v0, 255-v0, 255):
+       fmt == IMAGE_GRAYSCALE ? graya(v0, 255): v0);
+
+    Mask mask;
+    mask.byColor(image.get(), color, fuzziness);
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        const int v = (x*7 + y*13) % 64;
+        // For RGB the green channel (2*v) is the one that limits the match
+        const bool expected =
+          (fmt == IMAGE_RGB ? std::abs(2*v - 2*v0) <= fuzziness:
+                              std::abs(v - v0) <= fuzziness);
+        EXPECT_EQ(expected, mask.containsPoint(x, y))
+          << "fmt=" << int(fmt) << " x=" << x << " y=" << y;
+      }
+    }
+  }
+}
+
+TEST(Mask, ByColorInCels)
+{
+  ImageRef image1(Image::create(IMAGE_INDEXED, 20, 3));
+  ImageRef image2(Image::create(IMAGE_INDEXED, 20, 3));
+  clear_image(image1.get(), 0);
+  clear_image(image2.get(), 0);
+  put_pixel(image1.get(), 0, 0, 5);
+  put_pixel(image1.get(), 19, 2, 5);
+  put_pixel(image2.get(), 3, 1, 5);
+
+  Cel cel1(frame_t(0), image1);
+  Cel cel2(frame_t(1), image2);
+  cel1.setPosition(2, 1);
+  cel2.setPosition(13, 3);
+
+  Mask mask;
+  mask.byColor({ &cel1, &cel2 }, 5, 0);
+  EXPECT_EQ(gfx::Rect(2, 1, 20, 3), mask.bounds());
+  EXPECT_TRUE(mask.containsPoint(2, 1));
+  EXPECT_TRUE(mask.containsPoint(21, 3));
+  EXPECT_TRUE(mask.containsPoint(16, 4));
+  EXPECT_FALSE(mask.containsPoint(3, 1));
+  EXPECT_FALSE(mask.containsPoint(16, 3));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2023  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -27,6 +27,7 @@ Object::Object(ObjectType type)
   : m_type(type)
   , m_id(0)
   , m_version(0)
+  , m_snapshot(false)
 {
 }
 
@@ -34,12 +35,13 @@ Object::Object(const Object& other)
   : m_type(other.m_type)
   , m_id(0) // We don't copy the ID
   , m_version(0) // We don't copy the version
+  , m_snapshot(false)
 {
 }
 
 Object::~Object()
 {
-  if (m_id)
+  if (m_id && !m_snapshot)
     setId(0);
 }
 
@@ -64,7 +66,7 @@ void Object::setId(ObjectId id)
 {
   std::lock_guard lock(g_mutex);
 
-  if (m_id) {
+  if (m_id && !m_snapshot) {
     auto it = objects.find(m_id);
     ASSERT(it != objects.end());
     ASSERT(it->second == this);
@@ -73,6 +75,7 @@ void Object::setId(ObjectId id)
   }
 
   m_id = id;
+  m_snapshot = false;
 
   if (m_id) {
 #ifdef _DEBUG
@@ -94,6 +97,15 @@ void Object::setId(ObjectId id)
   }
 }
 
+void Object::setSnapshotId(ObjectId id)
+{
+  if (m_id && !m_snapshot)
+    setId(0);
+
+  m_id = id;
+  m_snapshot = true;
+}
+
 void Object::setVersion(ObjectVersion version)
 {
   m_version = version;
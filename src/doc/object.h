@@ -27,6 +27,12 @@ namespace doc {
     void setId(ObjectId id);
     void setVersion(ObjectVersion version);
 
+    // Uses the ID of other object without registering this object as
+    // the owner of that ID (get_object() will keep returning the
+    // original object). Used to create snapshots of documents.
+    void setSnapshotId(ObjectId id);
+    bool isSnapshot() const { return m_snapshot; }
+
     void incrementVersion() {
       ++m_version;
     }
@@ -44,6 +50,9 @@ namespace doc {
 
     ObjectVersion m_version;
 
+    // True if m_id is the ID of other object (see setSnapshotId())
+    bool m_snapshot;
+
     // Disable copy assignment
     Object& operator=(const Object&);
   };
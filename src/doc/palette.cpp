@@ -26,6 +26,16 @@ namespace doc {
 
 using namespace gfx;
 
+// Palettes with less colors than this are searched linearly in
+// findExactMatch() (it's faster than creating the hash table).
+static const int kMinColorsForExactMatchIndex = 16;
+
+static inline std::size_t hash_color(color_t color)
+{
+  uint32_t h = color * 0x9E3779B1u;
+  return (h ^ (h >> 16));
+}
+
 enum class FitCriteria {
   OLD,
   RGB,
@@ -41,6 +51,7 @@ Palette::Palette()
 
 Palette::Palette(frame_t frame, int ncolors)
   : Object(ObjectType::Palette)
+  , m_exactMatchModifications(-1)
 {
   ASSERT(ncolors >= 0);
 
@@ -52,6 +63,7 @@ Palette::Palette(frame_t frame, int ncolors)
 Palette::Palette(const Palette& palette)
   : Object(palette)
   , m_comment(palette.m_comment)
+  , m_exactMatchModifications(-1)
 {
   m_frame = palette.m_frame;
   m_colors = palette.m_colors;
@@ -61,6 +73,7 @@ Palette::Palette(const Palette& palette)
 Palette::Palette(const Palette& palette, const Remap& remap)
   : Object(palette)
   , m_comment(palette.m_comment)
+  , m_exactMatchModifications(-1)
 {
   m_frame = palette.m_frame;
 
@@ -304,20 +317,83 @@ void Palette::makeHueGradient(int from, int to)
 
 int Palette::findExactMatch(int r, int g, int b, int a, int mask_index) const
 {
-  for (int i=0; i<(int)m_colors.size(); ++i)
-    if (getEntry(i) == rgba(r, g, b, a) && i != mask_index)
-      return i;
+  const color_t color = rgba(r, g, b, a);
 
-  return -1;
+  if (size() < kMinColorsForExactMatchIndex) {
+    for (int i=0; i<(int)m_colors.size(); ++i)
+      if (getEntry(i) == color && i != mask_index)
+        return i;
+    return -1;
+  }
+
+  int i = findFirstExactMatch(color);
+  if (i >= 0 && i == mask_index)
+    i = m_exactMatchNext[i];
+  return i;
 }
 
 bool Palette::findExactMatch(color_t color) const
 {
-  for (int i=0; i<(int)m_colors.size(); ++i) {
-    if (getEntry(i) == color)
-      return true;
+  if (size() < kMinColorsForExactMatchIndex) {
+    for (int i=0; i<(int)m_colors.size(); ++i) {
+      if (getEntry(i) == color)
+        return true;
+    }
+    return false;
   }
-  return false;
+
+  return (findFirstExactMatch(color) >= 0);
+}
+
+int Palette::findFirstExactMatch(color_t color) const
+{
+  // The index can be used from several threads at the same time, it
+  // just must be re-created when the palette is modified.
+  if (m_exactMatchModifications.load(std::memory_order_acquire) != m_modifications) {
+    std::lock_guard<std::mutex> lock(m_exactMatchMutex);
+    if (m_exactMatchModifications.load(std::memory_order_relaxed) != m_modifications)
+      updateExactMatchIndex();
+  }
+
+  const std::size_t mask = m_exactMatchColors.size()-1;
+  for (std::size_t j=hash_color(color) & mask; ; j=(j+1) & mask) {
+    const int i = m_exactMatchIndexes[j];
+    if (i < 0 || m_exactMatchColors[j] == color)
+      return i;
+  }
+}
+
+void Palette::updateExactMatchIndex() const
+{
+  const int n = size();
+  std::size_t capacity = 1;
+  while (capacity < 2*std::size_t(n))
+    capacity <<= 1;
+  const std::size_t mask = capacity-1;
+
+  m_exactMatchColors.assign(capacity, 0);
+  m_exactMatchIndexes.assign(capacity, -1);
+  m_exactMatchNext.assign(n, -1);
+
+  // Last entry found of each color to link the next one
+  std::vector<int> last(capacity, -1);
+
+  for (int i=0; i<n; ++i) {
+    const color_t color = m_colors[i];
+    std::size_t j = hash_color(color) & mask;
+    while (m_exactMatchIndexes[j] >= 0 && m_exactMatchColors[j] != color)
+      j = (j+1) & mask;
+
+    if (m_exactMatchIndexes[j] < 0) {
+      m_exactMatchColors[j] = color;
+      m_exactMatchIndexes[j] = i;
+    }
+    else
+      m_exactMatchNext[last[j]] = i;
+    last[j] = i;
+  }
+
+  m_exactMatchModifications.store(m_modifications, std::memory_order_release);
 }
 
 //////////////////////////////////////////////////////////////////////
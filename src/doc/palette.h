@@ -15,6 +15,8 @@
 #include "doc/object.h"
 #include "doc/palette_gradient_type.h"
 
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -116,12 +118,25 @@ namespace doc {
     const std::string& getEntryName(const int i) const;
 
   private:
+    void updateExactMatchIndex() const;
+    int findFirstExactMatch(color_t color) const;
+
     frame_t m_frame;
     std::vector<color_t> m_colors;
     std::vector<std::string> m_names;
     int m_modifications;
     std::string m_filename; // If the palette is associated with a file.
     std::string m_comment; // Some extra comment from the .gpl file (author, website, etc.).
+
+    // Hash table used by findExactMatch() to get the first index of
+    // each color. It's re-created when m_modifications is different
+    // from m_exactMatchModifications.
+    mutable std::vector<color_t> m_exactMatchColors;
+    mutable std::vector<int> m_exactMatchIndexes;
+    // Next palette entry with the same color of each entry (or -1)
+    mutable std::vector<int> m_exactMatchNext;
+    mutable std::atomic<int> m_exactMatchModifications;
+    mutable std::mutex m_exactMatchMutex;
   };
 
 } // namespace doc
@@ -0,0 +1,61 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+
+using namespace doc;
+
+static int linear_exact_match(const Palette& pal, color_t color, int mask_index)
+{
+  for (int i=0; i<pal.size(); ++i)
+    if (pal.getEntry(i) == color && i != mask_index)
+      return i;
+  return -1;
+}
+
+TEST(Palette, FindExactMatch)
+{
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba((i*3) & 63, i & 7, 0, 255));
+
+  for (int mask=-1; mask<pal.size(); mask+=5) {
+    for (int i=0; i<pal.size(); ++i) {
+      const color_t c = pal.getEntry(i);
+      EXPECT_EQ(linear_exact_match(pal, c, mask),
+                pal.findExactMatch(rgba_getr(c), rgba_getg(c), rgba_getb(c),
+                                   rgba_geta(c), mask));
+    }
+  }
+  EXPECT_EQ(-1, pal.findExactMatch(255, 255, 255, 255, -1));
+  EXPECT_FALSE(pal.findExactMatch(rgba(255, 255, 255, 255)));
+  EXPECT_TRUE(pal.findExactMatch(rgba(0, 0, 0, 255)));
+
+  // The index is updated when the palette is modified
+  pal.setEntry(100, rgba(255, 255, 255, 255));
+  EXPECT_EQ(100, pal.findExactMatch(255, 255, 255, 255, -1));
+  EXPECT_EQ(-1, pal.findExactMatch(255, 255, 255, 255, 100));
+
+  pal.resize(300, rgba(255, 255, 255, 255));
+  EXPECT_EQ(256, pal.findExactMatch(255, 255, 255, 255, 100));
+
+  Palette copy(pal);
+  copy.setEntry(100, rgba(1, 2, 3, 4));
+  EXPECT_EQ(256, copy.findExactMatch(255, 255, 255, 255, -1));
+  EXPECT_EQ(100, pal.findExactMatch(255, 255, 255, 255, -1));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// Threads that can still be created (the main thread isn't included)
+std::atomic<int>& available_threads()
+{
+  static std::atomic<int> available(hardware_threads()-1);
+  return available;
+}
+
+} // anonymous namespace
+
+ReservedThreads::ReservedThreads(const int wanted)
+  : m_count(0)
+{
+  if (wanted <= 0)
+    return;
+
+  std::atomic<int>& available = available_threads();
+  int n = available.load();
+  int count;
+  do {
+    count = std::min(wanted, n);
+    if (count <= 0)
+      return;
+  } while (!available.compare_exchange_weak(n, n - count));
+  m_count = count;
+}
+
+ReservedThreads::~ReservedThreads()
+{
+  if (m_count > 0)
+    available_threads() += m_count;
+}
+
+int hardware_threads()
+{
+  return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+int run_workers(const int maxWorkers,
+                const std::function<void(const int worker)>& func)
+{
+  const int wanted = (maxWorkers > 0 ? maxWorkers: hardware_threads());
+  ReservedThreads reserved(wanted-1);
+
+  std::mutex mutex;
+  std::exception_ptr error;
+  auto work = [&func, &mutex, &error](const int worker){
+    try {
+      func(worker);
+    }
+    catch (...) {
+      std::lock_guard lock(mutex);
+      if (!error)
+        error = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(reserved.count());
+  for (int i=1; i<=reserved.count(); ++i)
+    threads.emplace_back(work, i);
+  work(0);
+  for (auto& thread : threads)
+    thread.join();
+
+  if (error)
+    std::rethrow_exception(error);
+  return reserved.count()+1;
+}
+
+void parallel_for(const int n,
+                  const int minItems,
+                  const std::function<void(const int begin,
+                                           const int end)>& func)
+{
+  if (n <= 0)
+    return;
+
+  // Ranges are smaller than n/workers, so threads that finish first
+  // can take more work.
+  const int maxWorkers = std::clamp(n / std::max(1, minItems),
+                                    1, hardware_threads());
+  const int rangeSize = std::max(std::max(1, minItems),
+                                 (n + 4*maxWorkers - 1) / (4*maxWorkers));
+  if (maxWorkers == 1) {
+    func(0, n);
+    return;
+  }
+
+  std::atomic<int> next(0);
+  run_workers(
+    maxWorkers,
+    [&func, &next, n, rangeSize](const int){
+      int begin;
+      while ((begin = next.fetch_add(rangeSize)) < n)
+        func(begin, std::min(n, begin + rangeSize));
+    });
+}
+
+} // namespace doc
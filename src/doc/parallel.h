@@ -0,0 +1,62 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_PARALLEL_H_INCLUDED
+#define DOC_PARALLEL_H_INCLUDED
+#pragma once
+
+#include <functional>
+
+namespace doc {
+
+  // Reserves threads from a process-wide budget (the number of
+  // hardware threads minus the calling thread) and gives them back
+  // when it's destroyed. All code that creates threads to work in
+  // parallel (run_workers(), parallel_for(), background threads of
+  // file encoders, CLI jobs, etc.) takes them from this budget. In
+  // this way nested parallel code (e.g. CLI jobs that save PNG files
+  // compressing bands of rows in several threads) doesn't create
+  // more threads than hardware threads, the inner code just gets
+  // fewer threads (or zero, and runs in the calling thread).
+  class ReservedThreads {
+  public:
+    explicit ReservedThreads(const int wanted);
+    ~ReservedThreads();
+
+    ReservedThreads(const ReservedThreads&) = delete;
+    ReservedThreads& operator=(const ReservedThreads&) = delete;
+
+    // Number of threads that can be created (from 0 to "wanted").
+    int count() const { return m_count; }
+
+  private:
+    int m_count;
+  };
+
+  // Number of hardware threads (at least 1).
+  int hardware_threads();
+
+  // Calls func(worker) from the calling thread (worker=0) and from up
+  // to maxWorkers-1 reserved threads (worker=1, 2, etc.), and waits
+  // all of them. Workers usually take their items from a shared
+  // std::atomic counter. If maxWorkers <= 0 the number of hardware
+  // threads is used. An exception thrown by a worker is rethrown in
+  // the calling thread. Returns the number of workers that were
+  // used.
+  int run_workers(const int maxWorkers,
+                  const std::function<void(const int worker)>& func);
+
+  // Calls func(begin, end) for consecutive ranges of [0, n) with at
+  // least minItems items (except the last range) from several
+  // threads (see run_workers()).
+  void parallel_for(const int n,
+                    const int minItems,
+                    const std::function<void(const int begin,
+                                             const int end)>& func);
+
+} // namespace doc
+
+#endif
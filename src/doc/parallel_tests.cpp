@@ -0,0 +1,81 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+TEST(Parallel, ParallelFor)
+{
+  const int n = 10000;
+  std::vector<std::atomic<int>> counts(n);
+  parallel_for(n, 100, [&counts](const int begin, const int end){
+    EXPECT_LE(0, begin);
+    EXPECT_LT(begin, end);
+    for (int i=begin; i<end; ++i)
+      ++counts[i];
+  });
+  for (int i=0; i<n; ++i)
+    EXPECT_EQ(1, counts[i]) << "Item " << i;
+}
+
+TEST(Parallel, NestedWorkersDontOversubscribe)
+{
+  std::atomic<int> running(0);
+  std::atomic<int> maxRunning(0);
+
+  run_workers(0, [&](const int){
+    run_workers(0, [&](const int){
+      const int r = ++running;
+      int m = maxRunning;
+      while (r > m && !maxRunning.compare_exchange_weak(m, r))
+        ;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      --running;
+    });
+  });
+
+  EXPECT_LE(maxRunning, hardware_threads());
+
+  // All threads were given back to the budget
+  ReservedThreads reserved(hardware_threads());
+  EXPECT_EQ(hardware_threads()-1, reserved.count());
+}
+
+TEST(Parallel, RethrowExceptions)
+{
+  EXPECT_THROW(
+    run_workers(0, [](const int worker){
+      if (worker == 0)
+        throw std::runtime_error("error");
+    }),
+    std::runtime_error);
+
+  EXPECT_THROW(
+    parallel_for(1000, 1, [](const int begin, const int end){
+      if (begin <= 500 && 500 < end)
+        throw std::runtime_error("error");
+    }),
+    std::runtime_error);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -23,7 +23,10 @@
 
 #include <city.h>
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 
 #if defined(__x86_64__) || defined(_WIN64)
   #include <emmintrin.h>
@@ -470,6 +473,119 @@ bool is_same_image_simd_templ(const Image* i1, const Image* i2)
   return true;
 }
 
+template<typename ImageTraits>
+void create_region_with_differences_templ(const Image* a,
+                                          const Image* b,
+                                          const gfx::Rect& bounds,
+                                          gfx::Region& output)
+{
+  using const_address_t = typename ImageTraits::const_address_t;
+
+  // Horizontal runs of different pixels in the previous rows (all
+  // rows with the same runs are merged in one band of rectangles).
+  std::vector<gfx::Rect> runs, prevRuns;
+  std::vector<gfx::Region> bands;
+
+  auto addBand = [&bands](const std::vector<gfx::Rect>& rcs) {
+    if (rcs.empty())
+      return;
+    // Rectangles are in the same band and sorted by x, so creating
+    // this region is cheap.
+    gfx::Region band;
+    for (const gfx::Rect& rc : rcs)
+      band |= gfx::Region(rc);
+    bands.push_back(std::move(band));
+  };
+
+  const int rowBytes = ImageTraits::width_bytes(bounds.w);
+
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    runs.clear();
+
+    auto p = (const_address_t)a->getPixelAddress(bounds.x, y);
+    auto q = (const_address_t)b->getPixelAddress(bounds.x, y);
+
+    // Fast path for equal rows
+    if (std::memcmp(p, q, rowBytes) != 0) {
+      for (int x=bounds.x; x<bounds.x2(); ) {
+        // Skip equal pixels
+        while (x < bounds.x2() && *p == *q) {
+          ++x; ++p; ++q;
+        }
+        if (x == bounds.x2())
+          break;
+
+        // Collect different pixels
+        const int x0 = x;
+        while (x < bounds.x2() && *p != *q) {
+          ++x; ++p; ++q;
+        }
+        runs.push_back(gfx::Rect(x0, y, x-x0, 1));
+      }
+    }
+
+    // Extend the previous rectangles if we've the same runs
+    if (!prevRuns.empty() &&
+        runs.size() == prevRuns.size() &&
+        std::equal(runs.begin(), runs.end(), prevRuns.begin(),
+                   [](const gfx::Rect& r1, const gfx::Rect& r2){
+                     return (r1.x == r2.x && r1.w == r2.w);
+                   })) {
+      for (gfx::Rect& rc : prevRuns)
+        ++rc.h;
+    }
+    else {
+      addBand(prevRuns);
+      std::swap(prevRuns, runs);
+    }
+  }
+  addBand(prevRuns);
+
+  // Merge bands by pairs (instead of adding them one by one to the
+  // same big region)
+  while (bands.size() > 1) {
+    std::size_t j = 0;
+    for (std::size_t i=0; i<bands.size(); i+=2, ++j) {
+      if (i+1 < bands.size())
+        bands[j].createUnion(bands[i], bands[i+1]);
+      else if (j != i)
+        bands[j] = std::move(bands[i]);
+    }
+    bands.resize(j);
+  }
+
+  if (!bands.empty())
+    output.createUnion(output, bands.front());
+}
+
+// Version for 1bpp images (we cannot compare bytes in this case)
+template<>
+void create_region_with_differences_templ<BitmapTraits>(const Image* a,
+                                                        const Image* b,
+                                                        const gfx::Rect& bounds,
+                                                        gfx::Region& output)
+{
+  gfx::Region rgn;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    for (int x=bounds.x; x<bounds.x2(); ) {
+      while (x < bounds.x2() &&
+             get_pixel_fast<BitmapTraits>(a, x, y) ==
+             get_pixel_fast<BitmapTraits>(b, x, y))
+        ++x;
+      if (x == bounds.x2())
+        break;
+
+      const int x0 = x;
+      while (x < bounds.x2() &&
+             get_pixel_fast<BitmapTraits>(a, x, y) !=
+             get_pixel_fast<BitmapTraits>(b, x, y))
+        ++x;
+      rgn |= gfx::Region(gfx::Rect(x0, y, x-x0, 1));
+    }
+  }
+  output.createUnion(output, rgn);
+}
+
 } // anonymous namespace
 
 bool is_plain_image(const Image* img, color_t c)
@@ -548,6 +664,24 @@ bool is_same_image(const Image* i1, const Image* i2)
   return false;
 }
 
+void create_region_with_differences(const Image* a,
+                                    const Image* b,
+                                    const gfx::Rect& bounds,
+                                    gfx::Region& output)
+{
+  ASSERT(a->pixelFormat() == b->pixelFormat());
+  ASSERT(a->bounds().contains(bounds));
+  ASSERT(b->bounds().contains(bounds));
+
+  if (bounds.isEmpty())
+    return;
+
+  DOC_DISPATCH_BY_COLOR_MODE(
+    a->colorMode(),
+    create_region_with_differences_templ,
+    a, b, bounds, output);
+}
+
 void remap_image(Image* image, const Remap& remap)
 {
   ASSERT(image->pixelFormat() == IMAGE_INDEXED ||
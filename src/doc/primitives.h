@@ -52,6 +52,15 @@ namespace doc {
   bool is_same_image(const Image* i1, const Image* i2);
   bool is_same_image_slow(const Image* i1, const Image* i2);
 
+  // Adds to "output" the region of pixels inside "bounds" that are
+  // different between images "a" and "b" (both images must have the
+  // same pixel format). Each row is compared as a whole and the
+  // region is built from horizontal runs of different pixels.
+  void create_region_with_differences(const Image* a,
+                                      const Image* b,
+                                      const gfx::Rect& bounds,
+                                      gfx::Region& output);
+
   void remap_image(Image* image, const Remap& remap);
 
   uint32_t calculate_image_hash(const Image* image,
@@ -16,6 +16,7 @@
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/primitives_fast.h"
+#include "gfx/region.h"
 
 #include <random>
 
@@ -80,6 +81,44 @@ TYPED_TEST(Primitives, IsSameImage)
   }
 }
 
+TYPED_TEST(Primitives, CreateRegionWithDifferences)
+{
+  using ImageTraits = TypeParam;
+
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_int_distribution<int> dist(0, 256);
+
+  for (int h=1; h<70; h+=7) {
+    for (int w=1; w<70; w+=7) {
+      ImageRef a(Image::create(ImageTraits::pixel_format, w, h));
+      doc::algorithm::random_image(a.get());
+
+      ImageRef b(Image::createCopy(a.get()));
+      for (int i=0; i<16; ++i) {
+        int u = dist(gen) % w;
+        int v = dist(gen) % h;
+        auto old = get_pixel_fast<ImageTraits>(b.get(), u, v);
+        put_pixel_fast<ImageTraits>(b.get(), u, v, (old != 0 ? 0: 1));
+      }
+
+      const gfx::Rect bounds(w/4, h/4, w-w/4, h-h/4);
+      gfx::Region rgn;
+      create_region_with_differences(a.get(), b.get(), bounds, rgn);
+
+      for (int v=0; v<h; ++v) {
+        for (int u=0; u<w; ++u) {
+          const bool diff =
+            (bounds.contains(gfx::Point(u, v)) &&
+             get_pixel_fast<ImageTraits>(a.get(), u, v) !=
+             get_pixel_fast<ImageTraits>(b.get(), u, v));
+          ASSERT_EQ(diff, rgn.contains(gfx::Point(u, v)));
+        }
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
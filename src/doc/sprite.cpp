@@ -663,6 +663,17 @@ void Sprite::remapTilemaps(const Tileset* tileset,
   }
 }
 
+void Sprite::invalidateTilesHistograms()
+{
+  if (!hasTilesets())
+    return;
+
+  for (Tileset* tileset : *tilesets()) {
+    if (tileset)
+      tileset->invalidateTilesHistogram();
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Drawing
 
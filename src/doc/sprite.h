@@ -205,6 +205,11 @@ namespace doc {
     void remapImages(const Remap& remap);
     void remapTilemaps(const Tileset* tileset,
                        const Remap& remap);
+
+    // Discards the tiles histogram of all tilesets (see
+    // Tileset::invalidateTilesHistogram()).
+    void invalidateTilesHistograms();
+
     void pickCels(const gfx::PointF& pos,
                   const int opacityThreshold,
                   const RenderPlan& plan,
@@ -11,9 +11,13 @@
 #include "doc/tileset.h"
 
 #include "doc/tilesets.h"
+#include "doc/algorithm/flip_image.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "base/mem_utils.h"
+#include "doc/cel.h"
+#include "doc/cels_range.h"
+#include "doc/image_impl.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
@@ -24,6 +28,31 @@
 
 namespace doc {
 
+namespace {
+
+// Flips that we try to match in order of preference (this order is
+// used to choose the flags when several flipped versions of different
+// tiles are the same image).
+const tile_flags kFlips[] = {
+  tile_f_xflip,
+  tile_f_yflip,
+  tile_f_xflip | tile_f_yflip,
+  tile_f_dflip,
+  tile_f_xflip | tile_f_dflip,
+  tile_f_xflip | tile_f_yflip | tile_f_dflip,
+  tile_f_yflip | tile_f_dflip,
+};
+
+int flip_priority(const tile_flags tf)
+{
+  for (int i=0; i<int(sizeof(kFlips)/sizeof(kFlips[0])); ++i)
+    if (kFlips[i] == tf)
+      return i;
+  return -1;
+}
+
+} // anonymous namespace
+
 // static
 UserData Tileset::kNoUserData;
 
@@ -159,6 +188,15 @@ void Tileset::setTileData(const tile_index ti,
     m_tiles[ti].data = userData;
 }
 
+void Tileset::setMatchFlags(const tile_flags tf)
+{
+  if (m_matchFlags != tf) {
+    m_matchFlags = tf;
+    m_flippedHash.clear();
+    m_flippedHashBuilt = false;
+  }
+}
+
 void Tileset::set(const tile_index ti,
                   const ImageRef& image)
 {
@@ -173,6 +211,8 @@ void Tileset::set(const tile_index ti,
 #endif
 
   removeFromHash(ti, false);
+  m_flippedHash.clear();
+  m_flippedHashBuilt = false;
 
   preprocess_transparent_pixels(image.get());
   m_tiles[ti].image = image;
@@ -194,6 +234,8 @@ tile_index Tileset::add(const ImageRef& image,
   const tile_index newIndex = tile_index(m_tiles.size()-1);
   if (!m_hash.empty())
     hashImage(newIndex, image);
+  if (m_flippedHashBuilt)
+    hashFlippedImages(newIndex, image);
   return newIndex;
 }
 
@@ -224,6 +266,14 @@ void Tileset::insert(const tile_index ti,
     // And now we can add the new image with the "ti" index
     hashImage(ti, image);
   }
+
+  if (m_flippedHashBuilt) {
+    for (auto& it : m_flippedHash)
+      if (it.second.ti >= ti)
+        ++it.second.ti;
+
+    hashFlippedImages(ti, image);
+  }
 }
 
 void Tileset::erase(const tile_index ti)
@@ -273,6 +323,37 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
   }
 }
 
+bool Tileset::findTileIndex(const ImageRef& tileImage,
+                            tile_index& ti,
+                            tile_flags& tf)
+{
+  tf = 0;
+  if (findTileIndex(tileImage, ti))
+    return true;
+
+  // In case we don't allow flipped tiles
+  if (m_matchFlags == 0)
+    return false;
+
+  auto& h = flippedHashTable();
+  auto it = h.find(tileImage);
+  if (it != h.end()) {
+    ti = it->second.ti;
+    tf = it->second.tf;
+    return true;
+  }
+  else {
+    ti = notile;
+    return false;
+  }
+}
+
+void Tileset::prepareToFindTiles()
+{
+  hashTable();
+  flippedHashTable();
+}
+
 void Tileset::notifyTileContentChange(const tile_index ti)
 {
 #if 0 // TODO Try to do less work
@@ -387,11 +468,54 @@ void Tileset::hashImage(const tile_index ti,
     m_hash[tileImage] = ti;
 }
 
+// Adds to the m_flippedHash table all the flipped versions of the
+// given tile image (the ones that we can match with m_matchFlags).
+void Tileset::hashFlippedImages(const tile_index ti,
+                                const ImageRef& tileImage)
+{
+  const gfx::Rect bounds = tileImage->bounds();
+
+  for (const tile_flags tf : kFlips) {
+    if ((tf & m_matchFlags) != tf)
+      continue;
+
+    // Diagonal flips can be used only with square tiles
+    if ((tf & tile_f_dflip) && bounds.w != bounds.h)
+      continue;
+
+    // Drawing the tile with the "tf" flags is the same as flipping
+    // the image diagonally first, and then vertically/horizontally.
+    ImageRef flipped(Image::createCopy(tileImage.get()));
+    if (tf & tile_f_dflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipDiagonal);
+    if (tf & tile_f_yflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipVertical);
+    if (tf & tile_f_xflip)
+      algorithm::flip_image(flipped.get(), bounds, algorithm::FlipHorizontal);
+
+    auto it = m_flippedHash.find(flipped);
+    if (it == m_flippedHash.end()) {
+      m_flippedHash[flipped] = FlippedTile{ ti, tf };
+    }
+    else {
+      // Keep the same preference as if we were flipping the given
+      // image to search it in the regular hash table, i.e. first by
+      // flags and then by tile index.
+      const int a = flip_priority(tf);
+      const int b = flip_priority(it->second.tf);
+      if (a < b || (a == b && ti < it->second.ti))
+        it->second = FlippedTile{ ti, tf };
+    }
+  }
+}
+
 void Tileset::rehash()
 {
   // Clear the hash table, we'll lazy-rehash it when
   // hashTable()/findTileIndex() is used.
   m_hash.clear();
+  m_flippedHash.clear();
+  m_flippedHashBuilt = false;
 
   // Reset the compressed data (just in case we have cached the data
   // from a loaded .aseprite file or when saving the file).
@@ -409,6 +533,21 @@ TilesetHashTable& Tileset::hashTable()
   return m_hash;
 }
 
+TilesetFlippedHashTable& Tileset::flippedHashTable()
+{
+  // The table can be empty after it's built (e.g. only diagonal
+  // flips with non-square tiles), so we use a flag to know if it's
+  // built, in other case threads that use a prepared tileset (see
+  // prepareToFindTiles()) would build it again at the same time.
+  if (!m_flippedHashBuilt && m_matchFlags != 0) {
+    tile_index ti = 0;
+    for (auto& tile : m_tiles)
+      hashFlippedImages(ti++, tile.image);
+    m_flippedHashBuilt = true;
+  }
+  return m_flippedHash;
+}
+
 int Tileset::tilemapsCount() const {
   auto tsi = sprite()->tilesets()->getIndex(this);
   int count = 0;
@@ -420,4 +559,106 @@ int Tileset::tilemapsCount() const {
   return count;
 }
 
+const std::vector<size_t>& Tileset::tilesHistogram() const
+{
+  if (m_tilesHistogramValid || !m_sprite)
+    return m_tilesHistogram;
+
+  m_tilesHistogram.clear();
+  m_tilesHistogram.resize(size(), 0);
+
+  for (const Cel* cel : sprite()->uniqueCels()) {
+    if (!cel->layer()->isTilemap() ||
+        static_cast<LayerTilemap*>(cel->layer())->tileset() != this)
+      continue;
+
+    const Image* image = cel->image();
+    ASSERT(image->pixelFormat() == IMAGE_TILEMAP);
+
+    const LockImageBits<TilemapTraits> bits(image);
+    for (const tile_t t : bits) {
+      if (t != notile) {
+        const tile_index ti = tile_geti(t);
+        if (ti >= m_tilesHistogram.size())
+          m_tilesHistogram.resize(ti+1, 0);
+        ++m_tilesHistogram[ti];
+      }
+    }
+  }
+
+  m_tilesHistogramValid = true;
+  return m_tilesHistogram;
+}
+
+void Tileset::updateTilesHistogram(const Image* tilemap,
+                                   const gfx::Rect& bounds,
+                                   const int delta)
+{
+  ASSERT(tilemap->pixelFormat() == IMAGE_TILEMAP);
+  ASSERT(delta == 1 || delta == -1);
+  if (!m_tilesHistogramValid)
+    return;
+
+  const gfx::Rect rc = (bounds & tilemap->bounds());
+  if (rc.isEmpty())
+    return;
+
+  const LockImageBits<TilemapTraits> bits(tilemap, rc);
+  for (const tile_t t : bits) {
+    if (t == notile)
+      continue;
+
+    const tile_index ti = tile_geti(t);
+    if (ti >= m_tilesHistogram.size())
+      m_tilesHistogram.resize(ti+1, 0);
+
+    if (delta > 0)
+      ++m_tilesHistogram[ti];
+    else if (m_tilesHistogram[ti] > 0)
+      --m_tilesHistogram[ti];
+    else {
+      // The tilemap wasn't counted, we'll have to scan all tilemaps
+      // again
+      ASSERT(false);
+      invalidateTilesHistogram();
+      return;
+    }
+  }
+}
+
+void Tileset::updateTilesHistogram(const Image* tilemap,
+                                   const int delta)
+{
+  updateTilesHistogram(tilemap, tilemap->bounds(), delta);
+}
+
+void Tileset::remapTilesHistogram(const Remap& remap)
+{
+  if (!m_tilesHistogramValid)
+    return;
+
+  // Same mapping of tile indexes as remap_image() for tilemaps
+  std::vector<size_t> newHistogram(m_tilesHistogram.size(), 0);
+  for (tile_index ti=0; ti<tile_index(m_tilesHistogram.size()); ++ti) {
+    if (!m_tilesHistogram[ti])
+      continue;
+
+    const int to = remap[ti];
+    if (to == Remap::kNoTile)
+      continue;
+
+    const tile_index tj = (to == Remap::kUnused ? ti: tile_index(to));
+    if (tj >= newHistogram.size())
+      newHistogram.resize(tj+1, 0);
+    newHistogram[tj] += m_tilesHistogram[ti];
+  }
+  std::swap(m_tilesHistogram, newHistogram);
+}
+
+void Tileset::invalidateTilesHistogram()
+{
+  m_tilesHistogramValid = false;
+  m_tilesHistogram.clear();
+}
+
 } // namespace doc
@@ -15,6 +15,7 @@
 #include "doc/tile.h"
 #include "doc/tileset_hash_table.h"
 #include "doc/with_user_data.h"
+#include "gfx/rect.h"
 
 #include <string>
 #include <vector>
@@ -62,7 +63,7 @@ namespace doc {
     // Allow to match tiles with the given flags/flips automatically
     // in Auto/Stack modes.
     tile_flags matchFlags() const { return m_matchFlags; }
-    void setMatchFlags(const tile_flags tf) { m_matchFlags = tf; }
+    void setMatchFlags(const tile_flags tf);
 
     // Cached compressed tileset read/writen directly from .aseprite
     // files.
@@ -129,6 +130,19 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Same as findTileIndex() but it can match flipped versions of
+    // the tiles too (only the flips enabled in matchFlags()). In "tf"
+    // it returns the flags that must be used to draw the "ti" tile
+    // to get the given "tileImage".
+    bool findTileIndex(const ImageRef& tileImage,
+                       tile_index& ti,
+                       tile_flags& tf);
+
+    // Generates the hash tables used by findTileIndex(), so then it
+    // can be called from several threads at the same time (while the
+    // tileset is not modified).
+    void prepareToFindTiles();
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
@@ -140,6 +154,32 @@ namespace doc {
     // Returns the number of tilemap layers that are referencing this tileset.
     int tilemapsCount() const;
 
+    // Returns the number of references to each tile from all the
+    // tilemaps of the sprite that use this tileset. The vector can be
+    // bigger than size() if tilemaps reference tiles outside the
+    // tileset range. Tilemaps are scanned only the first time (or
+    // after invalidateTilesHistogram()), then the cmds that modify
+    // tilemaps keep the counts updated.
+    const std::vector<size_t>& tilesHistogram() const;
+
+    // Adds (delta=+1) or removes (delta=-1) the tiles inside the
+    // given bounds of a tilemap that uses this tileset from the
+    // histogram. Does nothing if the histogram isn't calculated.
+    void updateTilesHistogram(const Image* tilemap,
+                              const gfx::Rect& bounds,
+                              const int delta);
+    void updateTilesHistogram(const Image* tilemap,
+                              const int delta);
+
+    // Remaps the histogram counts when the tilemaps that use this
+    // tileset are remapped (see Sprite::remapTilemaps()).
+    void remapTilesHistogram(const Remap& remap);
+
+    // Discards the histogram so it's calculated again (scanning all
+    // tilemaps) in the next tilesHistogram() call. Must be called
+    // when tilemaps are modified without updating the histogram.
+    void invalidateTilesHistogram();
+
 #ifdef _DEBUG
     void assertValidHashTable();
 #endif
@@ -149,13 +189,20 @@ namespace doc {
                         const bool adjustIndexes);
     void hashImage(const tile_index ti,
                    const ImageRef& tileImage);
+    void hashFlippedImages(const tile_index ti,
+                           const ImageRef& tileImage);
     void rehash();
     TilesetHashTable& hashTable();
+    TilesetFlippedHashTable& flippedHashTable();
 
     Sprite* m_sprite;
     Grid m_grid;
     Tiles m_tiles;
     TilesetHashTable m_hash;
+    // Flipped versions of the tiles (generated lazily only when
+    // matchFlags() != 0)
+    TilesetFlippedHashTable m_flippedHash;
+    bool m_flippedHashBuilt = false;
     std::string m_name;
     int m_baseIndex = 1;
     tile_flags m_matchFlags = 0;
@@ -175,6 +222,11 @@ namespace doc {
     // contains several layers with tilesets).
     mutable base::buffer m_compressedData;
     mutable doc::ObjectVersion m_compressedDataVersion;
+
+    // Number of references to each tile from the tilemaps, see
+    // tilesHistogram().
+    mutable std::vector<size_t> m_tilesHistogram;
+    mutable bool m_tilesHistogramValid = false;
   };
 
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2023  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -24,6 +24,19 @@ namespace doc {
                              details::image_hash,
                              details::image_eq> TilesetHashTable;
 
+  // A tile index with the flags/flips that must be used to draw it.
+  struct FlippedTile {
+    tile_index ti;
+    tile_flags tf;
+  };
+
+  // A hash table used to match flipped versions of the tileset tiles
+  // <-> tileset index + flags
+  typedef std::unordered_map<ImageRef,
+                             FlippedTile,
+                             details::image_hash,
+                             details::image_eq> TilesetFlippedHashTable;
+
 } // namespace doc
 
 #endif
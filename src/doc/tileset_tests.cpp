@@ -0,0 +1,171 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/remap.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <memory>
+
+using namespace doc;
+
+namespace {
+
+const color_t a = rgba(255, 0, 0, 255);
+const color_t b = rgba(0, 255, 0, 255);
+const color_t c = rgba(0, 0, 255, 255);
+const color_t d = rgba(255, 255, 0, 255);
+
+ImageRef make_tile(color_t c00, color_t c10,
+                   color_t c01, color_t c11)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 2, 2));
+  put_pixel(image.get(), 0, 0, c00);
+  put_pixel(image.get(), 1, 0, c10);
+  put_pixel(image.get(), 0, 1, c01);
+  put_pixel(image.get(), 1, 1, c11);
+  return image;
+}
+
+} // anonymous namespace
+
+TEST(Tileset, FindFlippedTiles)
+{
+  std::shared_ptr<Sprite> spr(std::make_shared<Sprite>(
+                                ImageSpec(ColorMode::RGB, 4, 4), 256));
+  std::unique_ptr<Tileset> ts(
+    new Tileset(spr.get(), Grid::MakeRect(gfx::Size(2, 2)), 1));
+
+  const tile_index t1 = ts->add(make_tile(a, b,
+                                          c, d));
+  EXPECT_EQ(1u, t1);
+
+  tile_index ti;
+  tile_flags tf;
+  EXPECT_TRUE(ts->findTileIndex(make_tile(a, b, c, d), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(0u, tf);
+
+  // Flipped tiles are not found if we don't allow flips
+  EXPECT_FALSE(ts->findTileIndex(make_tile(b, a, d, c), ti, tf));
+
+  ts->setMatchFlags(tile_f_xflip | tile_f_yflip | tile_f_dflip);
+
+  EXPECT_TRUE(ts->findTileIndex(make_tile(b, a, d, c), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_xflip, tf);
+
+  EXPECT_TRUE(ts->findTileIndex(make_tile(c, d, a, b), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_yflip, tf);
+
+  EXPECT_TRUE(ts->findTileIndex(make_tile(d, c, b, a), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_xflip | tile_f_yflip, tf);
+
+  EXPECT_TRUE(ts->findTileIndex(make_tile(a, c, b, d), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_dflip, tf);
+
+  EXPECT_TRUE(ts->findTileIndex(make_tile(d, b, c, a), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_xflip | tile_f_yflip | tile_f_dflip, tf);
+
+  // New tiles are added to the hash table of flipped tiles
+  const tile_index t2 = ts->add(make_tile(a, a,
+                                          b, b));
+  EXPECT_TRUE(ts->findTileIndex(make_tile(b, b, a, a), ti, tf));
+  EXPECT_EQ(t2, ti);
+  EXPECT_EQ(tile_f_yflip, tf);
+
+  // Only the allowed flips are matched
+  ts->setMatchFlags(tile_f_xflip);
+  EXPECT_FALSE(ts->findTileIndex(make_tile(b, b, a, a), ti, tf));
+  EXPECT_TRUE(ts->findTileIndex(make_tile(b, a, d, c), ti, tf));
+  EXPECT_EQ(t1, ti);
+  EXPECT_EQ(tile_f_xflip, tf);
+}
+
+TEST(Tileset, TilesHistogram)
+{
+  std::shared_ptr<Sprite> spr(std::make_shared<Sprite>(
+                                ImageSpec(ColorMode::RGB, 4, 4), 256));
+  Tileset* ts = new Tileset(spr.get(), Grid::MakeRect(gfx::Size(2, 2)), 3);
+  spr->tilesets()->add(ts);
+
+  LayerTilemap* lay = new LayerTilemap(spr.get(), 0);
+  spr->root()->addLayer(lay);
+  spr->setTotalFrames(2);
+
+  ImageRef tm1(Image::create(IMAGE_TILEMAP, 2, 2));
+  put_pixel(tm1.get(), 0, 0, tile(1, 0));
+  put_pixel(tm1.get(), 1, 0, tile(1, tile_f_xflip));
+  put_pixel(tm1.get(), 0, 1, tile(2, 0));
+  put_pixel(tm1.get(), 1, 1, notile);
+  lay->addCel(new Cel(0, tm1));
+
+  // The first call counts all tilemaps
+  std::vector<size_t> expected = { 0, 2, 1 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+
+  // Then the counts are updated incrementally
+  ImageRef tm2(Image::create(IMAGE_TILEMAP, 1, 1));
+  put_pixel(tm2.get(), 0, 0, tile(2, 0));
+  Cel* cel2 = new Cel(1, tm2);
+  lay->addCel(cel2);
+  ts->updateTilesHistogram(tm2.get(), 1);
+
+  expected = { 0, 2, 2 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+
+  ts->updateTilesHistogram(tm1.get(), gfx::Rect(0, 0, 1, 1), -1);
+  put_pixel(tm1.get(), 0, 0, tile(2, 0));
+  ts->updateTilesHistogram(tm1.get(), gfx::Rect(0, 0, 1, 1), 1);
+  expected = { 0, 1, 3 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+
+  // Remap tiles 1 <-> 2
+  Remap remap(3);
+  remap.map(0, 0);
+  remap.map(1, 2);
+  remap.map(2, 1);
+  spr->remapTilemaps(ts, remap);
+  ts->remapTilesHistogram(remap);
+  expected = { 0, 3, 1 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+
+  ts->updateTilesHistogram(tm2.get(), -1);
+  lay->removeCel(cel2);
+  delete cel2;
+  expected = { 0, 2, 1 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+
+  // Tilemaps modified without updating the histogram are counted
+  // again after invalidating it
+  put_pixel(tm1.get(), 1, 1, tile(1, 0));
+  EXPECT_EQ(expected, ts->tilesHistogram());
+  ts->invalidateTilesHistogram();
+  expected = { 0, 3, 1 };
+  EXPECT_EQ(expected, ts->tilesHistogram());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+// Aseprite Render Library
+// Copyright (c) 2023  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/onionskin_cache.h"
+
+#include "base/debug.h"
+#include "doc/image.h"
+
+#include <iterator>
+
+namespace render {
+
+OnionskinCache::OnionskinCache(std::size_t maxMemSize)
+  : m_maxMemSize(maxMemSize)
+{
+}
+
+void OnionskinCache::setMaxMemSize(std::size_t maxMemSize)
+{
+  m_maxMemSize = maxMemSize;
+  shrinkToFit();
+}
+
+doc::ImageRef OnionskinCache::get(const Key& key)
+{
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    if (it->key == key) {
+      // Move to the front as the most recently used image
+      if (it != m_entries.begin())
+        m_entries.splice(m_entries.begin(), m_entries, it);
+      return m_entries.front().image;
+    }
+  }
+  return nullptr;
+}
+
+void OnionskinCache::set(const Key& key, const doc::ImageRef& image)
+{
+  ASSERT(image);
+
+  // Remove the old version of this same image
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it) {
+    if (it->key.spriteId == key.spriteId &&
+        it->key.imageId == key.imageId) {
+      removeEntry(it);
+      break;
+    }
+  }
+
+  // Too big to be cached
+  const std::size_t size = image->getMemSize();
+  if (size > m_maxMemSize)
+    return;
+
+  m_entries.push_front(Entry{ key, image });
+  m_memSize += size;
+  shrinkToFit();
+}
+
+void OnionskinCache::invalidate()
+{
+  m_entries.clear();
+  m_memSize = 0;
+}
+
+void OnionskinCache::invalidateSprite(doc::ObjectId spriteId)
+{
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    auto next = it;
+    ++next;
+    if (it->key.spriteId == spriteId)
+      removeEntry(it);
+    it = next;
+  }
+}
+
+void OnionskinCache::removeEntry(Entries::iterator it)
+{
+  const std::size_t size = it->image->getMemSize();
+  ASSERT(m_memSize >= size);
+  m_memSize -= size;
+  m_entries.erase(it);
+}
+
+void OnionskinCache::shrinkToFit()
+{
+  while (m_memSize > m_maxMemSize && !m_entries.empty())
+    removeEntry(std::prev(m_entries.end()));
+}
+
+} // namespace render
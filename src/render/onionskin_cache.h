@@ -0,0 +1,88 @@
+// Aseprite Render Library
+// Copyright (c) 2023  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#define RENDER_ONIONSKIN_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace render {
+
+  // Cache of cel images of the previous/next frames converted to RGB
+  // (indexed/grayscale images and tilemaps) used to draw the onion
+  // skin, so we don't need to convert them on each repaint (e.g.
+  // while we paint in the current frame). The converted images are
+  // blended with the same opacity/blend mode of the original cels, so
+  // the result is the same as rendering the original cels.
+  //
+  // Each cel image is cached with a key that contains the state of
+  // the image and all the objects used to convert it (palette,
+  // tileset, etc.), so when something changes, the key doesn't match
+  // anymore and the image is converted again.
+  class OnionskinCache {
+  public:
+    static const std::size_t kDefaultMaxMemSize = 64*1024*1024;
+
+    struct Key {
+      doc::ObjectId spriteId = 0;
+      doc::ObjectId imageId = 0;
+      std::vector<uint32_t> state;
+
+      bool operator==(const Key& other) const {
+        return (spriteId == other.spriteId &&
+                imageId == other.imageId &&
+                state == other.state);
+      }
+      bool operator!=(const Key& other) const {
+        return !operator==(other);
+      }
+    };
+
+    explicit OnionskinCache(std::size_t maxMemSize = kDefaultMaxMemSize);
+
+    // Memory budget for all the cached images
+    std::size_t maxMemSize() const { return m_maxMemSize; }
+    void setMaxMemSize(std::size_t maxMemSize);
+    std::size_t memSize() const { return m_memSize; }
+
+    // Returns the cached RGB image for the given key (or nullptr).
+    doc::ImageRef get(const Key& key);
+
+    // Adds a new RGB image to the cache (it replaces the old
+    // conversion of the same cel image).
+    void set(const Key& key, const doc::ImageRef& image);
+
+    // Removes all cached images.
+    void invalidate();
+
+    // Removes all cached images of the given sprite.
+    void invalidateSprite(doc::ObjectId spriteId);
+
+  private:
+    struct Entry {
+      Key key;
+      doc::ImageRef image;
+    };
+    using Entries = std::list<Entry>; // Most recently used first
+
+    void removeEntry(Entries::iterator it);
+    void shrinkToFit();
+
+    Entries m_entries;
+    std::size_t m_memSize = 0;
+    std::size_t m_maxMemSize;
+  };
+
+} // namespace render
+
+#endif
@@ -637,6 +637,103 @@ bool has_visible_reference_layers(const LayerGroup* group)
   return false;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Conversion of cels to RGB (for the onion skin cache)
+
+template<class SrcTraits>
+struct RgbConversion;
+
+template<>
+struct RgbConversion<RgbTraits> {
+  static color_t convert(const color_t c, const Palette* pal) {
+    return c;
+  }
+};
+
+template<>
+struct RgbConversion<GrayscaleTraits> {
+  static color_t convert(const color_t c, const Palette* pal) {
+    const int v = graya_getv(c);
+    return rgba(v, v, v, graya_geta(c));
+  }
+};
+
+template<>
+struct RgbConversion<IndexedTraits> {
+  static color_t convert(const color_t c, const Palette* pal) {
+    return pal->getEntry(c);
+  }
+};
+
+// Converts the pixels of "src" (except its mask color) to RGB in the
+// given position of "dst", as BlenderHelper<RgbTraits, SrcTraits>
+// does. Returns false if a converted pixel is equal to the mask
+// color of "dst" (it would be skipped as a transparent pixel).
+template<class SrcTraits>
+bool convert_image_to_rgb_templ(Image* dst, const Image* src,
+                                const Palette* pal,
+                                const int x, const int y)
+{
+  const gfx::Rect bounds =
+    dst->bounds().createIntersection(gfx::Rect(x, y, src->width(), src->height()));
+  const color_t srcMask = src->maskColor();
+  const color_t dstMask = dst->maskColor();
+
+  for (int v=bounds.y; v<bounds.y2(); ++v) {
+    for (int u=bounds.x; u<bounds.x2(); ++u) {
+      const color_t c = get_pixel_fast<SrcTraits>(src, u-x, v-y);
+      if (c == srcMask)
+        continue;
+
+      const color_t rgb = RgbConversion<SrcTraits>::convert(c, pal);
+      if (rgb == dstMask)
+        return false;
+
+      put_pixel_fast<RgbTraits>(dst, u, v, rgb);
+    }
+  }
+  return true;
+}
+
+bool convert_image_to_rgb(Image* dst, const Image* src,
+                          const Palette* pal,
+                          const int x, const int y)
+{
+  switch (src->pixelFormat()) {
+    case IMAGE_RGB:       return convert_image_to_rgb_templ<RgbTraits>(dst, src, pal, x, y);
+    case IMAGE_GRAYSCALE: return convert_image_to_rgb_templ<GrayscaleTraits>(dst, src, pal, x, y);
+    case IMAGE_INDEXED:   return convert_image_to_rgb_templ<IndexedTraits>(dst, src, pal, x, y);
+  }
+  return false;
+}
+
+// Returns a color that cannot be the result of converting a pixel of
+// the given format to RGB, so it can be used as the mask color of the
+// converted image (to skip the same pixels as the original image).
+color_t rgb_mask_color_for_conversion(const PixelFormat format,
+                                      const Palette* pal)
+{
+  switch (format) {
+    case IMAGE_GRAYSCALE:
+      // Gray pixels are converted to rgba(v, v, v, a)
+      return rgba(255, 0, 0, 0);
+    case IMAGE_INDEXED:
+      // One of the first 257 colors is not in the palette
+      for (color_t c=0; ; ++c) {
+        int i = 0;
+        for (; i<256; ++i) {
+          if (pal->getEntry(i) == c)
+            break;
+        }
+        if (i == 256)
+          return c;
+      }
+  }
+  // RGB pixels can have any value (convert_image_to_rgb() fails if
+  // we find this color)
+  return rgba(255, 0, 255, 0);
+}
+
 } // anonymous namespace
 
 Render::Render()
@@ -657,6 +754,8 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_onionskinCache(nullptr)
+  , m_onionskinComposite(nullptr)
 {
 }
 
@@ -744,6 +843,11 @@ void Render::disableOnionskin()
   m_onionskin.type(OnionskinType::NONE);
 }
 
+void Render::setOnionskinCache(OnionskinCache* cache)
+{
+  m_onionskinCache = cache;
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -971,6 +1075,12 @@ void Render::renderOnionskin(
                                  std::min(frame, m_onionskin.prevFrames()));
     play.nextFrame(-prevFrames);
 
+    // Cels of previous/next frames can be drawn from their cached
+    // RGB conversion (see renderCachedOnionskinCel())
+    if (m_onionskinCache && dstImage->pixelFormat() == IMAGE_RGB)
+      m_onionskinComposite =
+        getImageComposition(IMAGE_RGB, IMAGE_RGB, m_sprite->root());
+
     for (frame_t frameOut = frame - prevFrames;
          frameOut <= frame + m_onionskin.nextFrames();
          ++frameOut, play.nextFrame()) {
@@ -1009,7 +1119,160 @@ void Render::renderOnionskin(
           true, blendMode);
       }
     }
+
+    m_onionskinComposite = nullptr;
+  }
+}
+
+// Renders the given cel of an onion skin frame using its conversion
+// to RGB from the m_onionskinCache (the conversion is created if it's
+// not in the cache). Returns false if we cannot use the cache for this
+// cel (it must be rendered as usual).
+//
+// The converted image is blended with the same opacity/blend mode, and
+// transparent pixels are skipped using the mask color of the
+// converted image (see rgb_mask_color_for_conversion()), so the result
+// is the same as blending the original cel.
+bool Render::renderCachedOnionskinCel(
+  Image* dstImage,
+  const Cel* cel,
+  const Image* celImage,
+  const Layer* layer,
+  const Palette* pal,
+  const gfx::RectF& celBounds,
+  const gfx::Clip& area,
+  const int opacity,
+  const BlendMode blendMode)
+{
+  ASSERT(m_onionskinCache);
+  ASSERT(m_onionskinComposite);
+
+  // RGB images don't need a conversion, and the SRC/DST_OVER blend
+  // modes don't skip transparent pixels.
+  if (celImage->pixelFormat() == IMAGE_RGB ||
+      layer->isReference() ||
+      blendMode == BlendMode::SRC ||
+      blendMode == BlendMode::DST_OVER)
+    return false;
+
+  // Cels of the current layer can be modified in place (e.g. while
+  // we're drawing), so we cannot trust their versions.
+  const Cel* currentCel =
+    (m_currentLayer ? m_currentLayer->cel(m_currentFrame): nullptr);
+  const Cel* extraCel =
+    (m_currentLayer && m_extraCel ? m_currentLayer->cel(m_extraCel->frame()): nullptr);
+  if (celImage != cel->image() || // Preview image
+      (currentCel && cel->data() == currentCel->data()) ||
+      (extraCel && cel->data() == extraCel->data()) ||
+      (m_extraType == ExtraType::OVER_COMPOSITE && layer == m_currentLayer))
+    return false;
+
+  if (celImage->pixelFormat() == IMAGE_TILEMAP) {
+    if (m_previewTileset && checkIfWeShouldUsePreview(cel))
+      return false;
+
+    // Tiles are blended one by one, which is the same as blending
+    // the whole converted tilemap only with integer scales.
+    double intpart;
+    if (m_proj.scaleX() < 1.0 ||
+        m_proj.scaleY() < 1.0 ||
+        std::modf(m_proj.scaleX(), &intpart) != 0.0 ||
+        std::modf(m_proj.scaleY(), &intpart) != 0.0)
+      return false;
   }
+
+  ImageRef rgb = getOnionskinCelInRgb(cel, layer, pal);
+  if (!rgb)
+    return false;
+
+  renderImage(dstImage, rgb.get(), pal, celBounds,
+              area, m_onionskinComposite, opacity, blendMode);
+  return true;
+}
+
+// Returns the cel image converted to RGB from the onion skin cache,
+// or creates the conversion if it's not in the cache. Returns nullptr
+// if the cel cannot be converted (e.g. it's too big for the cache).
+ImageRef Render::getOnionskinCelInRgb(
+  const Cel* cel,
+  const Layer* layer,
+  const Palette* pal)
+{
+  const Image* image = cel->image();
+  const gfx::Rect bounds = cel->bounds();
+  const Tileset* tileset =
+    (layer->isTilemap() ? static_cast<const LayerTilemap*>(layer)->tileset(): nullptr);
+  if (image->pixelFormat() == IMAGE_TILEMAP && !tileset)
+    return nullptr;
+
+  const PixelFormat format =
+    (tileset ? m_sprite->pixelFormat(): image->pixelFormat());
+
+  OnionskinCache::Key key;
+  key.spriteId = m_sprite->id();
+  key.imageId = image->id();
+  auto& state = key.state;
+  state.push_back(image->version());
+  state.push_back(uint32_t(format));
+  state.push_back(image->maskColor());
+  state.push_back(m_sprite->transparentColor());
+  state.push_back(bounds.w);
+  state.push_back(bounds.h);
+  if (format == IMAGE_INDEXED) {
+    state.push_back(pal->id());
+    state.push_back(pal->version());
+  }
+  if (tileset) {
+    state.push_back(tileset->id());
+    state.push_back(tileset->version());
+  }
+
+  ImageRef rgb = m_onionskinCache->get(key);
+  if (rgb)
+    return rgb;
+
+  if (bounds.isEmpty() ||
+      std::size_t(bounds.w) * bounds.h * 4 > m_onionskinCache->maxMemSize())
+    return nullptr;
+
+  const color_t maskColor = rgb_mask_color_for_conversion(format, pal);
+  rgb.reset(Image::create(IMAGE_RGB, bounds.w, bounds.h));
+  rgb->setMaskColor(maskColor);
+  clear_image(rgb.get(), maskColor);
+
+  if (tileset) {
+    // Same tiles positions used in renderCel()
+    doc::Grid grid = tileset->grid();
+    grid.origin(grid.origin() + bounds.origin());
+
+    for (int v=0; v<image->height(); ++v) {
+      for (int u=0; u<image->width(); ++u) {
+        const tile_t t = image->getPixel(u, v);
+        if (t == doc::notile)
+          continue;
+
+        // Flipped tiles use a special composite function
+        if (tile_getf(t))
+          return nullptr;
+
+        const ImageRef tileImage = tileset->get(tile_geti(t));
+        if (!tileImage)
+          continue;
+
+        const gfx::Point pos =
+          grid.tileToCanvas(gfx::Point(u, v)) - bounds.origin();
+        if (!convert_image_to_rgb(rgb.get(), tileImage.get(), pal,
+                                  pos.x, pos.y))
+          return nullptr;
+      }
+    }
+  }
+  else if (!convert_image_to_rgb(rgb.get(), image, pal, 0, 0)) {
+    return nullptr;
+  }
+
+  m_onionskinCache->set(key, rgb);
+  return rgb;
 }
 
 void Render::renderCheckeredBackground(
@@ -1214,9 +1477,17 @@ void Render::renderPlan(
             if (!isSelected && m_nonactiveLayersOpacity != 255)
               opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
 
+            // Cels of onion skin frames can be drawn from their cached
+            // RGB conversion
+            const bool cached =
+              (m_onionskinComposite && !drawExtra &&
+               renderCachedOnionskinCel(
+                 image, cel, celImage, layer, pal,
+                 celBounds, area, opacity, layerBlendMode));
+
             // Generally this is just one pass, but if we are using
             // OVER_COMPOSITE extra cel, this will be two passes.
-            for (int pass=0; pass<2; ++pass) {
+            for (int pass=0; pass<2 && !cached; ++pass) {
               // Draw parts outside the "m_extraCel" area
               if (drawExtra && m_extraType == ExtraType::PATCH) {
                 gfx::Region originalAreas(area.srcBounds());
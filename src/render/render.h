@@ -21,6 +21,7 @@
 #include "gfx/size.h"
 #include "render/bg_options.h"
 #include "render/extra_type.h"
+#include "render/onionskin_cache.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
@@ -86,6 +87,11 @@ namespace render {
     void setOnionskin(const OnionskinOptions& options);
     void disableOnionskin();
 
+    // Sets a cache to re-use the cels of previous/next frames
+    // converted to RGB between calls to renderSprite() (only used
+    // when the onion skin is rendered in an RGB image).
+    void setOnionskinCache(OnionskinCache* cache);
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -161,6 +167,22 @@ namespace render {
       const frame_t frame,
       const CompositeImageFunc compositeImage);
 
+    bool renderCachedOnionskinCel(
+      Image* dstImage,
+      const Cel* cel,
+      const Image* celImage,
+      const Layer* layer,
+      const Palette* pal,
+      const gfx::RectF& celBounds,
+      const gfx::Clip& area,
+      const int opacity,
+      const BlendMode blendMode);
+
+    ImageRef getOnionskinCelInRgb(
+      const Cel* cel,
+      const Layer* layer,
+      const Palette* pal);
+
     void renderPlan(
       doc::RenderPlan& plan,
       Image* image,
@@ -223,6 +245,10 @@ namespace render {
     gfx::Point m_previewPos;
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
+    OnionskinCache* m_onionskinCache;
+    // Function to draw cached RGB cels when we are rendering onion
+    // skin frames (nullptr if we cannot use the cache).
+    CompositeImageFunc m_onionskinComposite;
     ImageBufferPtr m_tmpBuf;
   };
 
@@ -15,10 +15,14 @@
 
 #include "doc/cel.h"
 #include "doc/document.h"
+#include "doc/grid.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
 
 #include <memory>
 
@@ -277,6 +281,208 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, CachedOnionskin)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 2, 2)));
+  Sprite* sprite = doc->sprite();
+  auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+
+  sprite->setTotalFrames(frame_t(2));
+  Image* src0 = layer->cel(0)->image();
+  clear_image(src0, 0);
+  put_pixel(src0, 0, 0, 1);
+
+  ImageRef src1(Image::create(IMAGE_INDEXED, 2, 2));
+  clear_image(src1.get(), 0);
+  put_pixel(src1.get(), 1, 1, 2);
+  layer->addCel(new Cel(frame_t(1), src1));
+
+  OnionskinOptions opts(OnionskinType::MERGE);
+  opts.prevFrames(1);
+  opts.opacityBase(128);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 2, 2));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 2, 2));
+
+  Render render;
+  render.setOnionskin(opts);
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+
+  OnionskinCache cache;
+  Render cachedRender;
+  cachedRender.setOnionskin(opts);
+  cachedRender.setOnionskinCache(&cache);
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_LT(0u, cache.memSize());
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+
+  // Use the cached cel
+  clear_image(dst.get(), 0);
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+
+  // Modify the previous frame, the cached cel must not be used
+  put_pixel(src0, 1, 0, 3);
+  src0->incrementVersion();
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+
+  // Modify the palette
+  sprite->palette(0)->setEntry(3, rgba(10, 20, 30, 40));
+  sprite->palette(0)->incrementVersion();
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+}
+
+TEST(Render, CachedOnionskinWithSeveralLayers)
+{
+  for (auto colorMode : { ColorMode::RGB,
+                          ColorMode::GRAYSCALE,
+                          ColorMode::INDEXED }) {
+    std::shared_ptr<Document> doc = std::make_shared<Document>();
+    doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(colorMode, 4, 4)));
+    Sprite* sprite = doc->sprite();
+    sprite->setTotalFrames(frame_t(2));
+
+    // A non-transparent color with alpha=0 (it isn't skipped as the
+    // transparent color)
+    sprite->palette(0)->setEntry(5, rgba(10, 20, 30, 0));
+
+    auto color = [colorMode](int r, int g, int b, int a, int index) -> color_t {
+      switch (colorMode) {
+        case ColorMode::RGB: return rgba(r, g, b, a);
+        case ColorMode::GRAYSCALE: return graya((r+g+b)/3, a);
+        default: return index;
+      }
+    };
+
+    auto layer1 = static_cast<LayerImage*>(sprite->root()->firstLayer());
+    clear_image(layer1->cel(0)->image(), color(255, 0, 0, 128, 1));
+    put_pixel(layer1->cel(0)->image(), 1, 1, color(10, 20, 30, 0, 5));
+    put_pixel(layer1->cel(0)->image(), 2, 2, sprite->transparentColor());
+
+    auto group = new LayerGroup(sprite);
+    sprite->root()->addLayer(group);
+
+    auto layer2 = new LayerImage(sprite);
+    layer2->setBlendMode(BlendMode::MULTIPLY);
+    layer2->setOpacity(200);
+    group->addLayer(layer2);
+    ImageRef img2(Image::create(sprite->pixelFormat(), 2, 4));
+    clear_image(img2.get(), color(0, 255, 128, 100, 2));
+    Cel* cel2 = new Cel(frame_t(0), img2);
+    cel2->setOpacity(100);
+    layer2->addCel(cel2);
+
+    auto layer3 = new LayerImage(sprite);
+    layer3->setBlendMode(BlendMode::SCREEN);
+    sprite->root()->addLayer(layer3);
+    ImageRef img3(Image::create(sprite->pixelFormat(), 4, 2));
+    clear_image(img3.get(), color(0, 0, 255, 160, 3));
+    layer3->addCel(new Cel(frame_t(0), img3));
+
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 4, 4));
+    std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 4, 4));
+
+    for (auto type : { OnionskinType::MERGE,
+                       OnionskinType::RED_BLUE_TINT }) {
+      OnionskinOptions opts(type);
+      opts.prevFrames(1);
+      opts.opacityBase(128);
+
+      OnionskinCache cache;
+      Render render;
+      Render cachedRender;
+      render.setOnionskin(opts);
+      cachedRender.setOnionskin(opts);
+      cachedRender.setOnionskinCache(&cache);
+
+      auto expectSameRender = [&]{
+        render.renderSprite(expected.get(), sprite, frame_t(1));
+        for (int i=0; i<2; ++i) {
+          clear_image(dst.get(), 0);
+          cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+          EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+        }
+      };
+
+      // Each cel is blended with its own opacity/blend mode
+      expectSameRender();
+
+      // Only images that need a conversion are cached
+      if (colorMode == ColorMode::RGB)
+        EXPECT_EQ(0u, cache.memSize());
+      else
+        EXPECT_LT(0u, cache.memSize());
+
+      // Hidden layers are not rendered
+      group->setVisible(false);
+      expectSameRender();
+      group->setVisible(true);
+    }
+  }
+}
+
+TEST(Render, CachedOnionskinWithTilemaps)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::INDEXED, 4, 4)));
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(frame_t(2));
+
+  Tileset* tileset = new Tileset(sprite, Grid::MakeRect(gfx::Size(2, 2)), 3);
+  sprite->tilesets()->add(tileset);
+  clear_image(tileset->get(1).get(), 1);
+  clear_image(tileset->get(2).get(), 2);
+  put_pixel(tileset->get(2).get(), 1, 1, sprite->transparentColor());
+
+  auto layer = new LayerTilemap(sprite, 0);
+  sprite->root()->addLayer(layer);
+
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, 2, 2));
+  put_pixel(tilemap.get(), 0, 0, tile(1, 0));
+  put_pixel(tilemap.get(), 1, 0, notile);
+  put_pixel(tilemap.get(), 0, 1, tile(2, 0));
+  put_pixel(tilemap.get(), 1, 1, tile(1, 0));
+  layer->addCel(new Cel(frame_t(0), tilemap));
+
+  OnionskinOptions opts(OnionskinType::RED_BLUE_TINT);
+  opts.prevFrames(1);
+  opts.opacityBase(128);
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 4, 4));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 4, 4));
+
+  OnionskinCache cache;
+  Render render;
+  Render cachedRender;
+  render.setOnionskin(opts);
+  cachedRender.setOnionskin(opts);
+  cachedRender.setOnionskinCache(&cache);
+
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_LT(0u, cache.memSize());
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+
+  // Modify a tile
+  put_pixel(tileset->get(1).get(), 0, 0, 3);
+  tileset->incrementVersion();
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+
+  // Flipped tiles are rendered without the cache
+  put_pixel(tilemap.get(), 1, 0, tile(2, tile_f_xflip));
+  tilemap->incrementVersion();
+  render.renderSprite(expected.get(), sprite, frame_t(1));
+  cachedRender.renderSprite(dst.get(), sprite, frame_t(1));
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,43 @@
+#! /bin/bash
+# Copyright (C) 2023 Igara Studio S.A.
+
+# --jobs N loads/saves the files in background threads, but the
+# output (order and content) must be the same as processing them one
+# by one.
+
+sprites="sprites/1empty3.aseprite
+sprites/abcd.aseprite
+sprites/groups2.aseprite
+sprites/groups3abc.aseprite
+sprites/link.aseprite
+sprites/point4frames.aseprite
+sprites/slices.aseprite
+sprites/tags3.aseprite"
+
+for j in 1 4 ; do
+    d=$t/jobs-$j
+    mkdir -p $d
+
+    list_args=""
+    save_args=""
+    for s in $sprites ; do
+	list_args="$list_args --list-layers --list-tags --list-slices $s"
+	save_args="$save_args $s --save-as $d/$(basename $s .aseprite)-{frame}.png"
+    done
+
+    $ASEPRITE -b -j $j $list_args >$d/list.txt 2>/dev/null || exit 1
+    $ASEPRITE -b -j $j $sprites --sheet $d/sheet.png --data $d/sheet.json 2>/dev/null || exit 1
+    $ASEPRITE -b -j $j $save_args 2>/dev/null || exit 1
+    # The document is modified (--trim) while previous saves are running
+    $ASEPRITE -b -j $j \
+	      sprites/groups3abc.aseprite --trim --split-layers --save-as $d/split-{layer}-{frame}.png \
+	      sprites/abcd.aseprite --trim --save-as $d/abcd-trim.png 2>/dev/null || exit 1
+done
+
+! diff -u $t/jobs-1/list.txt $t/jobs-4/list.txt && fail "--list-* output is different using --jobs 4"
+! diff -u $t/jobs-1/sheet.json $t/jobs-4/sheet.json && fail "--data output is different using --jobs 4"
+
+expect "$(cd $t/jobs-1 && ls -1)" "ls -1 $t/jobs-4"
+for f in $(cd $t/jobs-1 && ls -1) ; do
+    cmp -s $t/jobs-1/$f $t/jobs-4/$f || fail "$f is different using --jobs 4"
+done
@@ -1,5 +1,5 @@
 #! /bin/bash
-# Copyright (C) 2019-2022 Igara Studio S.A.
+# Copyright (C) 2019-2023 Igara Studio S.A.
 
 # $1 = first sprite sheet json file
 # $2 = second sprite sheet json file
@@ -416,3 +416,36 @@ t = tags["tags3-reverse"]  assert(t.from == 4 and t.to == 7)
 t = tags["tags3-pingpong"] assert(t.from == 8 and t.to == 11)
 EOF
 $ASEPRITE -b -script "$d/compare.lua" || exit 1
+
+# The CLI renders and saves the texture by bands of rows, it must be
+# equal to the texture rendered in memory by the ExportSpriteSheet
+# command (the vertical texture is taller than one band of rows)
+d=$t/sheet-by-rows
+mkdir $d
+$ASEPRITE -b -split-layers "sprites/1empty3.aseprite" \
+	  -sheet-type vertical \
+	  -inner-padding 1 -shape-padding 2 -extrude \
+	  -sheet "$d/sheet1.png" \
+	  -data "$d/sheet1.json" || exit 1
+cat >$d/create.lua <<EOF
+local sprite = app.open("sprites/1empty3.aseprite")
+app.command.ExportSpriteSheet {
+  type="vertical",
+  splitLayers=true,
+  innerPadding=1,
+  shapePadding=2,
+  extrude=true,
+  textureFilename="$d/sheet2.png",
+  dataFilename="$d/sheet2.json"
+}
+EOF
+$ASEPRITE -b -script "$d/create.lua" || exit 1
+cat >$d/compare.lua <<EOF
+local sheet1 = app.open("$d/sheet1.png")
+local sheet2 = app.open("$d/sheet2.png")
+assert(sheet1.height > 64)
+assert(sheet1.width == sheet2.width)
+assert(sheet1.height == sheet2.height)
+assert(sheet1.cels[1].image:isEqual(sheet2.cels[1].image))
+EOF
+$ASEPRITE -b -script "$d/compare.lua" || exit 1
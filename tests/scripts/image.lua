@@ -476,3 +476,91 @@ local spr = Sprite(3, 3)   -- Test with sprite (with transactions & undo/redo)
 test_image_flip(app.image)
 app.sprite = nil           -- Test without sprite (without transactions)
 test_image_flip(Image(3, 3))
+
+-- Image:remap()
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  array_to_pixels({ 0, 1, 2,
+                    2, 1, 0 }, img)
+  img:remap{ [1]=5, [2]=7 }
+  expect_img(img, { 0, 5, 7,
+                    7, 5, 0 })
+
+  local r = rgba(255, 0, 0)
+  local g = rgba(0, 255, 0)
+  local b = rgba(0, 0, 255)
+  local rgb = Image(2, 2)
+  array_to_pixels({ r, g,
+                    g, 0 }, rgb)
+  rgb:remap{ [g]=b, [0]=r }
+  expect_img(rgb, { r, b,
+                    b, r })
+end
+
+-- Image:getBytes() / Image:setBytes()
+do
+  local img = Image(3, 3, ColorMode.INDEXED)
+  array_to_pixels({ 1, 2, 3,
+                    4, 5, 6,
+                    7, 8, 9 }, img)
+  assert(img:getBytes() == img.bytes)
+  assert(img:getBytes(Rectangle(1, 1, 2, 2)) == string.char(5, 6, 8, 9))
+  assert(img:getBytes(Rectangle(2, 2, 4, 4)) == string.char(9))
+
+  img:setBytes(string.char(10, 11, 12, 13), Rectangle(0, 1, 2, 2))
+  expect_img(img, { 1, 2, 3,
+                    10, 11, 6,
+                    12, 13, 9 })
+
+  local ok = pcall(function() img:setBytes(string.char(1), Rectangle(0, 0, 2, 2)) end)
+  assert(not ok)
+end
+
+-- Image:getBytes() / Image:setBytes() with 1bpp bitmaps (rows are
+-- bit-packed, the first pixel is the least significant bit)
+do
+  local img = Image(10, 2, 3) -- ColorMode 3 = bitmap
+  array_to_pixels({ 1, 0, 1, 1, 0, 0, 0, 1, 1, 0,
+                    0, 1, 0, 0, 1, 1, 1, 0, 0, 1 }, img)
+  assert(img:getBytes() == string.char(141, 1, 114, 2))
+  assert(img:getBytes(Rectangle(1, 0, 3, 2)) == string.char(6, 1))
+
+  img:setBytes(string.char(5, 2), Rectangle(7, 0, 3, 2))
+  expect_img(img, { 1, 0, 1, 1, 0, 0, 0, 1, 0, 1,
+                    0, 1, 0, 0, 1, 1, 1, 0, 1, 0 })
+
+  local ok = pcall(function() img:setBytes(string.char(1, 2, 3), Rectangle(0, 0, 10, 1)) end)
+  assert(not ok)
+end
+
+function test_image_bulk_ops_undo(img)
+  array_to_pixels({ 1, 2,
+                    3, 4 }, img)
+  if not app.sprite then return end
+
+  img:remap{ [2]=9 }
+  expect_img(img, { 1, 9,
+                    3, 4 })
+  img:setBytes(string.char(7), Rectangle(0, 1, 1, 1))
+  expect_img(img, { 1, 9,
+                    7, 4 })
+  app.undo()
+  expect_img(img, { 1, 9,
+                    3, 4 })
+  app.undo()
+  expect_img(img, { 1, 2,
+                    3, 4 })
+
+  img:setBytes(string.char(5, 6), Rectangle(1, 0, 1, 2))
+  expect_img(img, { 1, 5,
+                    3, 6 })
+  app.undo()
+  expect_img(img, { 1, 2,
+                    3, 4 })
+end
+
+do
+  local spr = Sprite(2, 2, ColorMode.INDEXED)
+  test_image_bulk_ops_undo(app.image)
+  app.sprite = nil
+end
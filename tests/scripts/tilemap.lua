@@ -1326,3 +1326,53 @@ do
                      0,   0,     1|d,   (1|x|d),
                      0,   0,     1|y|d, (1|x|y|d) })
 end
+
+----------------------------------------------------------------------
+-- Tests AUTO mode after modifying the tilemap with the Image API
+-- (the tiles histogram must be updated with those changes)
+----------------------------------------------------------------------
+
+do
+  local spr = Sprite(8, 4, ColorMode.INDEXED)
+  spr.gridBounds = Rectangle{ 0, 0, 4, 4 }
+  app.command.NewLayer{ tilemap=true }
+  local lay = spr.layers[2]
+  local ts = lay.tileset
+
+  app.useTool{ tool='pencil', color=1, layer=lay,
+               tilesetMode=TilesetMode.AUTO,
+               points={ Point(1, 1) }}
+  app.useTool{ tool='pencil', color=1, layer=lay,
+               tilesetMode=TilesetMode.AUTO,
+               points={ Point(6, 2) }}
+  expect_eq(3, #ts)
+  expect_img(lay:cel(1).image, { 1, 2 })
+
+  local tile1 = { 0,0,0,0,
+                  0,1,0,0,
+                  0,0,0,0,
+                  0,0,0,0 }
+
+  -- Now tile 1 is used twice, it cannot be modified in place
+  lay:cel(1).image:drawPixel(1, 0, 1)
+  app.useTool{ tool='pencil', color=2, layer=lay,
+               tilesetMode=TilesetMode.AUTO,
+               points={ Point(2, 2) }}
+  expect_eq(4, #ts)
+  expect_img(lay:cel(1).image, { 3, 1 })
+  expect_img(ts:getTile(1), tile1)
+  expect_img(ts:getTile(3), { 0,0,0,0,
+                              0,1,0,0,
+                              0,0,2,0,
+                              0,0,0,0 })
+
+  -- Tile 1 is used twice again, and the first one is replaced with
+  -- the existent tile 3, so tile 1 cannot be removed
+  lay:cel(1).image:clear(1)
+  app.useTool{ tool='pencil', color=2, layer=lay,
+               tilesetMode=TilesetMode.AUTO,
+               points={ Point(2, 2) }}
+  expect_eq(4, #ts)
+  expect_img(lay:cel(1).image, { 3, 1 })
+  expect_img(ts:getTile(1), tile1)
+end